@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// One block of conversions delivered by a backend: 'count' conversions
+// already averaged by the driver (count = 1 for single conversions)
+struct AdcFrame {
+  float mv;
+  uint16_t count;
+};
+
+// Hardware abstraction for the ADC sampling engine. The ESP32 backends live
+// in AdcBackendEsp32.cpp; a synthetic backend can drive AdcSampler::pump()
+// on a host without any hardware.
+class IAdcBackend {
+public:
+  virtual ~IAdcBackend() {}
+
+  // Configure 'pin' for background sampling at 'sampleRateHz' conversions/s
+  virtual bool begin(uint8_t pin, uint32_t sampleRateHz) = 0;
+
+  // Wait up to 'timeoutMs' for new conversions and copy up to 'max' frames.
+  // Returns the number of frames written.
+  virtual size_t read(AdcFrame* out, size_t max, uint32_t timeoutMs) = 0;
+};
+
+// Best backend available for this core (continuous/DMA where supported)
+IAdcBackend* createAdcBackend();
@@ -0,0 +1,223 @@
+#include "AdcBackend.h"
+#include <Arduino.h>
+
+#if ESP_ARDUINO_VERSION >= ESP_ARDUINO_VERSION_VAL(3, 0, 0)
+
+// Continuous (DMA) driver: conversions run in hardware at the requested
+// rate; the driver averages CONVERSIONS_PER_FRAME of them per frame.
+static const uint32_t CONVERSIONS_PER_FRAME = 8;
+
+static volatile bool g_frame_ready = false;
+static TaskHandle_t g_reader_task = nullptr;
+
+static void ARDUINO_ISR_ATTR onAdcFrame() {
+  g_frame_ready = true;
+  if (g_reader_task) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(g_reader_task, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+}
+
+class AdcContinuousBackend : public IAdcBackend {
+public:
+  bool begin(uint8_t pin, uint32_t sampleRateHz) override {
+    _pin = pin;
+    analogContinuousSetAtten(ADC_11db);  // Full range ~0-2.6V
+    uint8_t pins[1] = {pin};
+    if (!analogContinuous(pins, 1, CONVERSIONS_PER_FRAME, sampleRateHz, &onAdcFrame)) {
+      return false;
+    }
+    return analogContinuousStart();
+  }
+
+  size_t read(AdcFrame* out, size_t max, uint32_t timeoutMs) override {
+    if (max == 0) return 0;
+    g_reader_task = xTaskGetCurrentTaskHandle();
+    if (!g_frame_ready) {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs));
+    }
+    if (!g_frame_ready) return 0;
+    g_frame_ready = false;
+
+    adc_continuous_data_t* result = nullptr;
+    if (!analogContinuousRead(&result, 0) || result == nullptr) return 0;
+    out[0].mv = (float)result[0].avg_read_mvolts;
+    out[0].count = CONVERSIONS_PER_FRAME;
+    return 1;
+  }
+
+private:
+  uint8_t _pin = 0;
+};
+
+IAdcBackend* createAdcBackend() {
+  return new AdcContinuousBackend();
+}
+
+#else
+
+// One-shot conversions paced by the FreeRTOS tick, from the sampler's
+// background task. The main loop still never blocks on the ADC. Used on
+// core 2.x when the DMA controller can't take the pin.
+class AdcPolledBackend : public IAdcBackend {
+public:
+  bool begin(uint8_t pin, uint32_t sampleRateHz) override {
+    _pin = pin;
+    _perTick = sampleRateHz / (1000 / portTICK_PERIOD_MS);
+    if (_perTick == 0) _perTick = 1;
+    analogSetPinAttenuation(pin, ADC_11db);  // Full range ~0-2.6V
+    _lastWake = xTaskGetTickCount();
+    return true;
+  }
+
+  size_t read(AdcFrame* out, size_t max, uint32_t timeoutMs) override {
+    (void)timeoutMs;
+    if (max == 0) return 0;
+    vTaskDelayUntil(&_lastWake, 1);
+
+    size_t n = (_perTick < max) ? _perTick : max;
+    for (size_t i = 0; i < n; i++) {
+      out[i].mv = (float)analogReadMilliVolts(_pin);
+      out[i].count = 1;
+    }
+    return n;
+  }
+
+private:
+  uint8_t _pin = 0;
+  uint32_t _perTick = 1;
+  TickType_t _lastWake = 0;
+};
+
+#if defined(CONFIG_IDF_TARGET_ESP32)
+
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+#include <inttypes.h>
+
+// Core 2.x (IDF 4.4) digital controller: ADC1 conversions run in hardware
+// and arrive by DMA through I2S0. The ESP32 can't run this mode below
+// 20 kHz, so the hardware runs at least that fast and each frame averages
+// hwRate / sampleRateHz conversions, counting as one conversion at the
+// requested rate - the decimator and output rate are unchanged.
+#ifdef SOC_ADC_SAMPLE_FREQ_THRES_LOW
+static const uint32_t DIGI_MIN_RATE_HZ = SOC_ADC_SAMPLE_FREQ_THRES_LOW;
+#else
+static const uint32_t DIGI_MIN_RATE_HZ = 20000;
+#endif
+static const uint32_t DIGI_BYTES_PER_INTR = 256;
+static const uint32_t DIGI_POOL_BYTES = 2048;
+static const uint32_t DIGI_RESULT_BYTES = sizeof(adc_digi_output_data_t);
+static const uint32_t DEFAULT_VREF_MV = 1100;  // Used when eFuse has no Vref
+
+class AdcDigiBackend : public IAdcBackend {
+public:
+  bool begin(uint8_t pin, uint32_t sampleRateHz) override {
+    int8_t ch = digitalPinToAnalogChannel(pin);
+    if (ch < 0 || ch >= ADC1_CHANNEL_MAX) {
+      // ADC2 shares the radio on ESP32 and has no DMA mode
+      Serial.printf("ADC pin %d not on ADC1, polling instead of DMA\n", pin);
+      _polled = true;
+      return _fallback.begin(pin, sampleRateHz);
+    }
+    _channel = (uint8_t)ch;
+
+    uint32_t hwRate = sampleRateHz < DIGI_MIN_RATE_HZ ? DIGI_MIN_RATE_HZ : sampleRateHz;
+    _perFrame = sampleRateHz ? (hwRate + sampleRateHz / 2) / sampleRateHz : 1;
+    if (_perFrame == 0) _perFrame = 1;
+
+    adc_digi_init_config_t init = {};
+    init.max_store_buf_size = DIGI_POOL_BYTES;
+    init.conv_num_each_intr = DIGI_BYTES_PER_INTR;
+    init.adc1_chan_mask = BIT(_channel);
+    init.adc2_chan_mask = 0;
+    if (adc_digi_initialize(&init) != ESP_OK) return fallBack(pin, sampleRateHz);
+
+    adc_digi_pattern_config_t pattern = {};
+    pattern.atten = ADC_ATTEN_DB_11;  // Full range ~0-2.6V
+    pattern.channel = _channel;
+    pattern.unit = 0;  // ADC1
+    pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+    adc_digi_configuration_t cfg = {};
+    cfg.conv_limit_en = true;  // Required on ESP32
+    cfg.conv_limit_num = 250;
+    cfg.pattern_num = 1;
+    cfg.adc_pattern = &pattern;
+    cfg.sample_freq_hz = hwRate;
+    cfg.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    cfg.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+    if (adc_digi_controller_configure(&cfg) != ESP_OK || adc_digi_start() != ESP_OK) {
+      adc_digi_deinitialize();
+      return fallBack(pin, sampleRateHz);
+    }
+
+    esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, DEFAULT_VREF_MV, &_chars);
+    Serial.printf("ADC pin %d: DMA at %" PRIu32 "Hz, %" PRIu32 " conversions per frame\n",
+                  pin, hwRate, _perFrame);
+    return true;
+  }
+
+  size_t read(AdcFrame* out, size_t max, uint32_t timeoutMs) override {
+    if (_polled) return _fallback.read(out, max, timeoutMs);
+    if (max == 0) return 0;
+
+    // Only ask for what fits in 'max' frames; the driver wants whole words
+    uint32_t want = ((uint32_t)max * _perFrame - _accCount) * DIGI_RESULT_BYTES;
+    if (want > sizeof(_buf)) want = sizeof(_buf);
+    want &= ~3u;
+    if (want == 0) want = 4;
+
+    uint32_t got = 0;
+    esp_err_t err = adc_digi_read_bytes(_buf, want, &got, timeoutMs);
+    // ESP_ERR_INVALID_STATE: the driver pool overflowed, data is still valid
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) return 0;
+
+    size_t n = 0;
+    for (uint32_t i = 0; i + DIGI_RESULT_BYTES <= got; i += DIGI_RESULT_BYTES) {
+      const adc_digi_output_data_t* r = (const adc_digi_output_data_t*)&_buf[i];
+      if (r->type1.channel != _channel) continue;
+      _accMv += (float)esp_adc_cal_raw_to_voltage(r->type1.data, &_chars);
+      if (++_accCount < _perFrame) continue;
+      if (n < max) {
+        out[n].mv = _accMv / (float)_accCount;
+        out[n].count = 1;
+        n++;
+      }
+      _accMv = 0.0f;
+      _accCount = 0;
+    }
+    return n;
+  }
+
+private:
+  bool fallBack(uint8_t pin, uint32_t sampleRateHz) {
+    Serial.printf("ADC pin %d: DMA init failed, polling instead\n", pin);
+    _polled = true;
+    return _fallback.begin(pin, sampleRateHz);
+  }
+
+  uint8_t _channel = 0;
+  uint32_t _perFrame = 1;
+  float _accMv = 0.0f;
+  uint32_t _accCount = 0;
+  uint8_t _buf[DIGI_BYTES_PER_INTR];
+  esp_adc_cal_characteristics_t _chars;
+  bool _polled = false;
+  AdcPolledBackend _fallback;
+};
+
+IAdcBackend* createAdcBackend() {
+  return new AdcDigiBackend();
+}
+
+#else
+
+IAdcBackend* createAdcBackend() {
+  return new AdcPolledBackend();
+}
+
+#endif
+
+#endif
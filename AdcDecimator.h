@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+
+// Oversampling decimator: averages 'factor' conversions into one output.
+// Frames carry a conversion count so pre-averaged driver frames and single
+// conversions are weighted correctly.
+class AdcDecimator {
+public:
+  explicit AdcDecimator(uint32_t factor = 1) { setFactor(factor); }
+
+  void setFactor(uint32_t factor) {
+    _factor = factor ? factor : 1;
+    reset();
+  }
+  uint32_t factor() const { return _factor; }
+
+  void reset() {
+    _sum = 0.0f;
+    _count = 0;
+  }
+
+  // Add 'count' conversions averaging 'mv'. Returns true and sets 'out'
+  // when a full output has been accumulated.
+  bool push(float mv, uint16_t count, float& out) {
+    _sum += mv * (float)count;
+    _count += count;
+    if (_count < _factor) return false;
+
+    out = _sum / (float)_count;
+    reset();
+    return true;
+  }
+
+private:
+  uint32_t _factor = 1;
+  float _sum = 0.0f;
+  uint32_t _count = 0;
+};
@@ -0,0 +1,66 @@
+#include "AdcSampler.h"
+#include "Clock.h"
+#include <Arduino.h>
+#include <inttypes.h>
+
+static const uint32_t ADC_TASK_STACK = 3072;
+static const UBaseType_t ADC_TASK_PRIORITY = 2;  // Above loop(), blocks most of the time
+static const size_t ADC_FRAMES_PER_READ = 16;
+
+AdcSampler::AdcSampler(uint8_t pin, uint32_t sampleRateHz, uint32_t outputRateHz, IAdcBackend* backend)
+  : _pin(pin), _sampleRateHz(sampleRateHz), _outputRateHz(outputRateHz ? outputRateHz : 1),
+    _backend(backend) {
+  _decimator.setFactor(_sampleRateHz / _outputRateHz);
+}
+
+bool AdcSampler::begin() {
+  if (!_backend) _backend = createAdcBackend();
+  if (!_backend->begin(_pin, _sampleRateHz)) {
+    Serial.printf("ADC pin %d: backend init failed\n", _pin);
+    return false;
+  }
+
+  xTaskCreatePinnedToCore(taskEntry, "adc", ADC_TASK_STACK, this, ADC_TASK_PRIORITY, nullptr, 1);
+  Serial.printf("ADC pin %d sampling at %" PRIu32 "Hz, %" PRIu32 " outputs/s (x%" PRIu32 " oversampling)\n",
+                _pin, _sampleRateHz, _outputRateHz, _decimator.factor());
+  return true;
+}
+
+void AdcSampler::taskEntry(void* arg) {
+  AdcSampler* self = static_cast<AdcSampler*>(arg);
+  for (;;) {
+    self->pump(100);
+  }
+}
+
+void AdcSampler::pump(uint32_t timeoutMs) {
+  AdcFrame frames[ADC_FRAMES_PER_READ];
+  size_t n = _backend->read(frames, ADC_FRAMES_PER_READ, timeoutMs);
+
+  for (size_t i = 0; i < n; i++) {
+    float mv;
+    if (_decimator.push(frames[i].mv, frames[i].count, mv)) {
+      AdcReading r{Clock::nowUs(), mv};
+      _outputs.push(r);
+      if (_listener) _listener(r, _listenerCtx);
+    }
+  }
+}
+
+bool AdcSampler::latest(AdcReading& out) const {
+  return _outputs.latest(out);
+}
+
+float AdcSampler::readMillivolts() const {
+  AdcReading r;
+  return latest(r) ? r.mv : 0.0f;
+}
+
+bool AdcSampler::waitForReading(uint32_t timeoutMs) const {
+  uint32_t start = millis();
+  while (_outputs.head() == 0) {
+    if (millis() - start >= timeoutMs) return false;
+    delay(1);
+  }
+  return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+#include "AdcBackend.h"
+#include "AdcDecimator.h"
+#include "SpscRing.h"
+
+// A decimated, oversampled ADC reading
+struct AdcReading {
+  uint64_t t_us;  // Clock::nowUs() when the output was produced
+  float mv;
+};
+
+// Background ADC sampling engine. A backend fills conversions at
+// 'sampleRateHz' (several kHz); a sampler task decimates them down to
+// 'outputRateHz' and publishes the results. Readers never block and never
+// touch the ADC.
+class AdcSampler {
+public:
+  static const uint32_t OUTPUT_RING_SIZE = 64;
+
+  // Called from the sampler task for every decimated output
+  typedef void (*OutputListener)(const AdcReading& r, void* ctx);
+
+  AdcSampler(uint8_t pin, uint32_t sampleRateHz = 4000, uint32_t outputRateHz = 100,
+             IAdcBackend* backend = nullptr);
+
+  // Starts the backend and the sampler task
+  bool begin();
+
+  // Latest decimated value in mV (0 before the first output)
+  float readMillivolts() const;
+  bool latest(AdcReading& out) const;
+
+  // Copy outputs produced since 'cursor' (caller-owned), oldest first
+  uint32_t readSince(uint32_t& cursor, AdcReading* out, uint32_t max) const {
+    return _outputs.read(cursor, out, max);
+  }
+
+  // Install before begin(); runs in the sampler task
+  void setListener(OutputListener fn, void* ctx) {
+    _listener = fn;
+    _listenerCtx = ctx;
+  }
+
+  // Block until the first output exists (or timeout). Used at startup.
+  bool waitForReading(uint32_t timeoutMs) const;
+
+  // One backend read + decimation step. Called by the sampler task; can be
+  // called directly to run the engine synchronously (e.g. host-side).
+  void pump(uint32_t timeoutMs);
+
+  uint32_t getSampleRateHz() const { return _sampleRateHz; }
+  uint32_t getOutputRateHz() const { return _outputRateHz; }
+
+private:
+  uint8_t _pin;
+  uint32_t _sampleRateHz;
+  uint32_t _outputRateHz;
+  IAdcBackend* _backend;
+  AdcDecimator _decimator;
+  SpscRing<AdcReading, OUTPUT_RING_SIZE> _outputs;
+  OutputListener _listener = nullptr;
+  void* _listenerCtx = nullptr;
+
+  static void taskEntry(void* arg);
+};
@@ -0,0 +1,55 @@
+#include "AdcService.h"
+
+AdcService::AdcService(uint8_t pin, uint32_t sampleRateHz, uint32_t outputRateHz)
+  : _sampler(pin, sampleRateHz, outputRateHz),
+    _adaptive(_sampler.getOutputRateHz()) {
+  uint32_t rate = _sampler.getOutputRateHz();
+  _mean1s.len = rate;
+  _mean5s.len = rate * 5;
+  // One slot stays free so the leaving value is never the one just written
+  if (_mean1s.len > MAX_HISTORY - 1) _mean1s.len = MAX_HISTORY - 1;
+  if (_mean5s.len > MAX_HISTORY - 1) _mean5s.len = MAX_HISTORY - 1;
+  if (_mean1s.len == 0) _mean1s.len = 1;
+  if (_mean5s.len == 0) _mean5s.len = 1;
+}
+
+bool AdcService::begin() {
+  _sampler.setListener(&AdcService::readingThunk, this);
+  return _sampler.begin();
+}
+
+void AdcService::readingThunk(const AdcReading& r, void* ctx) {
+  static_cast<AdcService*>(ctx)->onReading(r);
+}
+
+void AdcService::advance(RunningMean& m, int32_t v) {
+  m.sum += v;
+  if (m.count < m.len) {
+    m.count++;
+  } else {
+    // Drop the value that just left this window (history already holds v)
+    m.sum -= _history[(_head - m.len) % MAX_HISTORY];
+  }
+}
+
+void AdcService::onReading(const AdcReading& r) {
+  int32_t v = (int32_t)(r.mv * 16.0f + 0.5f);
+  _history[_head % MAX_HISTORY] = v;
+  advance(_mean1s, v);
+  advance(_mean5s, v);
+  _head++;
+
+  AdcValue out;
+  out.t_us = r.t_us;
+  out.raw = r.mv;
+  out.avg1s = _mean1s.mean();
+  out.avg5s = _mean5s.mean();
+  out.adaptive = _adaptive.push(r.mv);
+  _published.push(out);
+}
+
+AdcValue AdcService::read() const {
+  AdcValue v{};
+  _published.latest(v);
+  return v;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include "AdcSampler.h"
+#include "AdcStepFilter.h"
+#include "SpscRing.h"
+
+// Published force ADC value (all mV at the ADC pin)
+struct AdcValue {
+  uint64_t t_us;  // Time of the newest reading (Clock::nowUs())
+  float raw;      // Newest decimated reading
+  float avg1s;    // Mean over the last 1 s
+  float avg5s;    // Mean over the last 5 s
+  float adaptive; // Mean over up to 1 s, restarted when the pendulum moves
+};
+
+// Single owner of the force ADC pin. Runs the AdcSampler and keeps O(1)
+// running 1 s and 5 s means of its outputs, plus a step-aware mean for
+// live power, then publishes an AdcValue that any task (loop, sampling,
+// async web handlers) can read lock-free.
+class AdcService {
+public:
+  static const uint32_t MAX_HISTORY = 512;  // >= 5 s of outputs
+
+  AdcService(uint8_t pin, uint32_t sampleRateHz = 4000, uint32_t outputRateHz = 100);
+
+  bool begin();
+
+  // Latest published value (zeros before the first reading)
+  AdcValue read() const;
+
+  bool waitForReading(uint32_t timeoutMs) const { return _sampler.waitForReading(timeoutMs); }
+  AdcSampler& sampler() { return _sampler; }
+
+  // Feed a reading directly, bypassing the sampler (session replay). Do
+  // not mix with begin().
+  void inject(const AdcReading& r) { onReading(r); }
+
+private:
+  // Running mean over the last 'len' outputs, kept in 1/16 mV fixed point
+  // so adding and removing never drifts
+  struct RunningMean {
+    uint32_t len = 1;
+    uint32_t count = 0;
+    int32_t sum = 0;
+    float mean() const { return count ? (float)sum / (16.0f * (float)count) : 0.0f; }
+  };
+
+  AdcSampler _sampler;
+  int32_t _history[MAX_HISTORY] = {0};
+  uint32_t _head = 0;  // Outputs seen so far
+  RunningMean _mean1s;
+  RunningMean _mean5s;
+  AdcStepFilter _adaptive;
+  SpscRing<AdcValue, 4> _published;
+
+  void onReading(const AdcReading& r);
+  void advance(RunningMean& m, int32_t v);
+  static void readingThunk(const AdcReading& r, void* ctx);
+};
@@ -0,0 +1,81 @@
+#include "AdcStepFilter.h"
+#include <math.h>
+
+// Weight of one settled reading in the noise estimate (a plain average
+// until this many readings)
+static const uint32_t MAD_SPAN = 64;
+
+AdcStepFilter::AdcStepFilter(uint32_t maxLen, float noiseFloorMv, float bandFactor, uint8_t confirm)
+  : _maxLen(maxLen), _noiseFloor(noiseFloorMv), _bandFactor(bandFactor), _confirm(confirm) {
+  // One slot stays free so the leaving value is never the one just written
+  if (_maxLen > MAX_LEN - 1 - SHORT_LEN) _maxLen = MAX_LEN - 1 - SHORT_LEN;
+  if (_maxLen == 0) _maxLen = 1;
+  if (_confirm == 0) _confirm = 1;
+  if (_confirm > _maxLen) _confirm = (uint8_t)_maxLen;
+}
+
+void AdcStepFilter::reset() {
+  _head = 0;
+  _len = 0;
+  _sum = 0;
+  _shortSum = 0;
+  _mad = 0.0f;
+  _madCount = 0;
+  _outside = 0;
+  _side = 0;
+}
+
+float AdcStepFilter::band() const {
+  float b = _mad * _bandFactor;
+  return b > _noiseFloor ? b : _noiseFloor;
+}
+
+float AdcStepFilter::push(float mv) {
+  int32_t v = (int32_t)(mv * 16.0f + 0.5f);
+
+  // Compare against the window before this reading joins it
+  if (_len) {
+    float dev = mv - value();
+    if (fabsf(dev) > band()) {
+      int8_t side = dev > 0.0f ? 1 : -1;
+      _outside = (side == _side) ? (uint8_t)(_outside + 1) : 1;
+      _side = side;
+    } else {
+      _outside = 0;
+      if (_madCount < MAD_SPAN) _madCount++;
+      _mad += (fabsf(dev) - _mad) / (float)_madCount;
+    }
+  }
+
+  _hist[_head % MAX_LEN] = v;
+  _head++;
+  _shortSum += v;
+  if (_head > SHORT_LEN) _shortSum -= at(_head - 1 - SHORT_LEN);
+
+  // Pendulum moved: restart from the readings beyond the band
+  if (_outside >= _confirm) return restart(_confirm);
+
+  _sum += v;
+  if (_len < _maxLen) {
+    _len++;
+  } else {
+    _sum -= at(_head - 1 - _maxLen);
+  }
+
+  // Pendulum still creeping: the recent mean has left the window mean by
+  // more than noise on SHORT_LEN readings can explain
+  if (_len >= 2 * SHORT_LEN) {
+    float drift = fabsf((float)_shortSum / (16.0f * SHORT_LEN) - value());
+    if (drift > band() / 2.0f) return restart(SHORT_LEN);
+  }
+  return value();
+}
+
+float AdcStepFilter::restart(uint32_t len) {
+  _len = len;
+  _sum = 0;
+  for (uint32_t i = 1; i <= _len; i++) _sum += at(_head - i);
+  _outside = 0;
+  _steps++;
+  return value();
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+
+// Running mean of force readings whose window restarts when the pendulum
+// moves. Settled, it is a plain running mean over up to 'maxLen' readings
+// (heavy smoothing). The window restarts when
+//  - 'confirm' readings in a row fall outside the noise band on the same
+//    side (a step): it restarts from those readings, or
+//  - the mean of the last SHORT_LEN readings drifts away from the window
+//    mean by more than the noise allows (the pendulum's slow tail): it
+//    restarts from those SHORT_LEN readings.
+// Either way the mean jumps to the new level instead of averaging the old
+// one out over a full window, then grows back to 'maxLen' as the load
+// settles. The noise band tracks the mean absolute deviation while
+// settled, with a floor. O(1) per reading, hardware free.
+class AdcStepFilter {
+public:
+  static const uint32_t MAX_LEN = 256;
+  static const uint32_t SHORT_LEN = 8;
+
+  AdcStepFilter(uint32_t maxLen = 100, float noiseFloorMv = 1.0f,
+                float bandFactor = 4.0f, uint8_t confirm = 3);
+
+  void reset();
+
+  // Add one reading (mV); returns the filtered value
+  float push(float mv);
+
+  float value() const { return _len ? (float)_sum / (16.0f * (float)_len) : 0.0f; }
+  uint32_t length() const { return _len; }  // Readings in the current window
+  uint32_t steps() const { return _steps; }  // Window restarts so far
+  float band() const;                        // Current noise band (mV, +/-)
+
+private:
+  uint32_t _maxLen;
+  float _noiseFloor;
+  float _bandFactor;
+  uint8_t _confirm;
+
+  // Window in 1/16 mV fixed point, like AdcService, so it never drifts
+  int32_t _hist[MAX_LEN] = {0};
+  uint32_t _head = 0;  // Readings seen so far
+  uint32_t _len = 0;
+  int32_t _sum = 0;
+  int32_t _shortSum = 0;  // Last SHORT_LEN readings
+
+  float _mad = 0.0f;     // Mean absolute deviation while settled (mV)
+  uint32_t _madCount = 0;  // Readings in the estimate (fast start)
+  uint8_t _outside = 0;  // Consecutive readings outside the band
+  int8_t _side = 0;      // ... and on which side
+  uint32_t _steps = 0;
+
+  int32_t at(uint32_t seq) const { return _hist[seq % MAX_LEN]; }
+  float restart(uint32_t len);
+};
@@ -1,60 +1,200 @@
 #include "BleCps.h"
+#include "Workout.h"
+#include "Clock.h"
+#include <Arduino.h>
 #include <NimBLEDevice.h>
 
-// Cycling Power Service and characteristics
-static NimBLECharacteristic* ch_measurement = nullptr;
-
 // UUIDs
 static const uint16_t CPS_UUID16 = 0x1818; // Cycling Power Service
 static const uint16_t CPM_UUID16 = 0x2A63; // Cycling Power Measurement (Notify)
 static const uint16_t CPF_UUID16 = 0x2A65; // Cycling Power Feature (Read)
 static const uint16_t CSL_UUID16 = 0x2A5D; // Sensor Location (Read)
+static const uint16_t CPCP_UUID16 = 0x2A66; // Cycling Power Control Point (Write, Indicate)
+static const uint16_t CSC_UUID16 = 0x1816; // Cycling Speed and Cadence Service
+static const uint16_t CSM_UUID16 = 0x2A5B; // CSC Measurement (Notify)
+static const uint16_t CSF_UUID16 = 0x2A5C; // CSC Feature (Read)
+static const uint16_t FTMS_UUID16 = 0x1826; // Fitness Machine Service
+static const uint16_t FMF_UUID16 = 0x2ACC;  // Fitness Machine Feature (Read)
+static const uint16_t IBD_UUID16 = 0x2AD2;  // Indoor Bike Data (Notify)
+static const uint16_t FMCP_UUID16 = 0x2AD9; // Fitness Machine Control Point (Write, Indicate)
+static const uint16_t FMS_UUID16 = 0x2ADA;  // Fitness Machine Status (Notify)
 
-static inline void put_u16_le(uint8_t* p, uint16_t v) {
-  p[0] = (uint8_t)(v & 0xFF);
-  p[1] = (uint8_t)((v >> 8) & 0xFF);
-}
+// FTMS advertising service data: flags (machine available) + machine type (Indoor Bike)
+static const uint8_t FTMS_ADV_DATA[3] = {0x01, 0x20, 0x00};
 
-static inline void put_s16_le(uint8_t* p, int16_t v) {
-  p[0] = (uint8_t)(v & 0xFF);
-  p[1] = (uint8_t)((v >> 8) & 0xFF);
-}
+// Sensor Location: 13 = Rear Hub (implies total power, not single-sided)
+static const uint8_t SENSOR_LOCATION = 13;
+
+// ATT errors the CPS spec gives for Control Point writes
+static const uint8_t ATT_PROCEDURE_IN_PROGRESS = 0x80;
+static const uint8_t ATT_CCCD_IMPROPERLY_CONFIGURED = 0xFD;
 
 class ServerCB : public NimBLEServerCallbacks {
-  void onDisconnect(NimBLEServer* pServer, NimBLEConnInfo& connInfo, int reason) override {
+public:
+  explicit ServerCB(BleCps* owner) : owner(owner) {}
+
+  void onConnect(NimBLEServer* pServer, NimBLEConnInfo& connInfo) override {
+    owner->onConnected(connInfo.getConnHandle());
+    // Advertising stops on connect; keep it going while there is room
+    if (pServer->getConnectedCount() < BleCps::MAX_CENTRALS) {
+      NimBLEDevice::startAdvertising();
+    }
+  }
+
+  void onDisconnect(NimBLEServer*, NimBLEConnInfo& connInfo, int) override {
+    owner->onDisconnected(connInfo.getConnHandle());
     NimBLEDevice::startAdvertising();
   }
+
+private:
+  BleCps* owner;
+};
+
+// Subscriptions to one measurement characteristic
+class SlotCB : public NimBLECharacteristicCallbacks {
+public:
+  SlotCB(BleCps* owner, uint8_t slot) : owner(owner), slot(slot) {}
+
+  void onSubscribe(NimBLECharacteristic*, NimBLEConnInfo& connInfo, uint16_t subValue) override {
+    owner->onSubscribed(slot, connInfo.getConnHandle(), subValue);
+  }
+
+private:
+  BleCps* owner;
+  uint8_t slot;
+};
+
+class FtmsControlCB : public NimBLECharacteristicCallbacks {
+public:
+  explicit FtmsControlCB(BleCps* owner) : owner(owner) {}
+
+  void onWrite(NimBLECharacteristic* pCharacteristic, NimBLEConnInfo& connInfo) override {
+    NimBLEAttValue value = pCharacteristic->getValue();
+    // Refused writes are dropped, as on the CPS Control Point
+    uint8_t attError = owner->onFtmsControl(connInfo.getConnHandle(), value.data(), value.size());
+    if (attError) {
+      Serial.printf("FTMS Control Point write refused (ATT 0x%02X)\n", attError);
+    }
+  }
+
+  void onSubscribe(NimBLECharacteristic*, NimBLEConnInfo& connInfo, uint16_t subValue) override {
+    owner->onFtmsSubscribed(connInfo.getConnHandle(), subValue);
+  }
+
+private:
+  BleCps* owner;
+};
+
+class CpsControlCB : public NimBLECharacteristicCallbacks {
+public:
+  explicit CpsControlCB(BleCps* owner) : owner(owner) {}
+
+  void onWrite(NimBLECharacteristic* pCharacteristic, NimBLEConnInfo& connInfo) override {
+    NimBLEAttValue value = pCharacteristic->getValue();
+    // NimBLE-Arduino acknowledges the write once this returns and has no
+    // way to turn it into an ATT error, so a refused request is dropped:
+    // nothing is queued and nothing is indicated.
+    uint8_t attError = owner->onCpsControl(connInfo.getConnHandle(), value.data(), value.size());
+    if (attError) {
+      Serial.printf("CPS Control Point write refused (ATT 0x%02X)\n", attError);
+    }
+  }
+
+  void onSubscribe(NimBLECharacteristic*, NimBLEConnInfo& connInfo, uint16_t subValue) override {
+    owner->onCpsSubscribed(connInfo.getConnHandle(), subValue);
+  }
+
+private:
+  BleCps* owner;
 };
 
-void BleCps::begin(const char* deviceName) {
+static void addSensorLocation(NimBLEService* service) {
+  NimBLECharacteristic* ch_location =
+      service->createCharacteristic(NimBLEUUID((uint16_t)CSL_UUID16), NIMBLE_PROPERTY::READ);
+  ch_location->setValue(&SENSOR_LOCATION, 1);
+}
+
+int8_t BleCps::addSlot(NimBLECharacteristic* characteristic, uint8_t service) {
+  if (slot_count >= MAX_SLOTS) return -1;
+  slots[slot_count].characteristic = characteristic;
+  slots[slot_count].service = service;
+  slots[slot_count].len = 0;
+  characteristic->setCallbacks(new SlotCB(this, slot_count));
+  return (int8_t)slot_count++;
+}
+
+void BleCps::begin(const char* deviceName, uint8_t enabledServices) {
+  services = enabledServices;
   NimBLEDevice::init(deviceName);
   NimBLEDevice::setPower(ESP_PWR_LVL_P9);
 
   NimBLEServer* server = NimBLEDevice::createServer();
-  server->setCallbacks(new ServerCB());
+  server->setCallbacks(new ServerCB(this));
+  NimBLEAdvertising* adv = NimBLEDevice::getAdvertising();
 
-  NimBLEService* cps = server->createService(NimBLEUUID((uint16_t)CPS_UUID16));
+  if (services & BleServices::SERVICE_CPS) {
+    NimBLEService* cps = server->createService(NimBLEUUID((uint16_t)CPS_UUID16));
 
-  // Cycling Power Feature: 32-bit bitfield. 0 = only mandatory instantaneous power.
-  NimBLECharacteristic* ch_feature =
-      cps->createCharacteristic(NimBLEUUID((uint16_t)CPF_UUID16), NIMBLE_PROPERTY::READ);
-  uint8_t feature_val[4] = {0x08, 0, 0, 0}; // Bit 3: Crank Revolution Data Supported
-  ch_feature->setValue(feature_val, sizeof(feature_val));
+    // Cycling Power Feature: 32-bit bitfield
+    NimBLECharacteristic* ch_feature =
+        cps->createCharacteristic(NimBLEUUID((uint16_t)CPF_UUID16), NIMBLE_PROPERTY::READ);
+    uint8_t feature_val[4];
+    ch_feature->setValue(feature_val, BlePackets::cpsFeature((services & BleServices::SERVICE_CPS_TORQUE) != 0,
+                                                             (services & BleServices::SERVICE_CPS_ENERGY) != 0, feature_val));
 
-  // Sensor Location (optional). 13 = Rear Hub (implies total power, not single-sided)
-  NimBLECharacteristic* ch_location =
-      cps->createCharacteristic(NimBLEUUID((uint16_t)CSL_UUID16), NIMBLE_PROPERTY::READ);
-  uint8_t loc = 13;
-  ch_location->setValue(&loc, 1);
+    addSensorLocation(cps);
 
-  // Measurement (Notify)
-  ch_measurement =
-      cps->createCharacteristic(NimBLEUUID((uint16_t)CPM_UUID16), NIMBLE_PROPERTY::NOTIFY);
+    // Measurement (Notify)
+    slot_cps = addSlot(cps->createCharacteristic(NimBLEUUID((uint16_t)CPM_UUID16), NIMBLE_PROPERTY::NOTIFY), BleServices::SERVICE_CPS);
 
-  cps->start();
+    // Control Point: offset compensation, crank length, sampling rate
+    ch_cps_control = cps->createCharacteristic(NimBLEUUID((uint16_t)CPCP_UUID16),
+                                               NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::INDICATE);
+    ch_cps_control->setCallbacks(new CpsControlCB(this));
+
+    cps->start();
+    adv->addServiceUUID(NimBLEUUID((uint16_t)CPS_UUID16));
+  }
+
+  if (services & BleServices::SERVICE_CSC) {
+    NimBLEService* csc = server->createService(NimBLEUUID((uint16_t)CSC_UUID16));
+
+    // CSC Feature: 16-bit bitfield. Bit 0: Wheel Revolution Data, Bit 1: Crank Revolution Data
+    NimBLECharacteristic* ch_feature =
+        csc->createCharacteristic(NimBLEUUID((uint16_t)CSF_UUID16), NIMBLE_PROPERTY::READ);
+    uint8_t feature_val[2] = {(uint8_t)((services & BleServices::SERVICE_CSC_WHEEL) ? 0x03 : 0x02), 0};
+    ch_feature->setValue(feature_val, sizeof(feature_val));
+
+    addSensorLocation(csc);
+
+    slot_csc = addSlot(csc->createCharacteristic(NimBLEUUID((uint16_t)CSM_UUID16), NIMBLE_PROPERTY::NOTIFY), BleServices::SERVICE_CSC);
+
+    csc->start();
+    adv->addServiceUUID(NimBLEUUID((uint16_t)CSC_UUID16));
+  }
+
+  if (services & BleServices::SERVICE_FTMS) {
+    NimBLEService* ftms = server->createService(NimBLEUUID((uint16_t)FTMS_UUID16));
+
+    NimBLECharacteristic* ch_feature =
+        ftms->createCharacteristic(NimBLEUUID((uint16_t)FMF_UUID16), NIMBLE_PROPERTY::READ);
+    uint8_t feature_val[8];
+    ch_feature->setValue(feature_val, BlePackets::ftmsFeature(feature_val));
+
+    slot_ftms = addSlot(ftms->createCharacteristic(NimBLEUUID((uint16_t)IBD_UUID16), NIMBLE_PROPERTY::NOTIFY),
+                        BleServices::SERVICE_FTMS);
+
+    // Control Point: start, stop and reset drive the workout
+    ch_ftms_control = ftms->createCharacteristic(NimBLEUUID((uint16_t)FMCP_UUID16),
+                                                 NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::INDICATE);
+    ch_ftms_control->setCallbacks(new FtmsControlCB(this));
+    ch_ftms_status = ftms->createCharacteristic(NimBLEUUID((uint16_t)FMS_UUID16), NIMBLE_PROPERTY::NOTIFY);
+
+    ftms->start();
+    adv->addServiceUUID(NimBLEUUID((uint16_t)FTMS_UUID16));
+    adv->setServiceData(NimBLEUUID((uint16_t)FTMS_UUID16), FTMS_ADV_DATA, sizeof(FTMS_ADV_DATA));
+  }
 
-  NimBLEAdvertising* adv = NimBLEDevice::getAdvertising();
-  adv->addServiceUUID(NimBLEUUID((uint16_t)CPS_UUID16));
   // adv->setScanResponse(true); // Removed in NimBLE-Arduino 2.x
   adv->start();
 
@@ -62,21 +202,240 @@ void BleCps::begin(const char* deviceName) {
 }
 
 void BleCps::notify(const PowerSample& s) {
-  if (!started || ch_measurement == nullptr) return;
+  if (!started) return;
+
+  // Who wants what, as of this sample (subscriptions change in the NimBLE task)
+  uint8_t subscribed[MAX_CENTRALS];
+  uint8_t wanted = 0;
+  for (uint8_t c = 0; c < MAX_CENTRALS; c++) {
+    subscribed[c] = centrals[c].connected ? centrals[c].subscribed : 0;
+    wanted |= subscribed[c];
+  }
+
+  // The wheel and crank work follow every sample, so a late subscriber
+  // gets a correct wheel event time and totals
+  if (services & BleServices::SERVICE_CSC_WHEEL) {
+    wheel.onCrank(s.crank_revs, s.crank_evt_1024);
+  }
+  if (services & (BleServices::SERVICE_CPS_TORQUE | BleServices::SERVICE_CPS_ENERGY)) {
+    work.onCrank(s.crank_revs, s.kp);
+  }
+
+  // Encode each measurement someone subscribed to, once, into its slot...
+  for (uint8_t i = 0; i < slot_count; i++) {
+    NotifySlot& slot = slots[i];
+    if (!(wanted & (1u << i))) {
+      slot.len = 0;
+      stats.skipped++;
+      continue;
+    }
+    if (i == slot_cps) {
+      slot.len = BlePackets::cpsMeasurement(s, slot.payload, &work, (services & BleServices::SERVICE_CPS_TORQUE) != 0,
+                                            (services & BleServices::SERVICE_CPS_ENERGY) != 0);
+    } else if (i == slot_csc) {
+      const VirtualWheel* w = (services & BleServices::SERVICE_CSC_WHEEL) ? &wheel : nullptr;
+      slot.len = BlePackets::cscMeasurement(s, w, slot.payload);
+    } else if (i == slot_ftms) {
+      uint32_t elapsedMs = workout ? workout->getElapsedMs() : 0;
+      slot.len = BlePackets::indoorBikeData(s, elapsedMs, slot.payload);
+    }
+  }
+  if (!wanted) return;
+
+  // ...then send each central what it subscribed to, in one pass, straight
+  // from the slot buffers (no setValue copy into the attribute)
+  for (uint8_t c = 0; c < MAX_CENTRALS; c++) {
+    if (!subscribed[c]) continue;
+    Central& central = centrals[c];
+    uint16_t handle = central.handle;
+    for (uint8_t i = 0; i < slot_count; i++) {
+      if (!(subscribed[c] & (1u << i))) continue;
+      if (slots[i].characteristic->notify(slots[i].payload, slots[i].len, handle)) {
+        stats.sent++;
+        central.notifies++;
+      } else {
+        stats.failed++;
+      }
+    }
+    uint64_t now = Clock::nowUs();
+    recordLatency(central, (uint32_t)(now - s.timestamp_us), now);
+  }
+}
+
+void BleCps::recordLatency(Central& c, uint32_t us, uint64_t now) {
+  c.latencySum += us;
+  c.latencyCount++;
+  if (us > c.latencyMax) c.latencyMax = us;
+
+  if (now - c.windowStart >= LATENCY_WINDOW_US) {
+    c.latencyUs = (uint32_t)(c.latencySum / c.latencyCount);
+    c.maxLatencyUs = c.latencyMax;
+    c.windowStart = now;
+    c.latencySum = 0;
+    c.latencyCount = 0;
+    c.latencyMax = 0;
+  }
+}
+
+BleCps::Central* BleCps::findCentral(uint16_t handle) {
+  for (uint8_t c = 0; c < MAX_CENTRALS; c++) {
+    if (centrals[c].connected && centrals[c].handle == handle) return &centrals[c];
+  }
+  return nullptr;
+}
+
+void BleCps::onConnected(uint16_t handle) {
+  if (findCentral(handle)) return;
+  for (uint8_t c = 0; c < MAX_CENTRALS; c++) {
+    Central& central = centrals[c];
+    if (central.connected) continue;
+    central = Central();
+    central.handle = handle;
+    central.windowStart = Clock::nowUs();
+    central.connected = true;
+    return;
+  }
+}
+
+void BleCps::onDisconnected(uint16_t handle) {
+  Central* central = findCentral(handle);
+  if (central) {
+    central->subscribed = 0;
+    central->connected = false;
+  }
+  if (ftms_owner == handle) ftms_owner = NO_CONN;
+}
 
-  // Build CPS measurement:
-  // Flags (uint16) + Instantaneous Power (sint16) + Crank Rev Data (uint16 + uint16)
-  // Flags: bit5 set = crank revolution data present (0x0020)
-  uint8_t payload[8];
-  uint16_t flags = 0x0020;
+void BleCps::onSubscribed(uint8_t slot, uint16_t handle, uint16_t subValue) {
+  Central* central = findCentral(handle);
+  if (!central) return;
+  uint8_t bit = (uint8_t)(1u << slot);
+  if (subValue & 0x0001) {  // Notifications enabled
+    central->subscribed = central->subscribed | bit;
+  } else {
+    central->subscribed = central->subscribed & (uint8_t)~bit;
+  }
+}
+
+uint8_t BleCps::getCentrals(CentralStats* out, uint8_t max) const {
+  uint8_t n = 0;
+  for (uint8_t c = 0; c < MAX_CENTRALS && n < max; c++) {
+    const Central& central = centrals[c];
+    if (!central.connected) continue;
+    CentralStats& st = out[n++];
+    st.connHandle = central.handle;
+    st.subscriptions = 0;
+    for (uint8_t i = 0; i < slot_count; i++) {
+      if (central.subscribed & (1u << i)) st.subscriptions |= slots[i].service;
+    }
+    st.notifies = central.notifies;
+    st.latencyUs = central.latencyUs;
+    st.maxLatencyUs = central.maxLatencyUs;
+  }
+  return n;
+}
+
+void BleCps::onFtmsSubscribed(uint16_t handle, uint16_t subValue) {
+  Central* central = findCentral(handle);
+  if (central) central->ftmsIndicate = (subValue & 0x0002) != 0;
+}
+
+uint8_t BleCps::onFtmsControl(uint16_t handle, const uint8_t* data, size_t len) {
+  Central* central = findCentral(handle);
+  if (!central || !central->ftmsIndicate) return ATT_CCCD_IMPROPERLY_CONFIGURED;
+  if (central->ftmsPending) return ATT_PROCEDURE_IN_PROGRESS;
+
+  // Ownership is settled here, in write order; the command itself is
+  // applied and answered from loop()
+  FtmsControlRequest req = {};
+  req.op = len ? data[0] : 0;
+  req.connHandle = handle;
+  uint8_t result = BlePackets::ftmsControlPoint(data, len, ftms_owner == handle, req.cmd);
+  if (result == BlePackets::FTMS_SUCCESS) {
+    if (req.cmd == FtmsCommand::RequestControl) {
+      // Another central already controls the workout
+      if (ftms_owner != NO_CONN && ftms_owner != handle) {
+        result = BlePackets::FTMS_CONTROL_NOT_PERMITTED;
+      } else {
+        ftms_owner = handle;
+      }
+    } else if (req.cmd == FtmsCommand::Reset) {
+      ftms_owner = NO_CONN;  // Reset hands control back
+    }
+  }
+  central->ftmsResult = result;
+  central->ftmsRequest = req;
+  central->ftmsPending = true;
+  return 0;
+}
+
+bool BleCps::takeFtmsRequest(FtmsControlRequest& req) {
+  for (uint8_t c = 0; c < MAX_CENTRALS; c++) {
+    Central& central = centrals[c];
+    if (!central.connected || !central.ftmsPending) continue;
+    req = central.ftmsRequest;
+    uint8_t result = central.ftmsResult;
+    central.ftmsPending = false;
+    // Request Control changes nothing in the workout
+    if (result == BlePackets::FTMS_SUCCESS && req.cmd != FtmsCommand::RequestControl) return true;
+    respondFtms(req, result);
+  }
+  return false;
+}
+
+void BleCps::respondFtms(const FtmsControlRequest& req, uint8_t result) {
+  if (!ch_ftms_control) return;
+  uint8_t response[3];
+  size_t n = BlePackets::ftmsControlResponse(req.op, result, response);
+  ch_ftms_control->setValue(response, n);
+  ch_ftms_control->indicate(req.connHandle);
+}
+
+void BleCps::reportFtmsStatus(FtmsCommand applied) {
+  if (!ch_ftms_status) return;
+  uint8_t status[2];
+  size_t n = BlePackets::ftmsStatus(applied, status);
+  if (n == 0) return;
+  ch_ftms_status->setValue(status, n);
+  ch_ftms_status->notify();
+}
 
-  int16_t pwr = (int16_t)constrain((int)lroundf(s.power_w), -32768, 32767);
+void BleCps::onCpsSubscribed(uint16_t handle, uint16_t subValue) {
+  Central* central = findCentral(handle);
+  if (central) central->cpsIndicate = (subValue & 0x0002) != 0;
+}
+
+uint8_t BleCps::onCpsControl(uint16_t handle, const uint8_t* data, size_t len) {
+  // Responses are indicated, so the writer must have enabled indications
+  Central* central = findCentral(handle);
+  if (!central || !central->cpsIndicate) return ATT_CCCD_IMPROPERLY_CONFIGURED;
+  if (central->cpsPending) return ATT_PROCEDURE_IN_PROGRESS;
+
+  CpsControlRequest req = {};
+  req.connHandle = handle;
+  central->cpsResult = BlePackets::cpsControlPoint(data, len, req);
+  central->cpsRequest = req;
+  central->cpsPending = true;  // loop() applies or answers it
+  return 0;
+}
 
-  put_u16_le(&payload[0], flags);
-  put_s16_le(&payload[2], pwr);
-  put_u16_le(&payload[4], s.crank_revs);
-  put_u16_le(&payload[6], s.crank_evt_1024);
+bool BleCps::takeCpsRequest(CpsControlRequest& req) {
+  for (uint8_t c = 0; c < MAX_CENTRALS; c++) {
+    Central& central = centrals[c];
+    if (!central.connected || !central.cpsPending) continue;
+    req = central.cpsRequest;
+    uint8_t result = central.cpsResult;
+    central.cpsPending = false;
+    if (result == BlePackets::CPS_SUCCESS) return true;
+    respondCps(req, result);
+  }
+  return false;
+}
 
-  ch_measurement->setValue(payload, sizeof(payload));
-  ch_measurement->notify();
+void BleCps::respondCps(const CpsControlRequest& req, uint8_t result, const uint8_t* param, size_t paramLen) {
+  if (!ch_cps_control) return;
+  uint8_t response[BlePackets::MAX_PAYLOAD];
+  size_t n = BlePackets::cpsControlResponse(req.op, result, param, paramLen, response);
+  ch_cps_control->setValue(response, n);
+  ch_cps_control->indicate(req.connHandle);
 }
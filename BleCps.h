@@ -1,11 +1,147 @@
 #pragma once
 #include "PowerSample.h"
+#include "BlePackets.h"
 
+class NimBLECharacteristic;
+class Workout;
+
+// BLE transport: Cycling Power Service, and optionally Cycling Speed and
+// Cadence and Fitness Machine services fed from the same samples. Each
+// measurement with at least one subscriber is encoded once per sample into
+// its preallocated buffer, then all of them go out in one pass over the
+// connected centrals, each getting the measurements it subscribed to.
 class BleCps {
 public:
-  void begin(const char* deviceName);
+  // Simultaneous centrals (head unit + app); NimBLE defaults to 3 when
+  // platformio.ini doesn't set the limit
+#ifdef CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+  static const uint8_t MAX_CENTRALS = CONFIG_BT_NIMBLE_MAX_CONNECTIONS;
+#else
+  static const uint8_t MAX_CENTRALS = 3;
+#endif
+
+  // A connected central, for diagnostics
+  struct CentralStats {
+    uint16_t connHandle;
+    uint8_t subscriptions;  // BleServices::SERVICE_* bits of the measurements it receives
+    uint32_t notifies;      // Notifications sent since it connected
+    uint32_t latencyUs;     // Mean sample-to-notify time over the last window
+    uint32_t maxLatencyUs;  // Worst sample-to-notify time over the last window
+  };
+
+  // Notification counters since boot. 'skipped' counts measurements not
+  // encoded because no central subscribed to them.
+  struct NotifyStats {
+    uint32_t sent;
+    uint32_t skipped;
+    uint32_t failed;  // Stack refused (e.g. out of buffers)
+  };
+
+  void begin(const char* deviceName, uint8_t services = BleServices::SERVICES_DEFAULT);
   void notify(const PowerSample& s);
 
+  uint8_t getServices() const { return services; }
+
+  // Workout whose elapsed time goes into Indoor Bike Data
+  void setWorkout(const Workout* w) { workout = w; }
+
+  // Cycle constant for the CPS accumulated torque and energy
+  void setCycleConstant(float cc) { work.setCycleConstant(cc); }
+
+  // CPS Control Point request waiting to be applied (settings, offset
+  // compensation); false if there is none. Answer it with respondCps().
+  // Requests that failed to decode are answered here, so every Control
+  // Point indication goes out from the caller's task.
+  bool takeCpsRequest(CpsControlRequest& req);
+  void respondCps(const CpsControlRequest& req, uint8_t result, const uint8_t* param = nullptr,
+                  size_t paramLen = 0);
+
+  // FTMS Control Point command waiting to be applied to the workout;
+  // false if there is none. Answer it with respondFtms(). Refused requests
+  // and Request Control are answered here, like takeCpsRequest().
+  bool takeFtmsRequest(FtmsControlRequest& req);
+  void respondFtms(const FtmsControlRequest& req, uint8_t result);
+
+  // Tell FTMS clients a command was applied (Fitness Machine Status)
+  void reportFtmsStatus(FtmsCommand applied);
+
+  const NotifyStats& getNotifyStats() const { return stats; }
+
+  // Copies up to 'max' connected centrals into 'out'; returns the count
+  uint8_t getCentrals(CentralStats* out, uint8_t max) const;
+
 private:
+  // One measurement characteristic and its encoded payload
+  struct NotifySlot {
+    NimBLECharacteristic* characteristic;
+    uint8_t service;  // BleServices::SERVICE_* it belongs to
+    uint8_t payload[BlePackets::MAX_PAYLOAD];
+    size_t len;
+  };
+  static const uint8_t MAX_SLOTS = 3;
+
+  static const uint64_t LATENCY_WINDOW_US = 1000000;  // Publish once per second
+
+  // Connection table. Membership and subscriptions are written from the
+  // NimBLE task; the notify counters and latency only from notify().
+  struct Central {
+    volatile bool connected;
+    volatile uint16_t handle;
+    volatile uint8_t subscribed;  // Bit per notify slot
+    volatile bool cpsIndicate;    // Indications enabled on the CPS Control Point
+    volatile bool cpsPending;     // cpsRequest waits for takeCpsRequest()
+    CpsControlRequest cpsRequest;
+    uint8_t cpsResult;            // CPS_SUCCESS to apply, else the answer
+    volatile bool ftmsIndicate;   // Same for the FTMS Control Point
+    volatile bool ftmsPending;    // ftmsRequest waits for takeFtmsRequest()
+    FtmsControlRequest ftmsRequest;
+    uint8_t ftmsResult;           // FTMS_SUCCESS to apply, else the answer
+    uint32_t notifies;
+    uint64_t windowStart;
+    uint64_t latencySum;
+    uint32_t latencyCount;
+    uint32_t latencyMax;
+    uint32_t latencyUs;
+    uint32_t maxLatencyUs;
+  };
+
+  friend class ServerCB;
+  friend class SlotCB;
+  friend class FtmsControlCB;
+  friend class CpsControlCB;
+
   bool started = false;
+  uint8_t services = 0;
+  NotifySlot slots[MAX_SLOTS] = {};
+  int8_t slot_cps = -1;
+  int8_t slot_csc = -1;
+  int8_t slot_ftms = -1;
+  uint8_t slot_count = 0;
+  Central centrals[MAX_CENTRALS] = {};
+  NotifyStats stats = {};
+  VirtualWheel wheel;
+  CrankWork work;
+  const Workout* workout = nullptr;
+
+  // CPS control: one request in flight per central, queued in its entry
+  NimBLECharacteristic* ch_cps_control = nullptr;
+
+  // FTMS control: one central at a time, granted on Request Control and
+  // dropped on reset or when that central disconnects. Requests are queued
+  // per central like CPS ones.
+  static const uint16_t NO_CONN = 0xFFFF;
+  NimBLECharacteristic* ch_ftms_control = nullptr;
+  NimBLECharacteristic* ch_ftms_status = nullptr;
+  volatile uint16_t ftms_owner = NO_CONN;
+
+  int8_t addSlot(NimBLECharacteristic* characteristic, uint8_t service);
+  Central* findCentral(uint16_t handle);
+  void onConnected(uint16_t handle);
+  void onDisconnected(uint16_t handle);
+  void onSubscribed(uint8_t slot, uint16_t handle, uint16_t subValue);
+  void onFtmsSubscribed(uint16_t handle, uint16_t subValue);
+  uint8_t onFtmsControl(uint16_t handle, const uint8_t* data, size_t len);
+  void onCpsSubscribed(uint16_t handle, uint16_t subValue);
+  uint8_t onCpsControl(uint16_t handle, const uint8_t* data, size_t len);
+  void recordLatency(Central& c, uint32_t us, uint64_t now);
 };
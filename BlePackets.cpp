@@ -0,0 +1,282 @@
+#include "BlePackets.h"
+#include <math.h>
+
+// Cycling Power Feature bits
+static const uint32_t CPF_ACC_TORQUE = 1u << 1;     // Accumulated torque supported
+static const uint32_t CPF_CRANK_REV = 1u << 3;      // Crank revolution data supported
+static const uint32_t CPF_ACC_ENERGY = 1u << 7;     // Accumulated energy supported
+static const uint32_t CPF_OFFSET_COMP = 1u << 9;    // Offset compensation supported
+static const uint32_t CPF_CRANK_LENGTH = 1u << 12;  // Crank length adjustment supported
+
+// Cycling Power Measurement flags
+static const uint16_t CPM_FLAG_ACC_TORQUE = 0x0004;   // Bit 2: accumulated torque present
+static const uint16_t CPM_FLAG_TORQUE_CRANK = 0x0008; // Bit 3: accumulated torque source is the crank
+static const uint16_t CPM_FLAG_CRANK_REV = 0x0020;    // Bit 5: crank revolution data present
+static const uint16_t CPM_FLAG_ACC_ENERGY = 0x0800;   // Bit 11: accumulated energy present
+
+// Cycling Power Control Point response op code
+static const uint8_t CPS_OP_RESPONSE = 0x20;
+
+// CSC Measurement flags
+static const uint8_t CSC_FLAG_WHEEL_REV = 0x01;  // Bit 0: wheel revolution data present
+static const uint8_t CSC_FLAG_CRANK_REV = 0x02;  // Bit 1: crank revolution data present
+
+// Fitness Machine Features: cadence, resistance level, elapsed time, power
+static const uint32_t FTMS_FEATURES = (1u << 1) | (1u << 7) | (1u << 12) | (1u << 14);
+
+// Indoor Bike Data flags (instantaneous speed is present while bit 0 is clear)
+static const uint16_t IBD_FLAG_CADENCE = 0x0004;     // Bit 2: instantaneous cadence
+static const uint16_t IBD_FLAG_RESISTANCE = 0x0020;  // Bit 5: resistance level
+static const uint16_t IBD_FLAG_POWER = 0x0040;       // Bit 6: instantaneous power
+static const uint16_t IBD_FLAG_ELAPSED = 0x0800;     // Bit 11: elapsed time
+
+// One crank rev moves the flywheel rim 6 m on a Monark ergometer
+static const float METRES_PER_CRANK_REV = 6.0f;
+
+// FTMS Control Point op codes
+static const uint8_t FTMS_OP_REQUEST_CONTROL = 0x00;
+static const uint8_t FTMS_OP_RESET = 0x01;
+static const uint8_t FTMS_OP_START_RESUME = 0x07;
+static const uint8_t FTMS_OP_STOP_PAUSE = 0x08;
+static const uint8_t FTMS_OP_RESPONSE = 0x80;
+
+// Fitness Machine Status op codes
+static const uint8_t FTMS_STATUS_RESET = 0x01;
+static const uint8_t FTMS_STATUS_STOPPED_PAUSED = 0x02;  // Parameter: 1 = stop, 2 = pause
+static const uint8_t FTMS_STATUS_STARTED = 0x04;
+
+/* static */ int16_t BlePackets::clampS16(float v) {
+  long r = lroundf(v);
+  if (r < -32768) return -32768;
+  if (r > 32767) return 32767;
+  return (int16_t)r;
+}
+
+/* static */ uint16_t BlePackets::clampU16(float v) {
+  long r = lroundf(v);
+  if (r < 0) return 0;
+  if (r > 65535) return 65535;
+  return (uint16_t)r;
+}
+
+/* static */ size_t BlePackets::cpsFeature(bool accTorque, bool accEnergy, uint8_t* out) {
+  uint32_t features = CPF_CRANK_REV | CPF_OFFSET_COMP | CPF_CRANK_LENGTH;
+  if (accTorque) features |= CPF_ACC_TORQUE;
+  if (accEnergy) features |= CPF_ACC_ENERGY;
+  putU32(&out[0], features);
+  return 4;
+}
+
+/* static */ size_t BlePackets::cpsMeasurement(const PowerSample& s, uint8_t* out, const CrankWork* work,
+                                               bool accTorque, bool accEnergy) {
+  // Flags (uint16) + Instantaneous Power (sint16) + [Accumulated Torque (uint16, 1/32 Nm)]
+  // + Crank Rev Data (uint16 + uint16) + [Accumulated Energy (uint16, kJ)]
+  uint16_t flags = CPM_FLAG_CRANK_REV;
+  putS16(&out[2], clampS16(s.power_w));
+  size_t n = 4;
+  if (work && accTorque) {
+    flags |= CPM_FLAG_ACC_TORQUE | CPM_FLAG_TORQUE_CRANK;
+    putU16(&out[n], work->torque32());
+    n += 2;
+  }
+  putU16(&out[n], s.crank_revs);
+  putU16(&out[n + 2], s.crank_evt_1024);
+  n += 4;
+  if (work && accEnergy) {
+    flags |= CPM_FLAG_ACC_ENERGY;
+    putU16(&out[n], work->energyKj());
+    n += 2;
+  }
+  putU16(&out[0], flags);
+  return n;
+}
+
+/* static */ uint8_t BlePackets::cpsControlPoint(const uint8_t* data, size_t len, CpsControlRequest& req) {
+  if (len < 1) return CPS_INVALID_PARAMETER;
+  req.op = data[0];
+  req.value = 0;
+  switch (req.op) {
+    case CPS_OP_SET_CRANK_LENGTH: {
+      if (len != 3) return CPS_INVALID_PARAMETER;
+      uint16_t halfMm = (uint16_t)(data[1] | (data[2] << 8));
+      if (halfMm < BleServices::CRANK_LENGTH_MIN || halfMm > BleServices::CRANK_LENGTH_MAX) return CPS_INVALID_PARAMETER;
+      req.value = halfMm;
+      return CPS_SUCCESS;
+    }
+    case CPS_OP_REQUEST_CRANK_LENGTH:
+    case CPS_OP_START_OFFSET_COMPENSATION:
+    case CPS_OP_REQUEST_SAMPLING_RATE:
+      return len == 1 ? CPS_SUCCESS : CPS_INVALID_PARAMETER;
+    default:
+      return CPS_NOT_SUPPORTED;
+  }
+}
+
+/* static */ size_t BlePackets::cpsControlResponse(uint8_t opCode, uint8_t result, const uint8_t* param,
+                                                   size_t paramLen, uint8_t* out) {
+  out[0] = CPS_OP_RESPONSE;
+  out[1] = opCode;
+  out[2] = result;
+  if (paramLen > MAX_PAYLOAD - 3) paramLen = MAX_PAYLOAD - 3;
+  for (size_t i = 0; i < paramLen; i++) out[3 + i] = param[i];
+  return 3 + paramLen;
+}
+
+/* static */ int16_t BlePackets::cpsOffsetForce(float kp, float cycleConstant, uint16_t crankHalfMm) {
+  if (crankHalfMm == 0) return 0;
+  float torqueNm = kp * cycleConstant * 60.0f / 6.2831853f;
+  return clampS16(torqueNm / (crankHalfMm * 0.0005f));
+}
+
+/* static */ size_t BlePackets::cscMeasurement(const PowerSample& s, const VirtualWheel* wheel, uint8_t* out) {
+  // Flags (uint8) + [Wheel Revs (uint32) + Wheel Event (uint16)] + Crank Revs (uint16) + Crank Event (uint16)
+  size_t n = 1;
+  uint8_t flags = CSC_FLAG_CRANK_REV;
+  if (wheel) {
+    flags |= CSC_FLAG_WHEEL_REV;
+    putU32(&out[n], wheel->revs());
+    putU16(&out[n + 4], wheel->eventTime1024());
+    n += 6;
+  }
+  putU16(&out[n], s.crank_revs);
+  putU16(&out[n + 2], s.crank_evt_1024);
+  n += 4;
+  out[0] = flags;
+  return n;
+}
+
+/* static */ size_t BlePackets::ftmsFeature(uint8_t* out) {
+  putU32(&out[0], FTMS_FEATURES);
+  putU32(&out[4], 0);  // No target settings: the pendulum is set by hand
+  return 8;
+}
+
+/* static */ size_t BlePackets::indoorBikeData(const PowerSample& s, uint32_t elapsedMs, uint8_t* out) {
+  // Flags (uint16) + Speed (uint16, 0.01 km/h) + Cadence (uint16, 0.5 rpm)
+  // + Resistance Level (sint16) + Power (sint16, W) + Elapsed Time (uint16, s)
+  putU16(&out[0], IBD_FLAG_CADENCE | IBD_FLAG_RESISTANCE | IBD_FLAG_POWER | IBD_FLAG_ELAPSED);
+  float kmh = s.rpm * METRES_PER_CRANK_REV * 60.0f / 1000.0f;
+  putU16(&out[2], clampU16(kmh * 100.0f));
+  putU16(&out[4], clampU16(s.rpm * 2.0f));
+  putS16(&out[6], clampS16(s.kp * 10.0f));  // Unitless level: kp in tenths
+  putS16(&out[8], clampS16(s.power_w));
+  uint32_t elapsedS = elapsedMs / 1000;
+  putU16(&out[10], elapsedS > 0xFFFF ? 0xFFFF : (uint16_t)elapsedS);
+  return 12;
+}
+
+/* static */ uint8_t BlePackets::ftmsControlPoint(const uint8_t* req, size_t len, bool hasControl,
+                                                  FtmsCommand& cmd) {
+  if (len < 1) return FTMS_INVALID_PARAMETER;
+  uint8_t op = req[0];
+  if (op == FTMS_OP_REQUEST_CONTROL) {
+    if (len != 1) return FTMS_INVALID_PARAMETER;
+    cmd = FtmsCommand::RequestControl;
+    return FTMS_SUCCESS;
+  }
+  if (op != FTMS_OP_RESET && op != FTMS_OP_START_RESUME && op != FTMS_OP_STOP_PAUSE) {
+    return FTMS_NOT_SUPPORTED;
+  }
+  if (!hasControl) return FTMS_CONTROL_NOT_PERMITTED;
+
+  switch (op) {
+    case FTMS_OP_RESET:
+      if (len != 1) return FTMS_INVALID_PARAMETER;
+      cmd = FtmsCommand::Reset;
+      return FTMS_SUCCESS;
+    case FTMS_OP_START_RESUME:
+      if (len != 1) return FTMS_INVALID_PARAMETER;
+      cmd = FtmsCommand::Start;
+      return FTMS_SUCCESS;
+    default:  // Stop or pause
+      if (len != 2 || (req[1] != 1 && req[1] != 2)) return FTMS_INVALID_PARAMETER;
+      cmd = req[1] == 1 ? FtmsCommand::Stop : FtmsCommand::Pause;
+      return FTMS_SUCCESS;
+  }
+}
+
+/* static */ size_t BlePackets::ftmsControlResponse(uint8_t opCode, uint8_t result, uint8_t* out) {
+  out[0] = FTMS_OP_RESPONSE;
+  out[1] = opCode;
+  out[2] = result;
+  return 3;
+}
+
+/* static */ size_t BlePackets::ftmsStatus(FtmsCommand cmd, uint8_t* out) {
+  switch (cmd) {
+    case FtmsCommand::Reset:
+      out[0] = FTMS_STATUS_RESET;
+      return 1;
+    case FtmsCommand::Start:
+      out[0] = FTMS_STATUS_STARTED;
+      return 1;
+    case FtmsCommand::Stop:
+    case FtmsCommand::Pause:
+      out[0] = FTMS_STATUS_STOPPED_PAUSED;
+      out[1] = cmd == FtmsCommand::Stop ? 1 : 2;
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+// ------------------ VirtualWheel ------------------
+
+VirtualWheel::VirtualWheel(float metresPerCrankRev, float circumferenceM)
+  : _ratio(circumferenceM > 0.0f ? metresPerCrankRev / circumferenceM : 1.0f) {}
+
+void VirtualWheel::onCrank(uint16_t crankRevs, uint16_t crankEvt1024) {
+  if (!_primed) {
+    _primed = true;
+    _lastCrankRevs = crankRevs;
+    _lastCrankEvt = crankEvt1024;
+    _wheelEvt1024 = crankEvt1024;
+    return;
+  }
+
+  // 16-bit fields roll over; the differences don't
+  uint16_t dRevs = (uint16_t)(crankRevs - _lastCrankRevs);
+  if (dRevs == 0) return;
+  uint16_t dEvt = (uint16_t)(crankEvt1024 - _lastCrankEvt);
+  uint32_t prevCrank = _crankRevs;
+  _crankRevs += dRevs;
+  _lastCrankRevs = crankRevs;
+  _lastCrankEvt = crankEvt1024;
+
+  // Whole wheel revs reached by now, and when the last one was reached,
+  // assuming constant speed since the previous crank event
+  uint32_t wheel = (uint32_t)((float)_crankRevs * _ratio);
+  if (wheel == _wheelRevs) return;
+  _wheelRevs = wheel;
+  float crankAtWheel = (float)wheel / _ratio;  // Crank revs when it completed
+  float frac = (crankAtWheel - (float)prevCrank) / (float)dRevs;
+  if (frac < 0.0f) frac = 0.0f;
+  if (frac > 1.0f) frac = 1.0f;
+  uint16_t back = (uint16_t)lroundf((1.0f - frac) * (float)dEvt);
+  _wheelEvt1024 = (uint16_t)(crankEvt1024 - back);
+}
+
+// ------------------ CrankWork ------------------
+
+static const double RAD_PER_REV = 6.283185307179586;
+
+void CrankWork::onCrank(uint16_t crankRevs, float kp) {
+  if (!_primed) {
+    _primed = true;
+    _lastCrankRevs = crankRevs;
+    return;
+  }
+  uint16_t dRevs = (uint16_t)(crankRevs - _lastCrankRevs);
+  if (dRevs == 0) return;
+  _lastCrankRevs = crankRevs;
+  if (kp > 0.0f) _joules += (double)dRevs * (double)kp * (double)_cycleConstant * 60.0;
+}
+
+uint16_t CrankWork::torque32() const {
+  // One rev at torque T does 2*pi*T joules of work
+  return (uint16_t)((uint64_t)(_joules * 32.0 / RAD_PER_REV) & 0xFFFF);
+}
+
+uint16_t CrankWork::energyKj() const {
+  return (uint16_t)((uint64_t)(_joules / 1000.0) & 0xFFFF);
+}
@@ -0,0 +1,177 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "PowerSample.h"
+#include "BleServices.h"
+
+class VirtualWheel;
+class CrankWork;
+
+// Workout commands from the FTMS Control Point, applied in loop()
+enum class FtmsCommand : uint8_t {
+  None,
+  RequestControl,
+  Reset,
+  Start,  // Start, or resume if paused
+  Stop,
+  Pause
+};
+
+// FTMS Control Point request, checked in the NimBLE task and applied in
+// loop()
+struct FtmsControlRequest {
+  uint8_t op;           // Request op code, echoed in the response
+  FtmsCommand cmd;
+  uint16_t connHandle;  // Central the response goes to
+};
+
+// Cycling Power Control Point request, decoded in the NimBLE task and
+// applied in loop()
+struct CpsControlRequest {
+  uint8_t op;           // BlePackets::CPS_OP_*
+  uint16_t value;       // Crank length in 0.5 mm (Set Crank Length)
+  uint16_t connHandle;  // Central the response goes to
+};
+
+// GATT payload encoders for the BLE transports. Hardware free, so packet
+// layouts can be checked on a host; BleCps only moves the bytes.
+class BlePackets {
+public:
+  // Largest payload any encoder writes (fits the default 23-byte ATT MTU)
+  static const size_t MAX_PAYLOAD = 20;
+
+  // Cycling Power Feature (0x2A65): crank revolution data, offset
+  // compensation and crank length adjustment, plus the optional
+  // accumulated fields. Returns the length written.
+  static size_t cpsFeature(bool accTorque, bool accEnergy, uint8_t* out);
+
+  // Cycling Power Measurement (0x2A63): flags, instantaneous power,
+  // [accumulated torque], crank revolution data, [accumulated energy].
+  // The accumulated fields are added when 'work' is given and their flag
+  // is set. Returns the length written.
+  static size_t cpsMeasurement(const PowerSample& s, uint8_t* out, const CrankWork* work = nullptr,
+                               bool accTorque = false, bool accEnergy = false);
+
+  // Cycling Power Control Point (0x2A66) op codes
+  static const uint8_t CPS_OP_SET_CRANK_LENGTH = 0x04;
+  static const uint8_t CPS_OP_REQUEST_CRANK_LENGTH = 0x05;
+  static const uint8_t CPS_OP_START_OFFSET_COMPENSATION = 0x0C;
+  static const uint8_t CPS_OP_REQUEST_SAMPLING_RATE = 0x0E;
+
+  // Cycling Power Control Point result codes
+  static const uint8_t CPS_SUCCESS = 0x01;
+  static const uint8_t CPS_NOT_SUPPORTED = 0x02;
+  static const uint8_t CPS_INVALID_PARAMETER = 0x03;
+  static const uint8_t CPS_OPERATION_FAILED = 0x04;
+
+  // Decodes a Control Point write into 'req' (op and value). Returns
+  // CPS_SUCCESS if it should be applied, else the result code to answer.
+  static uint8_t cpsControlPoint(const uint8_t* data, size_t len, CpsControlRequest& req);
+
+  // Control Point response indication: 0x20, request op code, result,
+  // then any response parameter. Returns the length written.
+  static size_t cpsControlResponse(uint8_t opCode, uint8_t result, const uint8_t* param, size_t paramLen,
+                                   uint8_t* out);
+
+  // Start Offset Compensation response parameter. The feature leaves the
+  // Sensor Measurement Context bit clear (force based), so this is the
+  // pedal force in N that the removed offset of 'kp' stood for: its crank
+  // torque (kp * cycle constant * 60 J per rev, over 2 pi) divided by the
+  // crank length. 0 without a crank length; saturates at 16 bits.
+  static int16_t cpsOffsetForce(float kp, float cycleConstant, uint16_t crankHalfMm);
+
+  // CSC Measurement (0x2A5B): crank revolution data, plus wheel
+  // revolution data if 'wheel' is given
+  static size_t cscMeasurement(const PowerSample& s, const VirtualWheel* wheel, uint8_t* out);
+
+  // Fitness Machine Feature (0x2ACC): machine features and target setting
+  // features, 32 bits each. Returns the length written.
+  static size_t ftmsFeature(uint8_t* out);
+
+  // Indoor Bike Data (0x2AD2): speed, cadence, resistance level, power and
+  // workout elapsed time
+  static size_t indoorBikeData(const PowerSample& s, uint32_t elapsedMs, uint8_t* out);
+
+  // FTMS Control Point (0x2AD9) result codes
+  static const uint8_t FTMS_SUCCESS = 0x01;
+  static const uint8_t FTMS_NOT_SUPPORTED = 0x02;
+  static const uint8_t FTMS_INVALID_PARAMETER = 0x03;
+  static const uint8_t FTMS_CONTROL_NOT_PERMITTED = 0x05;
+
+  // Decodes a Control Point write. Everything but Request Control needs
+  // control to have been granted first. Returns the result code; 'cmd' is
+  // set only on success.
+  static uint8_t ftmsControlPoint(const uint8_t* req, size_t len, bool hasControl, FtmsCommand& cmd);
+
+  // Control Point response indication: 0x80, request op code, result
+  static size_t ftmsControlResponse(uint8_t opCode, uint8_t result, uint8_t* out);
+
+  // Fitness Machine Status (0x2ADA) for an applied command. Returns 0 if
+  // the command has no status.
+  static size_t ftmsStatus(FtmsCommand cmd, uint8_t* out);
+
+  static inline void putU16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+  }
+  static inline void putS16(uint8_t* p, int16_t v) { putU16(p, (uint16_t)v); }
+  static inline void putU32(uint8_t* p, uint32_t v) {
+    putU16(p, (uint16_t)(v & 0xFFFF));
+    putU16(p + 2, (uint16_t)(v >> 16));
+  }
+
+  // Round and saturate to the field's range
+  static int16_t clampS16(float v);
+  static uint16_t clampU16(float v);
+};
+
+// Wheel revolutions for CSC, derived from crank revolutions through a
+// fixed development (metres per crank rev) and wheel circumference.
+// The wheel event time is interpolated between crank events, so speed
+// computed by the app from wheel data matches the cadence it sees.
+class VirtualWheel {
+public:
+  // Monark ergometers define one crank rev as 6 m at the flywheel rim;
+  // 2.096 m is the usual 700x23c default in head units
+  explicit VirtualWheel(float metresPerCrankRev = 6.0f, float circumferenceM = 2.096f);
+
+  // Crank revolution data from a sample (16-bit, wrapping)
+  void onCrank(uint16_t crankRevs, uint16_t crankEvt1024);
+
+  uint32_t revs() const { return _wheelRevs; }
+  uint16_t eventTime1024() const { return _wheelEvt1024; }
+
+private:
+  float _ratio;  // Wheel revs per crank rev
+  bool _primed = false;
+  uint16_t _lastCrankRevs = 0;
+  uint16_t _lastCrankEvt = 0;
+  uint32_t _crankRevs = 0;  // 32-bit extension of the crank count
+  uint32_t _wheelRevs = 0;
+  uint16_t _wheelEvt1024 = 0;
+};
+
+// Work done at the crank, accumulated per revolution at the brake load of
+// the sample that reported it: E = kp * cycle constant * 60 J per rev, the
+// same relation live power uses. Feeds the CPS Accumulated Torque and
+// Accumulated Energy fields, so apps that integrate them get totals that
+// don't depend on how often samples arrive.
+class CrankWork {
+public:
+  explicit CrankWork(float cycleConstant = 1.05f) : _cycleConstant(cycleConstant) {}
+
+  void setCycleConstant(float cc) { _cycleConstant = cc; }
+
+  // Crank revolution count from a sample (16-bit, wrapping) and its load
+  void onCrank(uint16_t crankRevs, float kp);
+
+  // Accumulated torque in 1/32 Nm and energy in kJ (both wrap at 16 bits)
+  uint16_t torque32() const;
+  uint16_t energyKj() const;
+
+private:
+  float _cycleConstant;
+  bool _primed = false;
+  uint16_t _lastCrankRevs = 0;
+  double _joules = 0.0;
+};
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdint.h>
+
+// BLE services and optional measurement fields to register, as the
+// bitmask stored in the settings, and the crank length range CPS accepts.
+// Kept apart so the settings and the web UI need neither the BLE
+// transport nor the packet encoders.
+struct BleServices {
+  static const uint8_t SERVICE_CPS       = 0x01;  // Cycling Power (0x1818)
+  static const uint8_t SERVICE_CSC       = 0x02;  // Cycling Speed and Cadence (0x1816)
+  static const uint8_t SERVICE_CSC_WHEEL = 0x04;  // CSC virtual wheel data
+  static const uint8_t SERVICE_FTMS      = 0x08;  // Fitness Machine, Indoor Bike (0x1826)
+  static const uint8_t SERVICE_CPS_TORQUE = 0x10; // CPS Accumulated Torque field
+  static const uint8_t SERVICE_CPS_ENERGY = 0x20; // CPS Accumulated Energy field
+  static const uint8_t SERVICES_DEFAULT  = SERVICE_CPS;
+
+  // Crank lengths apps may set over CPS, in 0.5 mm (100..220 mm, default 170 mm)
+  static const uint16_t CRANK_LENGTH_MIN = 200;
+  static const uint16_t CRANK_LENGTH_MAX = 440;
+  static const uint16_t CRANK_LENGTH_DEFAULT = 340;
+};
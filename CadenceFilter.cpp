@@ -0,0 +1,171 @@
+#include "CadenceFilter.h"
+#include <math.h>
+#include <string.h>
+
+static const uint64_t WINDOW_SHORT_US = 3000000;   // 3s window (responsive)
+static const uint64_t WINDOW_LONG_US  = 10000000;  // 10s window (smooth)
+static const uint64_t TIMEOUT_US      = 5000000;   // No revs for 5s = stopped
+static const uint64_t SLOWING_US      = 2000000;   // Revs late: blend to long window
+
+// Blend smoothing: fraction of the previous value kept after one second.
+// Applied as keep^dt so the response does not depend on the output rate.
+static const float KEEP_STOPPED  = 0.7f;  // Decay to zero after timeout
+static const float KEEP_SLOWING  = 0.7f;  // Roll-down while revs are late
+static const float KEEP_RISING   = 0.3f;  // Quick to rise
+static const float KEEP_FALLING  = 0.6f;  // Slow to fall
+
+// Alpha-beta: intervals this many times the estimate are a restart after a
+// stop (or a missed edge), not a measurement of the current period
+static const float RESTART_RATIO = 3.0f;
+
+// Blend factor for the previous value after dt_s seconds
+static inline float keepFor(float keepPerSecond, float dt_s) {
+  return powf(keepPerSecond, dt_s);
+}
+
+// ------------------ ICadenceFilter ------------------
+
+/* static */ const char* ICadenceFilter::typeName(CadenceFilterType type) {
+  return type == CadenceFilterType::AlphaBeta ? "alphabeta" : "blend";
+}
+
+/* static */ CadenceFilterType ICadenceFilter::typeFromName(const char* name, CadenceFilterType fallback) {
+  if (!name) return fallback;
+  if (strcmp(name, "blend") == 0) return CadenceFilterType::Blend;
+  if (strcmp(name, "alphabeta") == 0) return CadenceFilterType::AlphaBeta;
+  return fallback;
+}
+
+// ------------------ BlendCadenceFilter ------------------
+
+BlendCadenceFilter::BlendCadenceFilter() {
+  _short = _windows.addWindow(WINDOW_SHORT_US);
+  _long = _windows.addWindow(WINDOW_LONG_US);
+}
+
+void BlendCadenceFilter::reset() {
+  _windows.reset();
+  _smoothed = 0.0f;
+}
+
+void BlendCadenceFilter::onRev(uint64_t t_us, float revs) {
+  _windows.onRev(t_us, (uint32_t)(revs * CadenceWindows::REV_Q16 + 0.5f));
+}
+
+float BlendCadenceFilter::windowRpm(int8_t window, uint64_t now_us) const {
+  uint64_t last_rev = _windows.lastRevUs();
+
+  // Timeout check - no revs for a while means stopped
+  if (last_rev && (now_us - last_rev) > TIMEOUT_US) {
+    return 0.0f;
+  }
+
+  return _windows.rpm((uint8_t)window);
+}
+
+float BlendCadenceFilter::rpm(uint64_t now_us, float dt_s) {
+  // Get raw RPM from both windows
+  float rpm3s = windowRpm(_short, now_us);
+  float rpm10s = windowRpm(_long, now_us);
+
+  // Handle timeout/stopped case
+  uint64_t last_rev = _windows.lastRevUs();
+  uint64_t timeSinceLastRev = last_rev ? (now_us - last_rev) : TIMEOUT_US;
+
+  // If completely stopped (timeout), decay smoothly to zero
+  if (timeSinceLastRev >= TIMEOUT_US) {
+    // Exponential decay towards zero
+    _smoothed *= keepFor(KEEP_STOPPED, dt_s);
+    if (_smoothed < 1.0f) _smoothed = 0.0f;
+    return _smoothed;
+  }
+
+  // If slowing down (no recent revs but not timed out), use longer window
+  // This creates smooth roll-down effect
+  if (timeSinceLastRev > SLOWING_US) {
+    // Blend towards 10s reading as we slow down
+    float blendFactor = (float)(timeSinceLastRev - SLOWING_US) / (float)(TIMEOUT_US - SLOWING_US);  // 0 to 1 over 3s
+    if (blendFactor > 1.0f) blendFactor = 1.0f;
+    float blendedRpm = rpm3s * (1.0f - blendFactor) + rpm10s * blendFactor;
+
+    // Also apply decay if current reading is lower than last
+    if (blendedRpm < _smoothed) {
+      // Smooth decay: move 30% per second towards new value
+      float keep = keepFor(KEEP_SLOWING, dt_s);
+      _smoothed = _smoothed * keep + blendedRpm * (1.0f - keep);
+    } else {
+      _smoothed = blendedRpm;
+    }
+    return _smoothed;
+  }
+
+  // Normal operation: quick to rise, slow to fall
+  float instantRpm = rpm3s;  // Use responsive 3s window as base
+
+  if (instantRpm >= _smoothed) {
+    // Increasing or stable: respond quickly
+    // Use 3s window directly, but smooth slightly to avoid jitter
+    float keep = keepFor(KEEP_RISING, dt_s);
+    _smoothed = _smoothed * keep + instantRpm * (1.0f - keep);
+  } else {
+    // Decreasing: use weighted blend favoring longer window
+    // This creates the smooth roll-down effect
+    float targetRpm = rpm3s * 0.3f + rpm10s * 0.7f;
+    // Move 40% per second towards target (slower response when decreasing)
+    float keep = keepFor(KEEP_FALLING, dt_s);
+    _smoothed = _smoothed * keep + targetRpm * (1.0f - keep);
+  }
+
+  return _smoothed;
+}
+
+// ------------------ AlphaBetaCadenceFilter ------------------
+
+AlphaBetaCadenceFilter::AlphaBetaCadenceFilter(float alpha, float beta)
+  : _alpha(alpha), _beta(beta) {}
+
+void AlphaBetaCadenceFilter::reset() {
+  _lastRevUs = 0;
+  _lastRevs = 1.0f;
+  _period = 0.0f;
+  _slope = 0.0f;
+}
+
+void AlphaBetaCadenceFilter::onRev(uint64_t t_us, float revs) {
+  uint64_t last = _lastRevUs;
+  _lastRevUs = t_us;
+  _lastRevs = revs;
+  if (last == 0 || t_us <= last || revs <= 0.0f) return;
+
+  // Interval scaled to a whole revolution (one magnet: the interval itself)
+  float interval = (float)(t_us - last) * 1e-6f / revs;
+
+  // First interval, or the crank (re)started after a pause: take it as is
+  if (_period <= 0.0f || interval > _period * RESTART_RATIO) {
+    _period = interval;
+    _slope = 0.0f;
+    return;
+  }
+
+  // Predict the period one interval ahead, then correct by the residual
+  float predicted = _period + _slope * interval;
+  if (predicted <= 0.0f) predicted = _period;
+  float residual = interval - predicted;
+  _period = predicted + _alpha * residual;
+  _slope += _beta * residual / interval;
+}
+
+float AlphaBetaCadenceFilter::rpm(uint64_t now_us, float dt_s) {
+  (void)dt_s;  // Updated per revolution, not per output
+  if (_period <= 0.0f || _lastRevUs == 0) return 0.0f;
+
+  uint64_t since = now_us > _lastRevUs ? now_us - _lastRevUs : 0;
+  if (since > TIMEOUT_US) return 0.0f;
+
+  // A late edge means the current period is at least the time elapsed,
+  // scaled by the angle the last edge covered
+  float period = _period;
+  float elapsed = (float)since * 1e-6f / _lastRevs;
+  if (elapsed > period) period = elapsed;
+  return 60.0f / period;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+#include "CadenceFilterType.h"
+#include "CadenceWindows.h"
+
+// Turns counted revolutions into the RPM shown and sent over BLE.
+// Hardware free: fed with edge timestamps (us), so it can be replayed.
+class ICadenceFilter {
+public:
+  virtual ~ICadenceFilter() {}
+  virtual void reset() = 0;
+
+  // One counted edge at t_us (monotonic, oldest first), 'revs' of a crank
+  // revolution after the previous one (1 with a single magnet)
+  virtual void onRev(uint64_t t_us, float revs = 1.0f) = 0;
+
+  // Smoothed RPM at now_us; dt_s is the time since the previous call
+  virtual float rpm(uint64_t now_us, float dt_s) = 0;
+
+  static const char* typeName(CadenceFilterType type);
+  static CadenceFilterType typeFromName(const char* name, CadenceFilterType fallback);
+};
+
+// The original smoothing: a responsive 3s window and a smooth 10s window,
+// blended towards the long one as revs become late, decaying after timeout.
+class BlendCadenceFilter : public ICadenceFilter {
+public:
+  BlendCadenceFilter();
+
+  void reset() override;
+  void onRev(uint64_t t_us, float revs = 1.0f) override;
+  float rpm(uint64_t now_us, float dt_s) override;
+
+private:
+  CadenceWindows _windows;
+  int8_t _short = -1;
+  int8_t _long = -1;
+  float _smoothed = 0.0f;
+
+  float windowRpm(int8_t window, uint64_t now_us) const;
+};
+
+// Alpha-beta tracker on the revolution period, updated on every edge with
+// the measured interval scaled to a full rev. Follows accelerations without the lag of a fixed
+// window; between revs the period is at least the time already elapsed,
+// so a stopping crank rolls down on its own.
+class AlphaBetaCadenceFilter : public ICadenceFilter {
+public:
+  AlphaBetaCadenceFilter(float alpha = 0.5f, float beta = 0.1f);
+
+  void reset() override;
+  void onRev(uint64_t t_us, float revs = 1.0f) override;
+  float rpm(uint64_t now_us, float dt_s) override;
+
+private:
+  float _alpha;
+  float _beta;
+  uint64_t _lastRevUs = 0;
+  float _lastRevs = 1.0f;  // Crank angle of the last edge step (revs)
+  float _period = 0.0f;  // Estimated revolution period (s), 0 = unknown
+  float _slope = 0.0f;   // Period change per second
+};
@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+
+// Cadence smoothing strategies (ICadenceFilter implementations). Kept
+// apart so settings and sources can name one without the filter classes.
+enum class CadenceFilterType : uint8_t {
+  Blend = 0,      // 3s/10s window blend, quick to rise, slow to fall
+  AlphaBeta = 1   // Alpha-beta tracker on the revolution period
+};
@@ -0,0 +1,53 @@
+#include "CadenceWindows.h"
+
+int8_t CadenceWindows::addWindow(uint64_t spanUs) {
+  if (_windowCount >= MAX_WINDOWS) return -1;
+  _windows[_windowCount].span_us = spanUs;
+  _windows[_windowCount].tail = _head;
+  return (int8_t)_windowCount++;
+}
+
+void CadenceWindows::reset() {
+  _head = 0;
+  _position = 0;
+  for (uint8_t i = 0; i < _windowCount; i++) {
+    _windows[i].tail = 0;
+  }
+}
+
+void CadenceWindows::onRev(uint64_t t_us, uint32_t revsQ16) {
+  _position += revsQ16;
+  _pos[_head & (HIST_SIZE - 1)] = _position;
+  _hist[_head & (HIST_SIZE - 1)] = t_us;
+  _head++;
+
+  for (uint8_t i = 0; i < _windowCount; i++) {
+    Window& w = _windows[i];
+    // History overwrote the tail - clamp to the oldest stored edge
+    if (_head - w.tail > HIST_SIZE) w.tail = _head - HIST_SIZE;
+    // Advance past edges older than the window
+    while (w.tail != _head && (t_us - at(w.tail)) > w.span_us) w.tail++;
+  }
+}
+
+uint32_t CadenceWindows::revsInWindow(uint8_t window) const {
+  if (window >= _windowCount) return 0;
+  return _head - _windows[window].tail;
+}
+
+uint64_t CadenceWindows::spanUs(uint8_t window) const {
+  if (revsInWindow(window) < 2) return 0;
+  return at(_head - 1) - at(_windows[window].tail);
+}
+
+float CadenceWindows::rpm(uint8_t window) const {
+  uint32_t n = revsInWindow(window);
+  if (n < 2) return 0.0f;
+
+  uint64_t dt = spanUs(window);
+  if (dt == 0) return 0.0f;
+
+  // Unsigned difference: correct across position wrap
+  uint32_t revsQ16 = posAt(_head - 1) - posAt(_windows[window].tail);
+  return (float)revsQ16 * (60000000.0f / REV_Q16) / (float)dt;
+}
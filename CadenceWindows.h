@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+
+// Streaming sliding-window cadence estimator.
+// Each configured window keeps a running tail index into a shared history
+// of rev timestamps. Tails only move forward as edges arrive, so an edge
+// costs O(1) amortized per window and reading a window's RPM is O(1) -
+// no rescanning of the history on every output.
+// Edges may be fractions of a rev (multi-magnet cranks): each entry keeps
+// the crank position in 1/65536 rev, free running, so a window's revs are
+// a difference of positions.
+class CadenceWindows {
+public:
+  static const uint8_t MAX_WINDOWS = 4;
+  static const uint32_t HIST_SIZE = 256;  // Power of two; enough for 10s at 300rpm, 4 magnets
+  static const uint32_t REV_Q16 = 65536;  // One revolution in position units
+
+  // Add a window of 'spanUs' (measured back from the newest edge).
+  // Returns its index, or -1 if MAX_WINDOWS are already configured.
+  int8_t addWindow(uint64_t spanUs);
+
+  void reset();
+  // Edge at t_us, 'revsQ16' of a rev after the previous one
+  void onRev(uint64_t t_us, uint32_t revsQ16 = REV_Q16);
+
+  // RPM over a window: revs between oldest and newest edge / their span
+  float rpm(uint8_t window) const;
+  uint32_t revsInWindow(uint8_t window) const;
+  uint64_t spanUs(uint8_t window) const;
+
+  uint64_t lastRevUs() const { return _head ? at(_head - 1) : 0; }
+  uint32_t totalRevs() const { return _head; }
+
+private:
+  struct Window {
+    uint64_t span_us;
+    uint32_t tail;  // Sequence number of the oldest edge inside the window
+  };
+
+  uint64_t _hist[HIST_SIZE] = {0};
+  uint32_t _pos[HIST_SIZE] = {0};  // Crank position at each edge (1/65536 rev, wraps)
+  uint32_t _position = 0;
+  uint32_t _head = 0;  // Sequence number of the next edge
+  Window _windows[MAX_WINDOWS];
+  uint8_t _windowCount = 0;
+
+  uint64_t at(uint32_t seq) const { return _hist[seq & (HIST_SIZE - 1)]; }
+  uint32_t posAt(uint32_t seq) const { return _pos[seq & (HIST_SIZE - 1)]; }
+};
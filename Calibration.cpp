@@ -1,25 +1,282 @@
 #include "Calibration.h"
+#include <math.h>
+#include <string.h>
 
-MonarkCalibration::MonarkCalibration(int adc0, int adc2, int adc4, int adc6)
-    : _adc0(adc0), _adc2(adc2), _adc4(adc4), _adc6(adc6) {}
-
-float MonarkCalibration::lerp(float x, float x0, float y0, float x1, float y1) {
-    if (x1 == x0) return y0;
-    float t = (x - x0) / (x1 - x0);
-    return y0 + t * (y1 - y0);
+MonarkCalibration::MonarkCalibration(const CalPoint* points, uint8_t count, CalFit fit) {
+    if (!updateValues(points, count, fit)) {
+        // Invalid input: fall back to a flat 0 kp curve so readers always have a table
+        CalPoint flat[2] = {{0.0f, 0}, {0.0f, 1}};
+        apply(flat, 2, CalFit::Linear);
+    }
 }
 
 float MonarkCalibration::adcToKp(float adc) {
-    // Below 0kp calibration point - clamp to 0
-    if (adc <= (float)_adc0) return 0.0f;
-
-    // Interpolate between calibration points
-    if (adc <= (float)_adc2)
-        return lerp(adc, (float)_adc0, 0.0f, (float)_adc2, 2.0f);
-    else if (adc <= (float)_adc4)
-        return lerp(adc, (float)_adc2, 2.0f, (float)_adc4, 4.0f);
-    else
-        // For adc > _adc4, extrapolate using the 4-6kp slope
-        // This allows readings beyond 6kp
-        return lerp(adc, (float)_adc4, 4.0f, (float)_adc6, 6.0f);
+    for (;;) {
+        const CalibrationTable* t = _active.load(std::memory_order_acquire);
+        const std::atomic<uint32_t>& version = _versions[t == &_tables[1]];
+        uint32_t v = version.load(std::memory_order_acquire);
+        if (v & 1) continue;  // Rewrite in progress (two swaps behind)
+        float kp = t->lookup(adc);
+        // Retry if the table was rewritten while we read it
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (version.load(std::memory_order_relaxed) == v) return kp;
+    }
+}
+
+bool MonarkCalibration::updateValues(const CalPoint* points, uint8_t count, CalFit fit) {
+    if (!isMonotone(points, count)) return false;
+
+    CalPoint sorted[MAX_POINTS];
+    sortByAdc(points, count, sorted);
+    std::lock_guard<std::mutex> lock(_writeLock);
+    apply(sorted, count, fit);
+    return true;
+}
+
+bool MonarkCalibration::moveZero(float zeroMv, float maxShiftMv, int& shiftMv) {
+    std::lock_guard<std::mutex> lock(_writeLock);
+    if (_count == 0 || _points[0].kp != 0.0f) return false;
+    float delta = zeroMv - (float)_points[0].adc;
+    if (!(fabsf(delta) <= maxShiftMv)) return false;
+
+    // A uniform shift keeps the points sorted and monotone
+    int shift = (int)lroundf(delta);
+    CalPoint moved[MAX_POINTS];
+    for (uint8_t i = 0; i < _count; i++) {
+        moved[i] = _points[i];
+        moved[i].adc += shift;
+    }
+    apply(moved, _count, _fit);
+    shiftMv = shift;
+    return true;
+}
+
+uint8_t MonarkCalibration::getPoints(CalPoint* out, CalFit& fit) const {
+    std::lock_guard<std::mutex> lock(_writeLock);
+    memcpy(out, _points, sizeof(CalPoint) * _count);
+    fit = _fit;
+    return _count;
+}
+
+void MonarkCalibration::apply(const CalPoint* sorted, uint8_t count, CalFit fit) {
+    memcpy(_points, sorted, sizeof(CalPoint) * count);
+    _count = count;
+    _fit = fit;
+    computeTangents(_points, _count, _fit, _tangents);
+    computeResiduals();
+    rebuildTable();
+    _revision.fetch_add(1, std::memory_order_release);
+}
+
+void MonarkCalibration::sortByAdc(const CalPoint* points, uint8_t count, CalPoint* out) {
+    // Insertion sort by ADC (at most MAX_POINTS entries)
+    for (uint8_t i = 0; i < count; i++) {
+        CalPoint p = points[i];
+        uint8_t j = i;
+        while (j > 0 && out[j - 1].adc > p.adc) {
+            out[j] = out[j - 1];
+            j--;
+        }
+        out[j] = p;
+    }
+}
+
+bool MonarkCalibration::isMonotone(const CalPoint* points, uint8_t count) {
+    if (count < 2 || count > MAX_POINTS) return false;
+
+    CalPoint sorted[MAX_POINTS];
+    sortByAdc(points, count, sorted);
+    for (uint8_t i = 0; i + 1 < count; i++) {
+        // !(a < b) also rejects NaN kp
+        if (!(sorted[i].adc < sorted[i + 1].adc) || !(sorted[i].kp < sorted[i + 1].kp)) return false;
+    }
+    return true;
+}
+
+void MonarkCalibration::computeTangents(const CalPoint* pts, uint8_t n, CalFit fit, float* tangents) {
+    if (fit != CalFit::MonotoneCubic || n < 3) return;
+
+    // Fritsch-Carlson: secant slopes, averaged at interior points, zeroed at
+    // local extrema and limited so the cubic never overshoots.
+    float secant[MAX_POINTS];
+    for (uint8_t k = 0; k + 1 < n; k++) {
+        float dx = (float)(pts[k + 1].adc - pts[k].adc);
+        secant[k] = (dx != 0.0f) ? (pts[k + 1].kp - pts[k].kp) / dx : 0.0f;
+    }
+
+    tangents[0] = secant[0];
+    tangents[n - 1] = secant[n - 2];
+    for (uint8_t k = 1; k + 1 < n; k++) {
+        tangents[k] = (secant[k - 1] * secant[k] <= 0.0f) ? 0.0f : (secant[k - 1] + secant[k]) * 0.5f;
+    }
+
+    for (uint8_t k = 0; k + 1 < n; k++) {
+        if (secant[k] == 0.0f) {
+            tangents[k] = 0.0f;
+            tangents[k + 1] = 0.0f;
+            continue;
+        }
+        float a = tangents[k] / secant[k];
+        float b = tangents[k + 1] / secant[k];
+        float h = a * a + b * b;
+        if (h > 9.0f) {
+            float t = 3.0f / sqrtf(h);
+            tangents[k] = t * a * secant[k];
+            tangents[k + 1] = t * b * secant[k];
+        }
+    }
+}
+
+float MonarkCalibration::evaluate(const CalPoint* pts, const float* tangents, uint8_t n, CalFit fit, float adc) {
+    // Below the lowest point - clamp (0kp when the first point is 0kp)
+    if (adc <= (float)pts[0].adc) return pts[0].kp;
+
+    // Above the highest point - extrapolate the last segment's slope
+    if (adc >= (float)pts[n - 1].adc) {
+        const CalPoint& p0 = pts[n - 2];
+        const CalPoint& p1 = pts[n - 1];
+        float dx = (float)(p1.adc - p0.adc);
+        if (dx == 0.0f) return p1.kp;
+        return p1.kp + (adc - (float)p1.adc) * (p1.kp - p0.kp) / dx;
+    }
+
+    // Binary search for the segment [lo, lo + 1] containing adc
+    uint8_t lo = 0, hi = n - 1;
+    while (hi - lo > 1) {
+        uint8_t mid = (lo + hi) / 2;
+        if ((float)pts[mid].adc <= adc) lo = mid;
+        else hi = mid;
+    }
+
+    const CalPoint& p0 = pts[lo];
+    const CalPoint& p1 = pts[hi];
+    float dx = (float)(p1.adc - p0.adc);
+    if (dx == 0.0f) return p0.kp;
+    float t = (adc - (float)p0.adc) / dx;
+
+    if (fit != CalFit::MonotoneCubic || n < 3) {
+        return p0.kp + t * (p1.kp - p0.kp);
+    }
+
+    // Cubic Hermite basis
+    float t2 = t * t;
+    float t3 = t2 * t;
+    float h00 = 2.0f * t3 - 3.0f * t2 + 1.0f;
+    float h10 = t3 - 2.0f * t2 + t;
+    float h01 = -2.0f * t3 + 3.0f * t2;
+    float h11 = t3 - t2;
+    return h00 * p0.kp + h10 * dx * tangents[lo] + h01 * p1.kp + h11 * dx * tangents[hi];
+}
+
+float MonarkCalibration::adcToKpExact(float adc) const {
+    return evaluate(_points, _tangents, _count, _fit, adc);
+}
+
+float MonarkCalibration::kpToAdc(float kp) const {
+    // Both fits are monotone increasing in adc, so bisection converges
+    float lo = 0.0f;
+    float hi = (float)CalibrationTable::MAX_MV;
+    if (kp <= adcToKpExact(lo)) return lo;
+    if (kp >= adcToKpExact(hi)) return hi;
+    for (uint8_t i = 0; i < 24; i++) {
+        float mid = 0.5f * (lo + hi);
+        if (adcToKpExact(mid) < kp) lo = mid; else hi = mid;
+    }
+    return 0.5f * (lo + hi);
+}
+
+void MonarkCalibration::computeResiduals() {
+    for (uint8_t i = 0; i < _count; i++) _residuals[i] = 0.0f;
+    if (_count < 3) return;
+
+    CalPoint others[MAX_POINTS];
+    float tangents[MAX_POINTS];
+    for (uint8_t i = 1; i + 1 < _count; i++) {
+        uint8_t n = 0;
+        for (uint8_t j = 0; j < _count; j++) {
+            if (j != i) others[n++] = _points[j];
+        }
+        computeTangents(others, n, _fit, tangents);
+        _residuals[i] = _points[i].kp - evaluate(others, tangents, n, _fit, (float)_points[i].adc);
+    }
+}
+
+void MonarkCalibration::rebuildTable() {
+    // Fill whichever table is not active, then publish it. Readers still
+    // on the old pointer finish on a complete (old) table; a reader that
+    // picked this one up before the previous swap sees its version change.
+    const CalibrationTable* current = _active.load(std::memory_order_relaxed);
+    uint8_t nextIdx = (current == &_tables[0]) ? 1 : 0;
+    CalibrationTable* next = &_tables[nextIdx];
+    std::atomic<uint32_t>& version = _versions[nextIdx];
+    version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const uint16_t STEP = CalibrationTable::STEP_MV;
+    float startMv = (float)_points[0].adc;
+    float span = (float)(_points[_count - 1].adc - _points[0].adc);
+    uint32_t last = (uint32_t)ceilf(span / (float)STEP);
+    if (last > CalibrationTable::SIZE - 1) last = CalibrationTable::SIZE - 1;
+    if (last < 1) last = 1;
+
+    float maxAbs = 0.0f;
+    for (uint16_t i = 0; i <= last; i++) {
+        float a = fabsf(adcToKpExact(startMv + (float)(i * STEP)));
+        if (a > maxAbs) maxAbs = a;
+    }
+    uint8_t fracBits = CalibrationTable::MAX_FRAC_BITS;
+    while (fracBits > 0 && maxAbs * (float)(1 << fracBits) > 32767.0f) fracBits--;
+    float one = (float)(1 << fracBits);
+
+    for (uint16_t i = 0; i < CalibrationTable::SIZE; i++) {
+        float kp = (i <= last) ? adcToKpExact(startMv + (float)(i * STEP)) : 0.0f;
+        float q = kp * one + (kp >= 0.0f ? 0.5f : -0.5f);
+        if (q > 32767.0f) q = 32767.0f;
+        if (q < -32768.0f) q = -32768.0f;
+        next->kp[i] = (int16_t)q;
+    }
+    next->last = (uint16_t)last;
+    next->scale = 1.0f / one;
+    next->startMv = startMv;
+    next->startKp = _points[0].kp;
+    next->endMv = startMv + (float)(last * STEP);
+    next->endKp = adcToKpExact(next->endMv);
+    next->slope = adcToKpExact(next->endMv + 1.0f) - next->endKp;
+
+    version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    _active.store(next, std::memory_order_release);
+}
+
+uint8_t MonarkCalibration::captureOrder(const float* kps, uint8_t count, float* out) {
+    if (count > MAX_POINTS) count = MAX_POINTS;
+
+    // Sort ascending, then emit lowest followed by the rest highest-first
+    float sorted[MAX_POINTS];
+    for (uint8_t i = 0; i < count; i++) {
+        float v = kps[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+
+    if (count == 0) return 0;
+    out[0] = sorted[0];
+    for (uint8_t i = 1; i < count; i++) {
+        out[i] = sorted[count - i];
+    }
+    return count;
+}
+
+const char* MonarkCalibration::fitName(CalFit fit) {
+    return fit == CalFit::Linear ? "linear" : "monotone";
+}
+
+CalFit MonarkCalibration::fitFromName(const char* name, CalFit fallback) {
+    if (!name) return fallback;
+    if (strcmp(name, "linear") == 0) return CalFit::Linear;
+    if (strcmp(name, "monotone") == 0) return CalFit::MonotoneCubic;
+    return fallback;
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include <stdint.h>
+#include <atomic>
+#include <mutex>
 
 class ICalibration {
 public:
@@ -7,23 +9,133 @@ public:
     virtual float adcToKp(float adc) = 0;
 };
 
+// One calibration point: ADC millivolts measured at a known pendulum load
+struct CalPoint {
+    float kp;
+    int adc;
+};
+
+enum class CalFit : uint8_t {
+    Linear = 0,         // Piecewise linear between points
+    MonotoneCubic = 1   // Fritsch-Carlson monotone cubic Hermite
+};
+
+// Compiled calibration: kp sampled every STEP_MV millivolts from the first
+// calibration point up to the last one, as int16 in a per-table fixed-point
+// format (as many fraction bits as the kp range allows, e.g. Q3.12 below
+// 8 kp). Outside that range the fit is flat below and a straight line above,
+// so both are stored as such and need no entries. Lookup is branch-light:
+// one index, one fixed-point interpolation between neighbouring entries.
+// 3.3 KB per table, half the size of the Q16.16 table over 0..MAX_MV.
+struct CalibrationTable {
+    static const uint16_t STEP_MV = 2;
+    static const uint16_t MAX_MV = 3300;
+    static const uint16_t SIZE = MAX_MV / STEP_MV + 2;
+    static const uint8_t MAX_FRAC_BITS = 14;
+
+    int16_t kp[SIZE];
+    uint16_t last = 0;        // Last entry; linear above it
+    float scale = 1.0f;       // 2^-fracBits
+    float startMv = 0.0f;     // First point; flat below it
+    float startKp = 0.0f;
+    float endMv = 0.0f;       // = startMv + last * STEP_MV
+    float endKp = 0.0f;
+    float slope = 0.0f;       // kp per mV above endMv
+
+    float lookup(float mv) const {
+        if (mv <= startMv) return startKp;
+        float x = (mv - startMv) * (1.0f / (float)STEP_MV);
+        uint32_t i = (uint32_t)x;
+        if (i >= last) return endKp + (mv - endMv) * slope;
+        int32_t frac = (int32_t)((x - (float)i) * 32768.0f);  // Q15
+        int32_t a = kp[i];
+        int32_t v = a + (((int32_t)kp[i + 1] - a) * frac >> 15);
+        return (float)v * scale;
+    }
+};
+
+// Calibration with any number of points (2..MAX_POINTS). Below the first
+// point kp clamps to the first point's kp; above the last point the last
+// segment's slope is extrapolated (allows loads beyond the calibrated range).
 class MonarkCalibration : public ICalibration {
 public:
-    MonarkCalibration(int adc0, int adc2, int adc4, int adc6);
+    static const uint8_t MAX_POINTS = 12;
+
+    MonarkCalibration(const CalPoint* points, uint8_t count, CalFit fit = CalFit::Linear);
+
+    // Table lookup - safe to call from any task while updateValues() runs
     float adcToKp(float adc) override;
-    
-    void updateValues(int adc0, int adc2, int adc4, int adc6) {
-        _adc0 = adc0; _adc2 = adc2; _adc4 = adc4; _adc6 = adc6;
-    }
 
-    // Getters for calibration values
-    int getAdc0() const { return _adc0; }
-    int getAdc2() const { return _adc2; }
-    int getAdc4() const { return _adc4; }
-    int getAdc6() const { return _adc6; }
+    // Reference evaluation of the fit the table is compiled from
+    float adcToKpExact(float adc) const;
+
+    // Inverse of the fit: the ADC millivolts that read as 'kp' (simulation).
+    // Clamped to 0..CalibrationTable::MAX_MV.
+    float kpToAdc(float kp) const;
+
+    // Replace the points (sorted by ADC internally), refit, recompute
+    // residuals, rebuild the inactive table and swap it in atomically.
+    // Returns false (and keeps the old calibration) if count is out of range
+    // or the points are not monotone (see isMonotone).
+    // Callers from different tasks are serialised; any number of updates
+    // may follow each other back to back.
+    bool updateValues(const CalPoint* points, uint8_t count, CalFit fit);
+
+    // Zero offset as one update under the same lock as updateValues(), so a
+    // concurrent update is never overwritten with stale points: moves every
+    // point by zeroMv minus the 0 kp point's ADC. Returns false (and changes
+    // nothing) without a 0 kp first point or if the move exceeds maxShiftMv.
+    bool moveZero(float zeroMv, float maxShiftMv, int& shiftMv);
+
+    // Consistent copy of the points (sorted by ADC) and fit while other
+    // tasks may update them; returns the count. Takes the update lock.
+    uint8_t getPoints(CalPoint* out, CalFit& fit) const;
+
+    // Bumped by every successful update; loop() saves the points to NVS
+    // when it moves, so NVS always holds a getPoints() copy
+    uint32_t getRevision() const { return _revision.load(std::memory_order_acquire); }
+
+    uint8_t getPointCount() const { return _count; }
+    const CalPoint& getPoint(uint8_t i) const { return _points[i]; }
+    CalFit getFit() const { return _fit; }
+
+    // Leave-one-out residual of point i in kp: its kp minus the value the
+    // fit predicts from all other points. Large values flag a bad capture.
+    // Always 0 for the first and last point (nothing to interpolate from).
+    float getResidual(uint8_t i) const { return _residuals[i]; }
+
+    // True if, sorted by ADC, both ADC and kp strictly increase - more load
+    // must always read higher. Count must be 2..MAX_POINTS.
+    static bool isMonotone(const CalPoint* points, uint8_t count);
+
+    // Capture order for a set of kp targets: lowest first, then highest
+    // down (easier to remove weights than add them). Returns count.
+    static uint8_t captureOrder(const float* kps, uint8_t count, float* out);
+
+    static const char* fitName(CalFit fit);
+    static CalFit fitFromName(const char* name, CalFit fallback);
 
 private:
-    int _adc0, _adc2, _adc4, _adc6;
-    
-    float lerp(float x, float x0, float y0, float x1, float y1);
+    CalPoint _points[MAX_POINTS];
+    float _tangents[MAX_POINTS];
+    float _residuals[MAX_POINTS];
+    uint8_t _count = 0;
+    CalFit _fit = CalFit::MonotoneCubic;
+
+    // Double buffer with a version per table, odd while it is being
+    // rewritten: a reader that overlapped a rewrite sees the version move
+    // and looks up again, so back-to-back updates never hand out a
+    // half-written table and the writer never waits for readers
+    CalibrationTable _tables[2];
+    std::atomic<const CalibrationTable*> _active{nullptr};
+    std::atomic<uint32_t> _versions[2] = {{0}, {0}};
+    mutable std::mutex _writeLock;
+    std::atomic<uint32_t> _revision{0};
+
+    static void sortByAdc(const CalPoint* points, uint8_t count, CalPoint* out);
+    void apply(const CalPoint* sorted, uint8_t count, CalFit fit);
+    static void computeTangents(const CalPoint* pts, uint8_t n, CalFit fit, float* tangents);
+    static float evaluate(const CalPoint* pts, const float* tangents, uint8_t n, CalFit fit, float adc);
+    void computeResiduals();
+    void rebuildTable();
 };
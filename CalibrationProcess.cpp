@@ -1,14 +1,24 @@
 #include "CalibrationProcess.h"
 
-CalibrationProcess::CalibrationProcess(uint8_t btnPin, uint8_t adcPin, IDisplay* lcd, SettingsManager* settings, MonarkCalibration* calObj)
-    : _btnPin(btnPin), _adcPin(adcPin), _lcd(lcd), _settings(settings), _calObj(calObj) {}
+CalibrationProcess::CalibrationProcess(uint8_t btnPin, AdcService* adc, IDisplay* lcd, MonarkCalibration* calObj)
+    : _btnPin(btnPin), _adc(adc), _lcd(lcd), _calObj(calObj) {}
 
 void CalibrationProcess::begin() {
     pinMode(_btnPin, INPUT_PULLUP);
 }
 
+void CalibrationProcess::beginPlan() {
+    // Re-capture the same kp points the active calibration uses
+    float kps[MonarkCalibration::MAX_POINTS];
+    uint8_t n = _calObj->getPointCount();
+    for (uint8_t i = 0; i < n; i++) kps[i] = _calObj->getPoint(i).kp;
+    _planCount = MonarkCalibration::captureOrder(kps, n, _plan);
+    _step = 0;
+    _state = CAPTURE;
+}
+
 void CalibrationProcess::startCalibration() {
-    _state = WAIT_0KP;
+    beginPlan();
     if (_lcd) {
         _lcd->showMessage("Calibration Req.", "Starting...     ");
         delay(1000);
@@ -20,62 +30,46 @@ bool CalibrationProcess::isCalibrating() const {
 }
 
 float CalibrationProcess::readAdcAvg() {
-    // Quick 8-sample average - RC filter handles smoothing, returns calibrated millivolts
-    // Discard first 2 readings to avoid spikes from ADC settling
-    analogReadMilliVolts(_adcPin);
-    analogReadMilliVolts(_adcPin);
-
-    float sum = 0.0f;
-    for (int i = 0; i < 8; i++) {
-        sum += (float)analogReadMilliVolts(_adcPin);
-    }
-    yield();
-    return sum / 8.0f;
+    // 1-second mean published by the shared ADC service (calibrated mV)
+    return _adc->read().avg1s;
 }
 
-void CalibrationProcess::saveAndApply() {
-    // Save to NVS
-    _settings->saveCalibration(_tempAdc[0], _tempAdc[1], _tempAdc[2], _tempAdc[3]);
-    
-    // Update live object (we need to add a setter to MonarkCalibration or just re-instantiate, 
-    // but re-instantiating is hard because PowerReal holds the pointer.
-    // Let's assume we can update it or we just rely on the next reboot. 
-    // Ideally MonarkCalibration should have a updateValues method.
-    // For now, we will cast or assume the user reboots, OR we add updateValues to MonarkCalibration.
-    
-    // Let's update the object directly if we can.
-    _calObj->updateValues(_tempAdc[0], _tempAdc[1], _tempAdc[2], _tempAdc[3]);
+bool CalibrationProcess::saveAndApply() {
+    // Update the live object (PowerReal holds the pointer), keeping the fit.
+    // Readings that don't rise with the load (weight swinging, repeated
+    // reading) are rejected and leave the old calibration in place.
+    CalFit fit = _calObj->getFit();
+    // loop() saves the new points to NVS
+    return _calObj->updateValues(_captured, _planCount, fit);
 }
 
 void CalibrationProcess::handleButtonPress() {
     switch (_state) {
         case IDLE:
-            _state = WAIT_0KP;
-            _lcd->showMessage("Calibration Mode", "Release Button  ");
+            beginPlan();
+            if (_lcd) _lcd->showMessage("Calibration Mode", "Release Button  ");
             delay(1000); // Simple debounce/wait for release
             break;
 
-        // Order: 0kp -> 6kp -> 4kp -> 2kp (easier to remove weights)
-        case WAIT_0KP:
-            _tempAdc[0] = (int)roundf(readAdcAvg());
-            _state = WAIT_6KP;
-            break;
-
-        case WAIT_6KP:
-            _tempAdc[3] = (int)roundf(readAdcAvg());
-            _state = WAIT_4KP;
-            break;
-
-        case WAIT_4KP:
-            _tempAdc[2] = (int)roundf(readAdcAvg());
-            _state = WAIT_2KP;
-            break;
-
-        case WAIT_2KP:
-            _tempAdc[1] = (int)roundf(readAdcAvg());
-            saveAndApply();
-            _state = DONE;
-            _doneStartTime = millis();
+        // Order: lowest kp first, then highest down (easier to remove weights)
+        case CAPTURE:
+            _captured[_step].kp = _plan[_step];
+            _captured[_step].adc = (int)roundf(readAdcAvg());
+            _step++;
+            if (_step >= _planCount) {
+                if (saveAndApply()) {
+                    _state = DONE;
+                    _doneStartTime = millis();
+                } else {
+                    // Nothing was applied or saved: capture the whole plan again
+                    Serial.println("Calibration rejected: readings not increasing with load");
+                    if (_lcd) {
+                        _lcd->showMessage("Bad readings!   ", "Capture again   ");
+                        delay(2000);
+                    }
+                    beginPlan();
+                }
+            }
             break;
 
         case DONE:
@@ -88,21 +82,18 @@ void CalibrationProcess::showState() {
     if (!_lcd) return;  // No display, skip
 
     static State lastShownState = IDLE;
+    static uint8_t lastShownStep = 0xFF;
 
-    // Show header only on state change
-    if (_state != lastShownState) {
+    // Show header only on state/step change
+    if (_state != lastShownState || (_state == CAPTURE && _step != lastShownStep)) {
         lastShownState = _state;
-        const char* header = nullptr;
-        switch (_state) {
-            case WAIT_0KP: header = "Set 0kp & Click"; break;
-            case WAIT_2KP: header = "Set 2kp & Click"; break;
-            case WAIT_4KP: header = "Set 4kp & Click"; break;
-            case WAIT_6KP: header = "Set 6kp & Click"; break;
-            case DONE:     header = "Calibration Done"; break;
-            default: break;
-        }
-        if (header) {
-            _lcd->showMessage(header, _state == DONE ? "Saved!" : "");
+        lastShownStep = _step;
+        char header[17];
+        if (_state == CAPTURE) {
+            snprintf(header, sizeof(header), "Set %gkp & Click", _plan[_step]);
+            _lcd->showMessage(header, "");
+        } else if (_state == DONE) {
+            _lcd->showMessage("Calibration Done", "Saved!");
         }
     }
 
@@ -1,12 +1,12 @@
 #pragma once
 #include <Arduino.h>
 #include "IDisplay.h"
-#include "SettingsManager.h"
 #include "Calibration.h"
+#include "AdcService.h"
 
 class CalibrationProcess {
 public:
-    CalibrationProcess(uint8_t btnPin, uint8_t adcPin, IDisplay* lcd, SettingsManager* settings, MonarkCalibration* calObj);
+    CalibrationProcess(uint8_t btnPin, AdcService* adc, IDisplay* lcd, MonarkCalibration* calObj);
     
     void begin();
     void update(); // Call in loop
@@ -16,21 +16,22 @@ public:
 private:
     enum State {
         IDLE,
-        WAIT_0KP,
-        WAIT_6KP,
-        WAIT_4KP,
-        WAIT_2KP,
+        CAPTURE,   // Waiting for the pendulum at _plan[_step]
         DONE
     };
 
     uint8_t _btnPin;
-    uint8_t _adcPin;
+    AdcService* _adc;
     IDisplay* _lcd;
-    SettingsManager* _settings;
     MonarkCalibration* _calObj;
 
     State _state = IDLE;
-    int _tempAdc[4]; // 0, 2, 4, 6
+
+    // Capture plan: the current calibration's kp values in capture order
+    float _plan[MonarkCalibration::MAX_POINTS];
+    uint8_t _planCount = 0;
+    uint8_t _step = 0;
+    CalPoint _captured[MonarkCalibration::MAX_POINTS];
 
     // Button debounce
     bool _lastBtnState = HIGH;
@@ -43,8 +44,9 @@ private:
     // Done timer
     uint32_t _doneStartTime = 0;
 
+    void beginPlan();
     void handleButtonPress();
     float readAdcAvg();  // Returns float for precision, round when storing
     void showState();
-    void saveAndApply();
+    bool saveAndApply();  // False if the captured points were rejected
 };
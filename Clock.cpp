@@ -0,0 +1,38 @@
+#include "Clock.h"
+#include <esp_attr.h>
+#include <esp_timer.h>
+
+static Clock::SourceFn g_source = nullptr;
+static uint64_t g_virtual_us = 0;
+static uint32_t g_scale = 1;
+static uint64_t g_scale_base = 0;  // Hardware time when scaling started
+
+// IRAM: also called from the cadence ISR
+uint64_t IRAM_ATTR Clock::nowUs() {
+  if (g_source) return g_source();
+  uint64_t t = (uint64_t)esp_timer_get_time();
+  if (g_scale > 1) t = g_scale_base + (t - g_scale_base) * g_scale;
+  return t;
+}
+
+void Clock::setSource(SourceFn fn) {
+  g_source = fn;
+}
+
+static uint64_t virtualNowUs() {
+  return g_virtual_us;
+}
+
+void Clock::useVirtual(uint64_t startUs) {
+  g_virtual_us = startUs;
+  g_source = &virtualNowUs;
+}
+
+void Clock::advanceVirtual(uint64_t dtUs) {
+  g_virtual_us += dtUs;
+}
+
+void Clock::setScale(uint32_t factor) {
+  g_scale_base = (uint64_t)esp_timer_get_time();
+  g_scale = factor ? factor : 1;
+}
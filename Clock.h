@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+
+// Monotonic 64-bit time base shared by all timing code.
+// Backed by esp_timer (microseconds since boot), so it never wraps in
+// practice - unlike millis() (49 days) or 32-bit math on ms * 1024 (~70 min).
+class Clock {
+public:
+  typedef uint64_t (*SourceFn)();
+
+  static uint64_t nowUs();
+  static uint64_t nowMs() { return nowUs() / 1000ULL; }
+
+  // Install a custom time source, e.g. a virtual clock that can be
+  // fast-forwarded. Pass nullptr to restore the hardware timer.
+  static void setSource(SourceFn fn);
+
+  // Built-in virtual clock: time only moves when advanced (host runs,
+  // replays). Installs itself as the source, starting at startUs.
+  static void useVirtual(uint64_t startUs);
+  static void advanceVirtual(uint64_t dtUs);
+
+  // Run the hardware timer 'factor' times faster than real time from now
+  // on (stress tests). Call once at startup; 1 = real time.
+  static void setScale(uint32_t factor);
+
+  // Timestamp (us) -> BLE event time in 1/1024 s, rolling over at 16 bits
+  static uint16_t toBle1024(uint64_t us) {
+    return (uint16_t)((us * 1024ULL) / 1000000ULL);
+  }
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+#include "Clock.h"
+
+// Measures the share of wall time spent in a bracketed section of code
+// (start()/stop()), bucketed per slot so the cost of each output rate can
+// be compared after switching between them. Used for the power task's
+// sample production and for the loop's fan-out to consumers.
+class CpuMeter {
+public:
+  static const uint8_t MAX_SLOTS = 4;
+  static const uint64_t WINDOW_US = 1000000;  // Publish once per second
+
+  struct Load {
+    float percent;       // Busy time / wall time over the last window
+    uint32_t usPerRun;   // Mean busy time per start()/stop() pair
+    uint32_t maxUs;      // Worst single run in the last window
+  };
+
+  // Select the bucket new measurements go into; restarts the window
+  void select(uint8_t slot) {
+    if (slot >= MAX_SLOTS) return;
+    _slot = slot;
+    resetWindow(Clock::nowUs());
+  }
+
+  void start() { _t0 = Clock::nowUs(); }
+
+  void stop() {
+    uint64_t now = Clock::nowUs();
+    uint32_t busy = (uint32_t)(now - _t0);
+    _busyUs += busy;
+    _runs++;
+    if (busy > _maxUs) _maxUs = busy;
+
+    uint64_t wall = now - _windowStart;
+    if (wall >= WINDOW_US) {
+      Load& l = _loads[_slot];
+      l.percent = 100.0f * (float)_busyUs / (float)wall;
+      l.usPerRun = (uint32_t)(_busyUs / _runs);
+      l.maxUs = _maxUs;
+      _measured[_slot] = true;
+      resetWindow(now);
+    }
+  }
+
+  bool hasLoad(uint8_t slot) const { return slot < MAX_SLOTS && _measured[slot]; }
+  const Load& getLoad(uint8_t slot) const { return _loads[slot < MAX_SLOTS ? slot : 0]; }
+
+private:
+  uint8_t _slot = 0;
+  uint64_t _t0 = 0;
+  uint64_t _windowStart = 0;
+  uint64_t _busyUs = 0;
+  uint32_t _runs = 0;
+  uint32_t _maxUs = 0;
+  Load _loads[MAX_SLOTS] = {};
+  bool _measured[MAX_SLOTS] = {};
+
+  void resetWindow(uint64_t now) {
+    _windowStart = now;
+    _busyUs = 0;
+    _runs = 0;
+    _maxUs = 0;
+  }
+};
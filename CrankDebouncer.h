@@ -0,0 +1,178 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include "CrankEdgeStats.h"
+
+// Reed switch edge filter shared by the cadence ISR and the simulator.
+// A closing edge after the switch has been open for the debounce time
+// starts a candidate revolution, unless it comes sooner than the minimum
+// rev period after the last count. Closings within the debounce time of an
+// opening are contact bounce (on either edge) and belong to the same
+// closure. The candidate is counted on the first opening edge that follows
+// at least MIN_CLOSED_US of closed switch, and keeps the time of its
+// closing edge (lastRevUs()). Noise spikes - closures shorter than that -
+// are dropped by the next closing instead of taking the revolution's place.
+//
+// Both gates adapt to the current rev period (a running average of
+// counted revs): the debounce is a small fraction of it and the minimum
+// period about half of it, each clamped to safe bounds. After a stop, or
+// before the first interval, the fixed defaults apply. Integer-only,
+// header-only and always_inline so the ISR never calls into flash.
+//
+// Edges come from one context (the ISR, or the task feeding a simulated
+// or replayed switch); the timestamps are private to it. Other tasks only
+// call getStats(), which retries around a per-edge version count instead
+// of reading counters and gates the edge context is halfway through.
+//
+// With several crank magnets a "rev" here is one magnet pulse: the
+// minimum-period bounds and default are divided by the pulses per rev.
+class CrankDebouncer {
+public:
+  // Gates before the rev period is known (and after a stop)
+  static const uint32_t EDGE_DEBOUNCE_US  = 12000;
+  static const uint32_t MIN_REV_PERIOD_US = 200000;
+
+  // Closed time that makes a closure a magnet pass rather than a spike.
+  // Well under the shortest real closure (a few ms at 250 rpm).
+  static const uint32_t MIN_CLOSED_US = 2000;
+
+  // Adaptive bounds. The floor of the rev gate caps cadence at 400 rpm.
+  static const uint32_t EDGE_DEBOUNCE_MIN_US  = 4000;
+  static const uint32_t EDGE_DEBOUNCE_MAX_US  = 25000;
+  static const uint32_t MIN_REV_PERIOD_MIN_US = 150000;
+  static const uint32_t MIN_REV_PERIOD_MAX_US = 600000;
+
+  // Debounce = period / 64, min rev period = period / 2. A missed rev
+  // only moves the average by a quarter, so the gate stays below the
+  // next real period.
+  static const uint8_t DEBOUNCE_SHIFT = 6;
+  static const uint8_t REV_GATE_SHIFT = 1;
+  static const uint8_t AVG_SHIFT      = 2;
+
+  // Intervals longer than this many average periods mean the rider
+  // stopped: the average is dropped
+  static const uint32_t STALE_PERIODS = 3;
+
+  // Counters since boot (the riding session). Written by the edge context only.
+  typedef CrankEdgeStats Stats;
+
+  // Magnets on the crank (1 = one pulse per rev). Call before edges flow.
+  void setPulsesPerRev(uint8_t n) {
+    if (n < 1) n = 1;
+    _revGateDefaultUs = MIN_REV_PERIOD_US / n;
+    _revGateMinUs = MIN_REV_PERIOD_MIN_US / n;
+    _revGateMaxUs = MIN_REV_PERIOD_MAX_US / n;
+    _minRevPeriodUs = _revGateDefaultUs;
+  }
+
+  // One switch transition at t_us (closed = magnet over the reed).
+  // Returns true if it completes a revolution; its time is lastRevUs().
+  inline __attribute__((always_inline)) bool onEdge(uint64_t t_us, bool closed) {
+    // Odd while the edge is applied, for getStats() on another core
+    uint32_t v = _version.load(std::memory_order_relaxed);
+    _version.store(v + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bool rev = edge(t_us, closed);
+    _version.store(v + 2, std::memory_order_release);
+    return rev;
+  }
+
+  // Edge context only
+  uint64_t lastRevUs() const { return _lastRevUs; }
+
+  // Consistent snapshot for reporting from any task. An edge takes well
+  // under a microsecond; if it stays in progress (its task preempted by
+  // this one) the report settles for the copy it has.
+  Stats getStats() const {
+    Stats s;
+    for (uint8_t tries = 0;; tries++) {
+      uint32_t v = _version.load(std::memory_order_acquire);
+      s.edges = _stats.edges;
+      s.counted = _stats.counted;
+      s.bounced = _stats.bounced;
+      s.glitches = _stats.glitches;
+      s.tooSoon = _stats.tooSoon;
+      s.restarts = _stats.restarts;
+      s.revPeriodUs = _periodUs;
+      s.debounceUs = _debounceUs;
+      s.minRevPeriodUs = _minRevPeriodUs;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (!(v & 1) && _version.load(std::memory_order_relaxed) == v) return s;
+      if (tries == STATS_RETRIES) return s;
+    }
+  }
+
+private:
+  volatile uint64_t _closedUs = 0;     // Last closing edge, bounces included
+  volatile uint64_t _openedUs = 0;     // Last opening edge, bounces included
+  volatile uint64_t _candidateUs = 0;  // Closure waiting to be counted (0 = none)
+  volatile uint64_t _lastRevUs = 0;
+
+  volatile uint32_t _periodUs = 0;  // Running average rev period (0 = unknown)
+  volatile uint32_t _debounceUs = EDGE_DEBOUNCE_US;
+  volatile uint32_t _minRevPeriodUs = MIN_REV_PERIOD_US;
+  volatile Stats _stats{};
+  std::atomic<uint32_t> _version{0};  // Bumped before and after each edge
+  static const uint8_t STATS_RETRIES = 100;
+
+  // Rev gate bounds for one pulse (setPulsesPerRev)
+  uint32_t _revGateDefaultUs = MIN_REV_PERIOD_US;
+  uint32_t _revGateMinUs = MIN_REV_PERIOD_MIN_US;
+  uint32_t _revGateMaxUs = MIN_REV_PERIOD_MAX_US;
+
+  inline __attribute__((always_inline)) bool edge(uint64_t t_us, bool closed) {
+    _stats.edges++;
+    if (closed) {
+      uint64_t openFor = t_us - _openedUs;
+      _closedUs = t_us;
+      // Closing right after an opening: bounce, the closure goes on
+      if (openFor < _debounceUs) { _stats.bounced++; return false; }
+
+      // A new closure: a candidate still pending was a spike
+      if (_candidateUs != 0) { _stats.glitches++; _candidateUs = 0; }
+      if (_lastRevUs != 0 && (t_us - _lastRevUs) < _minRevPeriodUs) { _stats.tooSoon++; return false; }
+      _candidateUs = t_us;
+      return false;
+    }
+
+    // Opening: counts the candidate once the switch has stayed closed
+    _openedUs = t_us;
+    if (_candidateUs == 0 || (t_us - _closedUs) < MIN_CLOSED_US) return false;
+    uint64_t rev = _candidateUs;
+    _candidateUs = 0;
+
+    if (_lastRevUs != 0) adapt(rev - _lastRevUs);
+    _lastRevUs = rev;
+    _stats.counted++;
+    return true;
+  }
+
+  static inline __attribute__((always_inline)) uint32_t clamp(uint32_t v, uint32_t lo, uint32_t hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+  }
+
+  // Fold a counted interval into the average and re-derive the gates
+  inline __attribute__((always_inline)) void adapt(uint64_t since) {
+    uint32_t avg = _periodUs;
+    if (avg != 0 && since > (uint64_t)avg * STALE_PERIODS) {
+      // Rider stopped: this interval says nothing about the next one
+      _stats.restarts++;
+      _periodUs = 0;
+      _debounceUs = EDGE_DEBOUNCE_US;
+      _minRevPeriodUs = _revGateDefaultUs;
+      return;
+    }
+
+    uint32_t period = since > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32_t)since;
+    if (avg == 0) {
+      avg = period;
+    } else if (period > avg) {
+      avg += (period - avg) >> AVG_SHIFT;
+    } else {
+      avg -= (avg - period) >> AVG_SHIFT;
+    }
+    _periodUs = avg;
+    _debounceUs = clamp(avg >> DEBOUNCE_SHIFT, EDGE_DEBOUNCE_MIN_US, EDGE_DEBOUNCE_MAX_US);
+    _minRevPeriodUs = clamp(avg >> REV_GATE_SHIFT, _revGateMinUs, _revGateMaxUs);
+  }
+};
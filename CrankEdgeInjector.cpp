@@ -0,0 +1,98 @@
+#include "CrankEdgeInjector.h"
+
+static const uint64_t START_US = 1000000;  // Away from the debouncer's zero state
+static const uint32_t MIN_BOUNCE_US = 50;
+
+uint32_t CrankEdgeInjector::nextRandom() {
+  // xorshift32: deterministic for a given seed
+  _rng ^= _rng << 13;
+  _rng ^= _rng >> 17;
+  _rng ^= _rng << 5;
+  return _rng;
+}
+
+void CrankEdgeInjector::pushEdge(uint64_t t_us, bool closed) {
+  if (_edgeCount >= MAX_EDGES_PER_REV) return;  // Pathological config: drop the tail
+  _edgeTimes[_edgeCount] = t_us;
+  _edgeClosed[_edgeCount] = closed;
+  _edgeCount++;
+}
+
+void CrankEdgeInjector::bounce(uint64_t& t_us, bool closed, uint64_t limit_us) {
+  // A few short flips back and forth, ending in the settled state
+  uint8_t bounces = _cfg.maxBounces ? nextRandom() % (_cfg.maxBounces + 1) : 0;
+  float maxUs = (float)(_cfg.bounceUs > MIN_BOUNCE_US ? _cfg.bounceUs : MIN_BOUNCE_US);
+  for (uint8_t i = 0; i < bounces; i++) {
+    uint64_t away = t_us + (uint64_t)uniform((float)MIN_BOUNCE_US, maxUs);
+    uint64_t back = away + (uint64_t)uniform((float)MIN_BOUNCE_US, maxUs);
+    if (back >= limit_us) return;
+    pushEdge(away, !closed);
+    pushEdge(back, closed);
+    t_us = back;
+  }
+}
+
+void CrankEdgeInjector::noiseBurst(uint64_t from_us, uint64_t to_us) {
+  // Switch is open: spurious closures every noiseToggleUs, ending open
+  uint32_t step = _cfg.noiseToggleUs ? _cfg.noiseToggleUs : 1;
+  uint64_t t = from_us;
+  while (t + step < to_us) {
+    pushEdge(t, true);
+    pushEdge(t + step, false);
+    t += 2ULL * step;
+  }
+}
+
+CrankEdgeInjector::Result CrankEdgeInjector::run(float rpm, uint32_t revs) {
+  Result res{};
+  if (rpm <= 0.0f) return res;
+
+  _rng = _cfg.seed ? _cfg.seed : 1;
+  CrankDebouncer debouncer;
+  float periodUs = 60.0e6f / rpm;
+  uint64_t t0 = START_US;
+
+  for (uint32_t rev = 0; rev < revs; rev++) {
+    uint64_t period = (uint64_t)(periodUs * (1.0f + _cfg.periodJitter * uniform(-1.0f, 1.0f)));
+    uint64_t next = t0 + period;
+    uint64_t openAt = t0 + (uint64_t)(period * _cfg.closedFraction);
+
+    // Build this revolution's transitions, time ordered, all before 'next'
+    _edgeCount = 0;
+    uint64_t t = t0;
+    pushEdge(t, true);
+    bounce(t, true, openAt);
+    t = openAt;
+    pushEdge(t, false);
+    if (_cfg.bounceOnOpen) bounce(t, false, next);
+
+    if (_cfg.noiseBurstsPerRev > 0.0f) {
+      uint32_t bursts = (uint32_t)_cfg.noiseBurstsPerRev;
+      if (uniform(0.0f, 1.0f) < _cfg.noiseBurstsPerRev - (float)bursts) bursts++;
+      // One burst in each equal slot of the open phase keeps edges ordered
+      uint64_t quiet = t + _cfg.bounceUs;
+      if (bursts && next > quiet + _cfg.noiseBurstUs) {
+        uint64_t slot = (next - quiet) / bursts;
+        for (uint32_t b = 0; b < bursts && slot > _cfg.noiseBurstUs; b++) {
+          uint64_t start = quiet + b * slot + (uint64_t)uniform(0.0f, (float)(slot - _cfg.noiseBurstUs));
+          noiseBurst(start, start + _cfg.noiseBurstUs);
+        }
+      }
+    }
+
+    // Every count inside [t0, next) belongs to this revolution
+    uint32_t counts = 0;
+    for (uint16_t i = 0; i < _edgeCount; i++) {
+      if (debouncer.onEdge(_edgeTimes[i], _edgeClosed[i])) counts++;
+    }
+    res.edges += _edgeCount;
+    res.trueRevs++;
+    res.counted += counts;
+    if (counts == 0) res.missed++;
+    else res.doubled += counts - 1;
+
+    t0 = next;
+  }
+  res.gate = debouncer.getStats();
+  return res;
+}
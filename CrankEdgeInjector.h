@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include "CrankDebouncer.h"
+
+// Synthetic reed switch for regression-testing and benchmarking the
+// cadence front end on a host. Generates the switch transitions of a
+// crank at a given cadence - contact bounce when the magnet arrives,
+// optional bounce when it leaves, random noise bursts while the switch is
+// open - and runs them through CrankDebouncer, the exact logic cadenceISR
+// runs. Each counted revolution is matched to the true revolution it
+// falls in, so misses and double counts are reported separately.
+// No Arduino dependencies. Typical host sweep:
+//   CrankEdgeInjector inj(cfg);
+//   for (float rpm = 20; rpm <= 250; rpm += 10) {
+//     CrankEdgeInjector::Result r = inj.run(rpm, 1000);
+//     printf("%.0f rpm: %u missed, %u doubled\n", rpm, r.missed, r.doubled);
+//   }
+class CrankEdgeInjector {
+public:
+  struct Config {
+    float closedFraction = 0.15f;   // Part of a rev the magnet keeps the switch closed
+    float periodJitter = 0.02f;     // Rev-to-rev period variation (fraction, +/-)
+    uint8_t maxBounces = 3;         // Extra open/close pairs when closing
+    uint32_t bounceUs = 1500;       // Max length of each bounce half-cycle
+    bool bounceOnOpen = false;      // Also bounce when the contacts break
+    float noiseBurstsPerRev = 0.0f; // Expected noise bursts per rev (0 = none)
+    uint32_t noiseBurstUs = 2000;   // Length of one burst
+    uint32_t noiseToggleUs = 150;   // Spacing of the transitions in a burst
+    uint32_t seed = 1;
+  };
+
+  struct Result {
+    uint32_t trueRevs;  // Revolutions the crank made
+    uint32_t edges;     // Transitions fed to the debouncer
+    uint32_t counted;   // Revolutions the debouncer counted
+    uint32_t missed;    // True revs with no count
+    uint32_t doubled;   // Extra counts within one true rev
+    CrankDebouncer::Stats gate;  // Debouncer's own view (rejections, final gates)
+  };
+
+  explicit CrankEdgeInjector(const Config& config) : _cfg(config) {}
+
+  // Fresh debouncer, 'revs' revolutions at 'rpm'. Deterministic for a
+  // given config (seed included).
+  Result run(float rpm, uint32_t revs);
+
+private:
+  static const uint16_t MAX_EDGES_PER_REV = 128;
+
+  Config _cfg;
+  uint32_t _rng = 1;
+  uint64_t _edgeTimes[MAX_EDGES_PER_REV];
+  bool _edgeClosed[MAX_EDGES_PER_REV];
+  uint16_t _edgeCount = 0;
+
+  void pushEdge(uint64_t t_us, bool closed);
+  void bounce(uint64_t& t_us, bool closed, uint64_t limit_us);
+  void noiseBurst(uint64_t from_us, uint64_t to_us);
+  uint32_t nextRandom();
+  float uniform(float lo, float hi) { return lo + (hi - lo) * (float)(nextRandom() >> 8) * (1.0f / 16777216.0f); }
+};
@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+
+// Reed switch edge filter counters since boot (the riding session) and its
+// current gates, as reported by CrankDebouncer::getStats(). Kept apart so
+// sources and the web server can pass them around without the filter.
+struct CrankEdgeStats {
+  uint32_t edges;           // Transitions seen
+  uint32_t counted;         // Revolutions counted (magnet pulses with several magnets)
+  uint32_t bounced;         // Closings rejected as contact bounce
+  uint32_t glitches;        // Closures too short to count (noise spikes)
+  uint32_t tooSoon;         // Rejected by the minimum rev period
+  uint32_t restarts;        // Rev period average dropped after a stop
+  uint32_t revPeriodUs;     // Current average (0 = unknown)
+  uint32_t debounceUs;      // Current gates
+  uint32_t minRevPeriodUs;
+};
@@ -0,0 +1,74 @@
+#include "CrankPulses.h"
+
+// Gap learning: weight of one revolution's measurement, and the largest
+// rev-to-rev period change still trusted (cadence changing within the rev
+// would bias the gaps; a stop in between says nothing about them)
+static const float GAP_WEIGHT     = 1.0f / 16.0f;
+static const float MAX_REV_CHANGE = 0.15f;
+
+void CrankPulses::setPulsesPerRev(uint8_t n) {
+  if (n < 1) n = 1;
+  if (n > MAX_PULSES_PER_REV) n = MAX_PULSES_PER_REV;
+  _n = n;
+  reset();
+}
+
+void CrankPulses::reset() {
+  _pulses = 0;
+  _learnFrom = 0;
+  for (uint8_t i = 0; i < MAX_PULSES_PER_REV; i++) {
+    _gap[i] = i < _n ? 1.0f / _n : 0.0f;
+  }
+}
+
+uint8_t CrankPulses::gaps(float out[MAX_PULSES_PER_REV]) const {
+  // Bounded: a reader that preempted the pulse task mid-update (same
+  // core) would otherwise spin on an odd version forever
+  for (uint8_t tries = 0; tries < GAPS_RETRIES; tries++) {
+    uint32_t v = _version.load(std::memory_order_acquire);
+    if (v & 1) continue;  // Pulse being learned
+    for (uint8_t i = 0; i < _n; i++) out[i] = _gap[i];
+    // Retry if a pulse rewrote them while we copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (_version.load(std::memory_order_relaxed) == v) return _n;
+  }
+  return 0;
+}
+
+void CrankPulses::skip(uint32_t n) {
+  if (n == 0) return;
+  _pulses += n;
+  _learnFrom = _pulses;
+}
+
+float CrankPulses::onPulse(uint64_t t_us) {
+  uint32_t seq = _pulses++;
+  _hist[seq % HIST_SIZE] = t_us;
+  uint8_t slot = (uint8_t)(seq % _n);
+  if (_n == 1) return 1.0f;
+
+  // Learn once this magnet and the previous one were both seen one rev
+  // ago; the rev ending here is checked against the rev ending at the
+  // previous magnet
+  if (seq - _learnFrom > _n) {
+    uint64_t rev = t_us - at(seq - _n);
+    uint64_t prevRev = at(seq - 1) - at(seq - 1 - _n);
+    if (rev > 0 && prevRev > 0) {
+      float change = ((float)rev - (float)prevRev) / (float)prevRev;
+      if (change < MAX_REV_CHANGE && change > -MAX_REV_CHANGE) {
+        float measured = (float)(t_us - at(seq - 1)) / (float)rev;
+        uint32_t v = _version.load(std::memory_order_relaxed);
+        _version.store(v + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _gap[slot] += (measured - _gap[slot]) * GAP_WEIGHT;
+
+        // Keep the gaps summing to exactly one revolution
+        float sum = 0.0f;
+        for (uint8_t i = 0; i < _n; i++) sum += _gap[i];
+        for (uint8_t i = 0; i < _n; i++) _gap[i] /= sum;
+        _version.store(v + 2, std::memory_order_release);
+      }
+    }
+  }
+  return _gap[slot];
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+// Turns reed switch pulses from N crank magnets into crank angle, so the
+// cadence filters can update on every magnet instead of once per rev.
+// Magnets are rarely glued exactly 360/N degrees apart, so the angle
+// between consecutive magnets is learned: a magnet's pulse and the same
+// magnet's pulse one rev earlier bracket exactly one revolution, and the
+// share of it since the previous magnet is that magnet's gap. Gaps start
+// evenly spaced and follow a slow running average.
+// Hardware free: fed with pulse timestamps (us), so it can be replayed.
+// Pulses come from one task; gaps() may be called from any other.
+class CrankPulses {
+public:
+  static const uint8_t MAX_PULSES_PER_REV = 4;
+
+  // Resets the learned gaps. 1 = a single magnet (every pulse is a rev).
+  void setPulsesPerRev(uint8_t n);
+  uint8_t pulsesPerRev() const { return _n; }
+
+  void reset();
+
+  // One counted pulse at t_us (monotonic). Returns the crank angle in
+  // revs covered since the previous pulse: 1 with a single magnet, the
+  // learned gap otherwise.
+  float onPulse(uint64_t t_us);
+
+  // 'n' pulses were lost before the next one (e.g. the rev ring
+  // overflowed): keeps the next pulse on the right magnet, and learns
+  // again only once the history has no hole in it.
+  void skip(uint32_t n);
+
+  // Learned angle (revs) from the previous magnet to magnet 'slot'.
+  // Slots follow pulse order; slot 0 is the first pulse after reset().
+  float gap(uint8_t slot) const { return slot < _n ? _gap[slot] : 0.0f; }
+
+  // All gaps from one pulse (they sum to one revolution), for reporting
+  // from another task. Returns the number of magnets, or 0 if pulses kept
+  // rewriting them (or the pulse task was preempted mid-update) for
+  // GAPS_RETRIES attempts; try again later.
+  uint8_t gaps(float out[MAX_PULSES_PER_REV]) const;
+
+private:
+  uint8_t _n = 1;
+  uint32_t _pulses = 0;  // Pulses seen since reset, lost ones included
+  uint32_t _learnFrom = 0;  // First pulse of the history without a hole
+  static const uint8_t HIST_SIZE = MAX_PULSES_PER_REV + 2;  // Two revs' worth of one magnet
+  uint64_t _hist[HIST_SIZE] = {0};
+  float _gap[MAX_PULSES_PER_REV] = {1.0f};
+  std::atomic<uint32_t> _version{0};  // Odd while the gaps are rewritten
+  static const uint8_t GAPS_RETRIES = 100;
+
+  uint64_t at(uint32_t seq) const { return _hist[seq % HIST_SIZE]; }
+};
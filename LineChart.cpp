@@ -39,7 +39,7 @@ void LineChart::clear() {
     _needsRecalc = true;
 }
 
-void LineChart::addPoint(uint32_t timeMs, float value) {
+void LineChart::addPoint(uint64_t timeMs, float value) {
     // Add to circular buffer
     _points[_headIndex].timeMs = timeMs;
     _points[_headIndex].value = value;
@@ -52,10 +52,10 @@ void LineChart::addPoint(uint32_t timeMs, float value) {
     _needsRecalc = true;
 }
 
-void LineChart::pruneOldPoints(uint32_t currentTime) {
+void LineChart::pruneOldPoints(uint64_t currentTime) {
     if (_pointCount == 0) return;
 
-    uint32_t cutoffTime = (currentTime > _timeWindowMs) ? (currentTime - _timeWindowMs) : 0;
+    uint64_t cutoffTime = (currentTime > _timeWindowMs) ? (currentTime - _timeWindowMs) : 0;
 
     // Find oldest point still in window
     int validCount = 0;
@@ -79,16 +79,8 @@ void LineChart::recalculateMinMax() {
         return;
     }
 
-    uint32_t now = 0;
-    // Find the latest time
-    for (int i = 0; i < _pointCount; i++) {
-        int idx = (_headIndex - _pointCount + i + MAX_POINTS) % MAX_POINTS;
-        if (_points[idx].timeMs > now) {
-            now = _points[idx].timeMs;
-        }
-    }
-
-    uint32_t cutoffTime = (now > _timeWindowMs) ? (now - _timeWindowMs) : 0;
+    uint64_t now = latestTime();
+    uint64_t cutoffTime = (now > _timeWindowMs) ? (now - _timeWindowMs) : 0;
 
     float minVal = 999999;
     float maxVal = 0;
@@ -116,8 +108,19 @@ void LineChart::recalculateMinMax() {
     _needsRecalc = false;
 }
 
-int LineChart::mapX(uint32_t timeMs, uint32_t now) {
-    uint32_t startTime = (now > _timeWindowMs) ? (now - _timeWindowMs) : 0;
+uint64_t LineChart::latestTime() const {
+    uint64_t now = 0;
+    for (int i = 0; i < _pointCount; i++) {
+        int idx = (_headIndex - _pointCount + i + MAX_POINTS) % MAX_POINTS;
+        if (_points[idx].timeMs > now) {
+            now = _points[idx].timeMs;
+        }
+    }
+    return now;
+}
+
+int LineChart::mapX(uint64_t timeMs, uint64_t now) {
+    uint64_t startTime = (now > _timeWindowMs) ? (now - _timeWindowMs) : 0;
     if (timeMs < startTime) return _x;
 
     float ratio = (float)(timeMs - startTime) / (float)_timeWindowMs;
@@ -158,15 +161,8 @@ void LineChart::draw(Adafruit_GFX* gfx) {
     if (_pointCount < 2) return;
 
     // Find current time (latest point)
-    uint32_t now = 0;
-    for (int i = 0; i < _pointCount; i++) {
-        int idx = (_headIndex - _pointCount + i + MAX_POINTS) % MAX_POINTS;
-        if (_points[idx].timeMs > now) {
-            now = _points[idx].timeMs;
-        }
-    }
-
-    uint32_t cutoffTime = (now > _timeWindowMs) ? (now - _timeWindowMs) : 0;
+    uint64_t now = latestTime();
+    uint64_t cutoffTime = (now > _timeWindowMs) ? (now - _timeWindowMs) : 0;
 
     // Draw line segments
     int prevX = -1, prevY = -1;
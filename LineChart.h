@@ -7,7 +7,7 @@ public:
     static const int MAX_POINTS = 120;  // Max data points to store
 
     struct DataPoint {
-        uint32_t timeMs;
+        uint64_t timeMs;  // Clock::nowMs() or workout-relative ms
         float value;
     };
 
@@ -21,7 +21,7 @@ public:
     void setGridLines(int xLines, int yLines);   // Number of grid lines
 
     // Data
-    void addPoint(uint32_t timeMs, float value);
+    void addPoint(uint64_t timeMs, float value);
     void clear();
 
     // Rendering
@@ -53,7 +53,8 @@ private:
     bool _needsRecalc = true;
 
     void recalculateMinMax();
-    void pruneOldPoints(uint32_t currentTime);
-    int mapX(uint32_t timeMs, uint32_t now);
+    void pruneOldPoints(uint64_t currentTime);
+    uint64_t latestTime() const;
+    int mapX(uint64_t timeMs, uint64_t now);
     int mapY(float value);
 };
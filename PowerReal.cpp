@@ -1,9 +1,9 @@
 #include "PowerReal.h"
+#include "Clock.h"
+#include "SpscRing.h"
+#include "CrankDebouncer.h"
 
 // ------------------ Configuration ------------------
-// Number of samples for single ADC read (noise reduction)
-static const uint8_t ADC_SAMPLES = 8;
-
 // Voltage divider configuration (for raw ADC calculation)
 static const float R1_KOHM = 4.7f;   // Top resistor (to Vin)
 static const float R2_KOHM = 10.0f;  // Bottom resistor (to GND)
@@ -11,99 +11,69 @@ static const float DIVIDER_RATIO = (R1_KOHM + R2_KOHM) / R2_KOHM;  // 1.47
 static const float ADC_VREF_MV = 3300.0f;  // ESP32 reference voltage
 static const float ADC_MAX_RAW = 4095.0f;  // 12-bit ADC
 
-// Cadence tuning
-static const uint32_t EDGE_DEBOUNCE_MS   = 12;
-static const uint32_t MIN_REV_PERIOD_MS  = 200;
-static const uint32_t WINDOW_SHORT_MS    = 3000;   // 3s window (responsive)
-static const uint32_t WINDOW_LONG_MS     = 10000;  // 10s window (smooth)
-static const uint32_t TIMEOUT_MS         = 5000;
+// Per-revolution samples: never closer than this (caps BLE load at high
+// cadence), and a timer sample when no rev arrives so zero cadence and
+// slow pedalling still update
+static const uint32_t MIN_REV_SAMPLE_MS  = 250;
+static const uint32_t REV_FALLBACK_MS    = 1000;
 
 // ------------------ ISR & Globals ------------------
 // We use static/global variables for the ISR because attaching a class member is complex
 static volatile uint8_t  g_pin_cadence = 0;
 
-static const uint8_t TS_BUF_SIZE = 64;  // Enough for 10s at high cadence
-static volatile uint32_t ts_buf[TS_BUF_SIZE];
-static volatile uint8_t  ts_head = 0;
-static volatile uint8_t  ts_count = 0;
+// Pulse timestamps (us, Clock) flow ISR -> update() through a wait-free SPSC
+// ring. Its sequence counter doubles as the cumulative pulse count; every
+// pulses_per_rev-th pulse completes a revolution.
+static SpscRing<uint64_t, REV_RING_SIZE> rev_ring;
 
-static volatile uint32_t last_falling_ms = 0;  // Debounce for falling edges (switch closing)
-static volatile uint32_t last_rising_ms = 0;   // Debounce for rising edges (switch opening)
-static volatile uint32_t last_rev_ms = 0;
-static volatile bool armed_for_count = true;
-static volatile uint32_t total_revs = 0; // Cumulative revolutions
+// ISR-private debounce state (timing is captured in microseconds)
+static CrankDebouncer debouncer;
 static volatile uint32_t isr_calls = 0;  // Debug: count ISR calls
 
-static inline void push_timestamp(uint32_t t_ms) {
-  ts_buf[ts_head] = t_ms;
-  ts_head = (ts_head + 1) % TS_BUF_SIZE;
-  if (ts_count < TS_BUF_SIZE) ts_count++;
-}
+// Task woken on each counted revolution (per-revolution trigger only)
+static volatile TaskHandle_t g_rev_waiter = nullptr;
 
-// ISR - debounce rising and falling edges independently to prevent missed readings
+// ISR - every transition goes through the debouncer; counted revs go to the ring
 void IRAM_ATTR cadenceISR() {
   isr_calls++;  // Debug: count every ISR call
-  uint32_t now = millis();
+  // 64-bit microsecond timer: no wrap in practice and no 1ms quantization
+  uint64_t now = Clock::nowUs();
   bool isClosed = (digitalRead(g_pin_cadence) == LOW);
 
-  if (isClosed) {
-    // Falling edge (switch closing) - debounce independently
-    if ((now - last_falling_ms) < EDGE_DEBOUNCE_MS) return;
-    last_falling_ms = now;
-
-    if (!armed_for_count) return;
-    armed_for_count = false;
-
-    if (last_rev_ms != 0 && (now - last_rev_ms) < MIN_REV_PERIOD_MS) return;
-
-    last_rev_ms = now;
-    total_revs++;
-    push_timestamp(now);
-  } else {
-    // Rising edge (switch opening) - debounce independently
-    if ((now - last_rising_ms) < EDGE_DEBOUNCE_MS) return;
-    last_rising_ms = now;
+  if (!debouncer.onEdge(now, isClosed)) return;
+  rev_ring.push(debouncer.lastRevUs());
 
-    armed_for_count = true;
+  // Wake the sample producer so the revolution goes out right away
+  TaskHandle_t waiter = g_rev_waiter;
+  if (waiter) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(waiter, &woken);
+    if (woken) portYIELD_FROM_ISR();
   }
 }
 
 // ------------------ Class Implementation ------------------
 
-PowerReal::PowerReal(float cc, uint8_t pinCadence, uint8_t pinAdc, ICalibration* calibration)
-  : cycle_constant(cc), pin_cadence(pinCadence), pin_adc(pinAdc), cal(calibration) {
+PowerReal::PowerReal(float cc, uint8_t pinCadence, AdcService* adcService, ICalibration* calibration)
+  : cycle_constant(cc), pin_cadence(pinCadence), adc(adcService), cal(calibration), revs(&rev_ring),
+    edge_filter(&debouncer) {
     g_pin_cadence = pinCadence;
 }
 
+PowerReal::PowerReal(float cc, AdcService* adcService, ICalibration* calibration, RevRing* revSource,
+                     CrankDebouncer* edgeFilter)
+  : cycle_constant(cc), pin_cadence(0xFF), adc(adcService), cal(calibration), revs(revSource),
+    edge_filter(edgeFilter) {}
+
 void PowerReal::begin() {
   pinMode(pin_cadence, INPUT_PULLUP);
   attachInterrupt(digitalPinToInterrupt(pin_cadence), cadenceISR, CHANGE);
-  Serial.printf("Cadence pin %d initialized\n", pin_cadence);
-
-  // Configure ADC for potentiometer reading
-  analogSetPinAttenuation(pin_adc, ADC_11db);  // Full range ~0-2.6V
-  Serial.printf("ADC pin %d configured with 11dB attenuation\n", pin_adc);
+  Serial.printf("Cadence pin %d initialized (%u pulses/rev)\n", pin_cadence, pulses_per_rev);
 
-  // Pre-fill ADC buffer to avoid startup delay
-  for (uint8_t i = 0; i < ADC_BUF_SIZE; i++) {
-    adcBuffer[i] = readAdcRaw();
+  // ADC is sampled and smoothed in the background by AdcService
+  if (!adc->waitForReading(500)) {
+    Serial.println("ADC service not producing readings");
   }
-  adcBufferCount = ADC_BUF_SIZE;
-  Serial.println("ADC buffer pre-filled");
-}
-
-float PowerReal::readAdcRaw() {
-  // Quick multi-sample read for noise reduction, returns calibrated millivolts
-  // Discard first 2 readings to avoid spikes from ADC settling
-  analogReadMilliVolts(pin_adc);
-  analogReadMilliVolts(pin_adc);
-
-  float sum = 0.0f;
-  for (uint8_t i = 0; i < ADC_SAMPLES; i++) {
-    sum += (float)analogReadMilliVolts(pin_adc);
-  }
-  yield();  // Let other tasks run
-  return sum / (float)ADC_SAMPLES;
 }
 
 /* static */ float PowerReal::millivoltsToRawAdc(float mv) {
@@ -120,146 +90,89 @@ float PowerReal::readAdcRaw() {
   return vin_mv / DIVIDER_RATIO;
 }
 
-void PowerReal::sampleAdc(uint32_t now_ms) {
-  // Sample at 3Hz (every 333ms)
-  if (now_ms - last_adc_sample_ms < ADC_SAMPLE_INTERVAL_MS) return;
-  last_adc_sample_ms = now_ms;
-
-  // Read ADC and add to ring buffer
-  float value = readAdcRaw();
-  adcBuffer[adcBufferHead] = value;
-  adcBufferHead = (adcBufferHead + 1) % ADC_BUF_SIZE;
-  if (adcBufferCount < ADC_BUF_SIZE) adcBufferCount++;
-}
-
-float PowerReal::getSmoothedAdc(uint32_t now_ms) {
-  (void)now_ms;  // Not needed anymore
-  if (adcBufferCount == 0) return 0.0f;
-
-  // Simple average of buffer (3 samples = 1 second)
-  float sum = 0.0f;
-  for (uint8_t i = 0; i < adcBufferCount; i++) {
-    sum += adcBuffer[i];
-  }
-  return sum / (float)adcBufferCount;
-}
-
-float PowerReal::readKp(float& rawAdc, uint32_t now_ms) {
-  rawAdc = getSmoothedAdc(now_ms);
+float PowerReal::readKp(float& rawAdc) {
+  // Step-aware mean published by the shared ADC service: 1 s of smoothing
+  // once the pendulum is settled, immediate after it moves
+  rawAdc = adc->read().adaptive;
   return cal->adcToKp(rawAdc);
 }
 
-struct Snapshot {
-  uint32_t ts[TS_BUF_SIZE];
-  uint8_t count;
-  uint32_t last_rev;
-  uint32_t total_revs;
-};
+void PowerReal::drainRevs() {
+  // Pull only the edges produced since the last call - no interrupt masking
+  uint64_t fresh[REV_RING_SIZE];
+  uint32_t lostBefore = revs_lost;
+  uint32_t n = revs->read(rev_cursor, fresh, REV_RING_SIZE, &revs_lost);
+  uint32_t seq = rev_cursor - n;  // Ring sequence of fresh[0]
 
-static Snapshot snapshotState() {
-  Snapshot s{};
-  noInterrupts();
-  s.count = ts_count;
-  uint8_t head = ts_head;
-  for (uint8_t i = 0; i < ts_count; i++) {
-    uint8_t idx = (head + TS_BUF_SIZE - ts_count + i) % TS_BUF_SIZE;
-    s.ts[i] = ts_buf[idx];
-  }
-  s.last_rev = last_rev_ms;
-  s.total_revs = total_revs;
-  interrupts();
-  return s;
-}
+  // Pulses the ring overwrote still moved the crank: keep the magnet
+  // slots in step with the ring sequence
+  crank_pulses.skip(revs_lost - lostBefore);
 
-float PowerReal::calculateRpmWindow(uint32_t windowMs) {
-  Snapshot s = snapshotState();
-  uint32_t now = millis();
+  // Both filters track every pulse so switching between them is seamless
+  for (uint32_t i = 0; i < n; i++, seq++) {
+    float step = crank_pulses.onPulse(fresh[i]);
+    blend_filter.onRev(fresh[i], step);
+    alpha_beta_filter.onRev(fresh[i], step);
 
-  // Timeout check - no revs for a while means stopped
-  if (s.last_rev && (now - s.last_rev) > TIMEOUT_MS) {
-    return 0.0f;
+    // Same magnet one rev later: a whole revolution, whatever the gaps
+    if ((seq + 1) % pulses_per_rev == 0) last_rev_us = fresh[i];
   }
-
-  if (s.count < 2) return 0.0f;
-
-  uint32_t newest = s.ts[s.count - 1];
-  uint8_t first = 0;
-  while (first < s.count && (newest - s.ts[first]) > windowMs) first++;
-
-  uint8_t n = s.count - first;
-  if (n < 2) return 0.0f;
-
-  uint32_t dt = newest - s.ts[first];
-  if (dt == 0) return 0.0f;
-
-  return (float)(n - 1) * 60000.0f / (float)dt;
 }
 
-float PowerReal::calculateSmoothedRpm() {
-  // Get raw RPM from both windows
-  float rpm3s = calculateRpmWindow(WINDOW_SHORT_MS);
-  float rpm10s = calculateRpmWindow(WINDOW_LONG_MS);
-
-  // Handle timeout/stopped case
-  Snapshot s = snapshotState();
-  uint32_t now = millis();
-  uint32_t timeSinceLastRev = s.last_rev ? (now - s.last_rev) : TIMEOUT_MS;
+bool PowerReal::setPulsesPerRev(uint8_t n) {
+  if (n < 1 || n > CrankPulses::MAX_PULSES_PER_REV) return false;
+  pulses_per_rev = n;
+  crank_pulses.setPulsesPerRev(n);
+  if (edge_filter) edge_filter->setPulsesPerRev(n);
+  return true;
+}
 
-  // If completely stopped (timeout), decay smoothly to zero
-  if (timeSinceLastRev >= TIMEOUT_MS) {
-    // Exponential decay towards zero
-    lastSmoothedRpm *= 0.7f;  // Decay factor per update (at 1Hz)
-    if (lastSmoothedRpm < 1.0f) lastSmoothedRpm = 0.0f;
-    return lastSmoothedRpm;
-  }
+bool PowerReal::setCadenceFilter(CadenceFilterType type) {
+  filter_type = type;
+  filter = (type == CadenceFilterType::AlphaBeta) ? (ICadenceFilter*)&alpha_beta_filter
+                                                  : (ICadenceFilter*)&blend_filter;
+  return true;
+}
 
-  // If slowing down (no recent revs but not timed out), use longer window
-  // This creates smooth roll-down effect
-  if (timeSinceLastRev > 2000) {
-    // Blend towards 10s reading as we slow down
-    float blendFactor = (float)(timeSinceLastRev - 2000) / 3000.0f;  // 0 to 1 over 3s
-    if (blendFactor > 1.0f) blendFactor = 1.0f;
-    float blendedRpm = rpm3s * (1.0f - blendFactor) + rpm10s * blendFactor;
+bool PowerReal::setSampleTrigger(SampleTrigger trigger) {
+  sample_trigger = trigger;
+  // The ISR notifies the task running update(); until one is bound, the caller
+  TaskHandle_t task = wake_task ? wake_task : xTaskGetCurrentTaskHandle();
+  g_rev_waiter = (trigger == SampleTrigger::Revolution) ? task : nullptr;
+  return true;
+}
 
-    // Also apply decay if current reading is lower than last
-    if (blendedRpm < lastSmoothedRpm) {
-      // Smooth decay: move 30% towards new value
-      lastSmoothedRpm = lastSmoothedRpm * 0.7f + blendedRpm * 0.3f;
-    } else {
-      lastSmoothedRpm = blendedRpm;
-    }
-    return lastSmoothedRpm;
+void PowerReal::bindToCurrentTask() {
+  wake_task = xTaskGetCurrentTaskHandle();
+  if (sample_trigger == SampleTrigger::Revolution) {
+    g_rev_waiter = wake_task;
   }
+}
 
-  // Normal operation: quick to rise, slow to fall
-  float instantRpm = rpm3s;  // Use responsive 3s window as base
+bool PowerReal::getEdgeStats(CrankEdgeStats& out) const {
+  if (!edge_filter) return false;
+  out = edge_filter->getStats();
+  return true;
+}
 
-  if (instantRpm >= lastSmoothedRpm) {
-    // Increasing or stable: respond quickly
-    // Use 3s window directly, but smooth slightly to avoid jitter
-    lastSmoothedRpm = lastSmoothedRpm * 0.3f + instantRpm * 0.7f;
+void PowerReal::update(uint64_t now_ms) {
+  uint64_t since_ms = now_ms - last_update_ms;
+  if (sample_trigger == SampleTrigger::Revolution) {
+    // One sample per new whole revolution, rate limited, with a timer fallback
+    bool new_rev = revs->head() / pulses_per_rev != rev_cursor / pulses_per_rev;
+    if (!(new_rev && since_ms >= MIN_REV_SAMPLE_MS) && since_ms < REV_FALLBACK_MS) return;
   } else {
-    // Decreasing: use weighted blend favoring longer window
-    // This creates the smooth roll-down effect
-    float targetRpm = rpm3s * 0.3f + rpm10s * 0.7f;
-    // Move 40% towards target (slower response when decreasing)
-    lastSmoothedRpm = lastSmoothedRpm * 0.6f + targetRpm * 0.4f;
+    // Produce power samples at the configured output rate
+    if (since_ms < output_period_ms) return;
   }
-
-  return lastSmoothedRpm;
-}
-
-void PowerReal::update(uint32_t now_ms) {
-  // Continuously sample ADC for 3-second smoothing
-  sampleAdc(now_ms);
-
-  // Produce power sample at 1Hz for BLE
-  if (now_ms - last_update_ms < 1000) return;
+  // Elapsed time drives smoothing; the first sample assumes one period
+  float dt_s = last_update_ms ? (now_ms - last_update_ms) / 1000.0f : output_period_ms / 1000.0f;
   last_update_ms = now_ms;
 
-  float rpm = calculateSmoothedRpm();
+  drainRevs();
+  float rpm = filter->rpm(Clock::nowUs(), dt_s);
   float rawAdc = 0.0f;
-  float kp = readKp(rawAdc, now_ms);
+  float kp = readKp(rawAdc);
   float power_brake = kp * rpm;
   float power = power_brake * cycle_constant;
 
@@ -268,25 +181,15 @@ void PowerReal::update(uint32_t now_ms) {
   sample.kp = kp;
   sample.power_w = power;
   sample.adc_raw = rawAdc;
+  sample.timestamp_us = Clock::nowUs();
   
-  // Get latest rev counts for BLE
-  Snapshot s = snapshotState();
-  sample.crank_revs = (uint16_t)s.total_revs;
-  
-  // Convert last event time to 1/1024s units
-  // We need to handle the wrap-around of millis() if running for 49 days, 
-  // but for simple casting it might be okay. 
-  // BLE expects a free running timer.
-  sample.crank_evt_1024 = (uint16_t)((s.last_rev * 1024) / 1000);
+  // Get latest rev counts for BLE: the ring cursor is the number of pulses
+  // consumed so far (including any the ring had to drop), in whole revs
+  sample.crank_revs = (uint16_t)(rev_cursor / pulses_per_rev);
 
-  ready = true;
-}
-
-bool PowerReal::hasSample() const {
-  return ready;
-}
+  // Convert last event time (us) to 1/1024s units in 64-bit, then let it
+  // roll over at 16 bits - BLE expects a free running timer.
+  sample.crank_evt_1024 = Clock::toBle1024(last_rev_us);
 
-PowerSample PowerReal::getSample() {
-  ready = false;
-  return sample;
+  emit(sample);
 }
@@ -1,51 +1,66 @@
 #pragma once
 #include "PowerSource.h"
 #include "Calibration.h"
+#include "CadenceFilter.h"
+#include "CrankDebouncer.h"
+#include "CrankPulses.h"
+#include "AdcService.h"
+#include "SpscRing.h"
 #include <Arduino.h>
 
-// ADC sampling: 3Hz, report 1-second average (3 samples)
-static const uint8_t ADC_BUF_SIZE = 10;
-static const uint32_t ADC_SAMPLE_INTERVAL_MS = 100;  // 10Hz sampling
+// Cadence: ISR -> consumer ring of magnet pulses (enough for 1s at 250rpm
+// with the most magnets; drained at least once per second)
+static const uint32_t REV_RING_SIZE = 64;
+typedef SpscRing<uint64_t, REV_RING_SIZE> RevRing;
 
 class PowerReal : public PowerSource {
 public:
-  PowerReal(float cycleConstant, uint8_t pinCadence, uint8_t pinAdc, ICalibration* calibration);
+  PowerReal(float cycleConstant, uint8_t pinCadence, AdcService* adc, ICalibration* calibration);
 
   void begin() override;
-  void update(uint32_t now_ms) override;
-  bool hasSample() const override;
-  PowerSample getSample() override;
+  void update(uint64_t now_ms) override;
+  bool setSampleTrigger(SampleTrigger trigger) override;
+  bool setCadenceFilter(CadenceFilterType type) override;
+  void bindToCurrentTask() override;
+  bool setPulsesPerRev(uint8_t n) override;
+  bool getEdgeStats(CrankEdgeStats& out) const override;
+  uint8_t getMagnetGaps(float* out) const override { return crank_pulses.gaps(out); }
 
   // Voltage divider conversion utilities (4.7k + 10k divider)
   static float millivoltsToRawAdc(float mv);   // mV at ADC pin -> raw ADC (0-4095)
   static float rawAdcToMillivolts(float raw);  // raw ADC (0-4095) -> mV at ADC pin
 
+protected:
+  // Same pipeline fed from another rev source instead of the cadence ISR
+  // (e.g. a recorded session). Nothing is attached to a pin. 'edgeFilter'
+  // is the source's own debouncer, if it has one, for getEdgeStats().
+  PowerReal(float cycleConstant, AdcService* adc, ICalibration* calibration, RevRing* revSource,
+            CrankDebouncer* edgeFilter = nullptr);
+
 private:
   float cycle_constant;
   uint8_t pin_cadence;
-  uint8_t pin_adc;
+  AdcService* adc;
   ICalibration* cal;
+  RevRing* revs;  // Pulse timestamps (us): the ISR ring or a replay source
+  CrankDebouncer* edge_filter;  // Debouncer feeding 'revs' (null for replays)
 
-  uint32_t last_update_ms = 0;
-  uint32_t last_adc_sample_ms = 0;
-  bool ready = false;
+  uint64_t last_update_ms = 0;
+  TaskHandle_t wake_task = nullptr;  // Woken by the ISR in per-revolution mode
   PowerSample sample{};
 
-  // ADC ring buffer (3 samples for 1-second average)
-  float adcBuffer[ADC_BUF_SIZE] = {0};
-  uint8_t adcBufferHead = 0;
-  uint8_t adcBufferCount = 0;
-
-  // Cadence smoothing state
-  float lastSmoothedRpm = 0.0f;
+  // Cadence filters, fed from 'revs' by drainRevs(), one update per pulse
+  CrankPulses crank_pulses;  // Pulse -> crank angle (learned magnet gaps)
+  BlendCadenceFilter blend_filter;
+  AlphaBetaCadenceFilter alpha_beta_filter;
+  ICadenceFilter* filter = &blend_filter;
+  uint64_t last_rev_us = 0;  // Newest whole rev consumed (for the BLE event time)
+  uint32_t rev_cursor = 0;  // Next ring sequence to read = pulses consumed
+  uint32_t revs_lost = 0;   // Pulses overwritten in the ring before being read
 
   // ADC / KP helpers
-  void sampleAdc(uint32_t now_ms);
-  float readAdcRaw();
-  float getSmoothedAdc(uint32_t now_ms);
-  float readKp(float& rawAdc, uint32_t now_ms);
+  float readKp(float& rawAdc);
 
   // RPM helpers
-  float calculateRpmWindow(uint32_t windowMs);  // Calculate RPM for specific window
-  float calculateSmoothedRpm();                  // Smart smoothing combining windows
+  void drainRevs();  // Consume new edges from 'revs'
 };
@@ -0,0 +1,96 @@
+#include "PowerReplay.h"
+#include "Clock.h"
+#include <stdlib.h>
+#include <string.h>
+
+PowerReplay::PowerReplay(const char* path, float cc, ICalibration* calibration, uint32_t adcOutputRateHz)
+  : PowerReal(cc, &_adc, calibration, &_revs, &_debouncer),
+    _path(path),
+    _adc(0xFF, adcOutputRateHz, adcOutputRateHz) {}  // Never begun: readings are injected
+
+PowerReplay::~PowerReplay() {
+  if (_file) fclose(_file);
+}
+
+void PowerReplay::begin() {
+  _file = fopen(_path, "r");
+  if (!_file) {
+    Serial.printf("Replay: cannot open %s\n", _path);
+    _eof = true;
+    return;
+  }
+
+  // Start the virtual clock at the first recorded event
+  _hasPending = readEvent(_pending);
+  uint64_t start = _hasPending ? _pending.t_us : 0;
+  Clock::useVirtual(start);
+  Serial.printf("Replay: %s from t=%llu us\n", _path, (unsigned long long)start);
+}
+
+bool PowerReplay::readEvent(Event& ev) {
+  char line[64];
+  while (!_eof) {
+    if (!fgets(line, sizeof(line), _file)) {
+      _eof = true;
+      break;
+    }
+    if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+
+    char* p = nullptr;
+    ev.t_us = strtoull(line, &p, 10);
+    if (p == line || *p != ',') {
+      _stats.badLines++;
+      continue;
+    }
+    p++;
+    if (*p == 'E' && p[1] == ',' && (p[2] == '0' || p[2] == '1')) {
+      ev.type = EVENT_EDGE;
+      ev.closed = (p[2] == '0');  // Reed switch pulls the pin LOW
+      return true;
+    }
+    if (*p == 'R') {
+      ev.type = EVENT_REV;
+      return true;
+    }
+    if (*p == 'A' && p[1] == ',') {
+      ev.type = EVENT_ADC;
+      ev.mv = strtof(p + 2, nullptr);
+      return true;
+    }
+    _stats.badLines++;
+  }
+  return false;
+}
+
+void PowerReplay::feedUntil(uint64_t t_us) {
+  while (_hasPending && _pending.t_us <= t_us) {
+    if (_pending.type == EVENT_EDGE) {
+      // Same path as cadenceISR()
+      _stats.edges++;
+      if (_debouncer.onEdge(_pending.t_us, _pending.closed)) {
+        _revs.push(_debouncer.lastRevUs());
+        _stats.revs++;
+      }
+    } else if (_pending.type == EVENT_REV) {
+      _revs.push(_pending.t_us);
+      _stats.revs++;
+    } else {
+      AdcReading r{_pending.t_us, _pending.mv};
+      _adc.inject(r);
+      _stats.adcReadings++;
+    }
+    _hasPending = readEvent(_pending);
+  }
+}
+
+void PowerReplay::update(uint64_t now_ms) {
+  feedUntil(Clock::nowUs());
+  PowerReal::update(now_ms);
+}
+
+bool PowerReplay::step(uint64_t dtUs) {
+  if (finished()) return false;
+  Clock::advanceVirtual(dtUs);
+  update(Clock::nowMs());
+  return true;
+}
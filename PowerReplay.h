@@ -0,0 +1,67 @@
+#pragma once
+#include <stdio.h>
+#include "PowerReal.h"
+
+// Replays a recorded session through the exact PowerReal pipeline (cadence
+// filters, ADC running means, calibration) against a virtual clock, so a
+// field complaint can be reproduced and an hour-long ride runs in seconds
+// on a host.
+//
+// Session file (CSV, one event per line, time ordered, '#' comments):
+//   <t_us>,E,<level>    raw cadence pin transition (0 = switch closed, as
+//                       read by the ISR); goes through CrankDebouncer
+//   <t_us>,R            already counted crank revolution (skips the debouncer)
+//   <t_us>,A,<mv>       decimated force ADC reading (mV at the ADC pin)
+// Record raw edges where possible, so debouncer changes can be replayed.
+class PowerReplay : public PowerReal {
+public:
+  struct Stats {
+    uint32_t edges;
+    uint32_t revs;  // Counted: R lines plus edges the debouncer accepted
+    uint32_t adcReadings;
+    uint32_t badLines;
+  };
+
+  PowerReplay(const char* path, float cycleConstant, ICalibration* calibration,
+              uint32_t adcOutputRateHz = 100);
+  ~PowerReplay();
+
+  // Opens the file and switches Clock to its virtual time base, starting
+  // at the first event. No pins are touched.
+  void begin() override;
+
+  // Feeds every recorded event up to Clock::nowUs(), then runs PowerReal
+  void update(uint64_t now_ms) override;
+
+  // Advance the virtual clock by dtUs and update. Returns false once the
+  // session is exhausted. Typical host loop:
+  //   while (replay.step(5000)) { n = replay.drainSamples(buf, max); ... }
+  bool step(uint64_t dtUs);
+
+  bool isOpen() const { return _file != nullptr; }
+  bool finished() const { return _eof && !_hasPending; }
+  const Stats& getStats() const { return _stats; }
+
+private:
+  enum EventType : uint8_t { EVENT_EDGE, EVENT_REV, EVENT_ADC };
+
+  struct Event {
+    uint64_t t_us;
+    EventType type;
+    bool closed;
+    float mv;
+  };
+
+  const char* _path;
+  FILE* _file = nullptr;
+  AdcService _adc;
+  RevRing _revs;
+  CrankDebouncer _debouncer;
+  Event _pending{};
+  bool _hasPending = false;
+  bool _eof = false;
+  Stats _stats{};
+
+  bool readEvent(Event& ev);
+  void feedUntil(uint64_t t_us);
+};
@@ -8,4 +8,7 @@ struct PowerSample {
   uint16_t crank_revs;
   uint16_t crank_evt_1024;
   float adc_raw;      // Raw ADC value (smoothed) for calibration
+  uint64_t timestamp_us;  // Clock::nowUs() when the sample was produced
+  uint32_t source_seq;    // Position in the source's output, set by PowerSource::emit()
+  uint32_t bus_seq;       // Position on the bus, set by SampleBus::publish()
 };
@@ -1,50 +1,244 @@
 #include "PowerSimulator.h"
+#include "Clock.h"
 #include <Arduino.h>
+#include <math.h>
+#include <string.h>
 
-PowerSimulator::PowerSimulator(float cc)
-: cycle_constant(cc) {}
+// Physics (SI units at the crank)
+static const uint64_t SIM_STEP_US     = 1000;     // Integration step
+static const uint64_t SIM_MAX_LAG_US  = 1000000;  // Skip ahead if further behind
+static const uint64_t ADC_PERIOD_US   = 10000;    // Force readings at 100Hz
+static const float CRANK_INERTIA      = 12.0f;    // kg m^2, flywheel seen at the crank
+static const float FRICTION_NM        = 0.3f;
+static const float RIDER_GAIN         = 3.0f;     // 1/s, how hard the rider chases the target
+static const float RIDER_MAX_NM       = 200.0f;
+static const float STROKE_RIPPLE      = 0.6f;     // Torque ripple, two strokes per rev
+static const float PENDULUM_TAU_S     = 0.5f;     // Pendulum settling time constant
+static const float ADC_NOISE_MV       = 1.5f;
+static const float TWO_PI             = 6.2831853f;
+
+// Reed switch: closed while a magnet is within this part of a rev (at most
+// half the spacing between magnets)
+static const float SWITCH_CLOSED_REVS = 0.15f;
+static const float MAGNET_ERROR_REVS  = 3.0f / 360.0f;  // Placement error, +/-
+static const uint8_t BOUNCE_MAX       = 3;        // Extra open/close pairs when closing
+static const float BOUNCE_MIN_US      = 100.0f;
+static const float BOUNCE_MAX_US      = 1500.0f;
+
+PowerSimulator::PowerSimulator(float cc, MonarkCalibration* calibration, SimProfile profile, uint32_t seed)
+  : PowerReal(cc, &_adc, calibration, &_revs, &_debouncer),
+    _cycleConstant(cc), _calibration(calibration), _profile(profile), _rng(seed ? seed : 1),
+    _adc(0xFF, 100, 100) {}  // Never begun: readings are injected
+
+/* static */ const char* PowerSimulator::profileName(SimProfile profile) {
+  switch (profile) {
+    case SimProfile::Intervals: return "intervals";
+    case SimProfile::Sprints:   return "sprints";
+    case SimProfile::CoastDown: return "coastdown";
+    default:                    return "steady";
+  }
+}
+
+/* static */ SimProfile PowerSimulator::profileFromName(const char* name, SimProfile fallback) {
+  if (!name) return fallback;
+  for (uint8_t i = 0; i <= (uint8_t)SimProfile::CoastDown; i++) {
+    if (strcmp(name, profileName((SimProfile)i)) == 0) return (SimProfile)i;
+  }
+  return fallback;
+}
+
+bool PowerSimulator::setPulsesPerRev(uint8_t n) {
+  if (!PowerReal::setPulsesPerRev(n)) return false;
+  // Evenly spaced, each but the first glued a little off (deterministic)
+  for (uint8_t k = 0; k < n; k++) {
+    float err = k ? uniform(-MAGNET_ERROR_REVS, MAGNET_ERROR_REVS) : 0.0f;
+    _magnets[k] = (float)k / n + err;
+  }
+  _closedRevs = SWITCH_CLOSED_REVS < 0.5f / n ? SWITCH_CLOSED_REVS : 0.5f / n;
+  return true;
+}
 
 void PowerSimulator::begin() {
-  randomSeed((uint32_t)esp_random());
+  _startUs = Clock::nowUs();
+  _simUs = _startUs;
+  _nextAdcUs = _startUs;
+  Serial.printf("Simulator: %s profile\n", profileName(_profile));
+}
+
+uint32_t PowerSimulator::nextRandom() {
+  // xorshift32: deterministic for a given seed
+  _rng ^= _rng << 13;
+  _rng ^= _rng >> 17;
+  _rng ^= _rng << 5;
+  return _rng;
 }
 
-void PowerSimulator::update(uint32_t now_ms) {
-  if (now_ms - last_ms < 1000) return;
-  last_ms = now_ms;
+void PowerSimulator::target(float s, float& rpm, float& kp, bool& pedalling) const {
+  pedalling = true;
+  switch (_profile) {
+    case SimProfile::Intervals: {
+      bool hard = fmodf(s, 360.0f) < 240.0f;
+      rpm = hard ? 95.0f : 80.0f;
+      kp = hard ? 3.0f : 1.5f;
+      break;
+    }
+    case SimProfile::Sprints: {
+      bool sprint = fmodf(s, 60.0f) < 10.0f;
+      rpm = sprint ? 130.0f : 85.0f;
+      kp = sprint ? 4.0f : 2.0f;
+      break;
+    }
+    case SimProfile::CoastDown:
+      pedalling = fmodf(s, 60.0f) < 30.0f;
+      rpm = 90.0f;
+      kp = 2.0f;
+      break;
+    default:
+      rpm = 90.0f;
+      kp = 2.0f;
+      break;
+  }
+}
 
-  int rpm = random(85, 96);
-  int pwr = random(150, 201);
+void PowerSimulator::pushEdge(uint64_t t_us, bool closed) {
+  if (_edgeCount >= EDGE_QUEUE_SIZE) return;  // Bounce storm: drop the tail
+  _edges[(uint8_t)(_edgeHead + _edgeCount) % EDGE_QUEUE_SIZE] = Edge{t_us, closed};
+  _edgeCount++;
+}
 
-  float kp = (float)pwr / ((float)rpm * cycle_constant);
+void PowerSimulator::emitSwitch(uint64_t t_us, bool closed) {
+  // The real transition, then (contacts making) a few short bounces
+  pushEdge(t_us, closed);
+  if (!closed) return;  // Reed contacts break cleanly
+  uint8_t bounces = nextRandom() % (BOUNCE_MAX + 1);
+  uint64_t t = t_us;
+  for (uint8_t i = 0; i < bounces; i++) {
+    t += (uint64_t)uniform(BOUNCE_MIN_US, BOUNCE_MAX_US);
+    pushEdge(t, !closed);
+    t += (uint64_t)uniform(BOUNCE_MIN_US, BOUNCE_MAX_US);
+    pushEdge(t, closed);
+  }
+}
 
-  // crank revolutions
-  float revs = rpm / 60.0f;
-  rev_accum += revs;
-  uint16_t add = (uint16_t)rev_accum;
-  if (add > 0) {
-    rev_accum -= add;
-    sample.crank_revs += add;
-    
-    // Calculate ticks for these revolutions (1/1024 sec resolution)
-    // Time for 'add' revolutions = (add * 60 / rpm) seconds
-    // Ticks = Time * 1024
-    float ticks = (add * 60.0f / rpm) * 1024.0f;
-    sample.crank_evt_1024 += (uint16_t)ticks;
+void PowerSimulator::feedEdges(uint64_t t_us) {
+  while (_edgeCount && _edges[_edgeHead].t_us <= t_us) {
+    const Edge& e = _edges[_edgeHead];
+    _stats.edges++;
+    if (_debouncer.onEdge(e.t_us, e.closed)) {
+      _revs.push(_debouncer.lastRevUs());
+      _stats.counted++;
+    }
+    _edgeHead = (uint8_t)(_edgeHead + 1) % EDGE_QUEUE_SIZE;
+    _edgeCount--;
   }
+}
+
+void PowerSimulator::stepPhysics(float dt) {
+  float elapsed = (float)(_simUs - _startUs) * 1e-6f;
+  float targetRpm, targetKp;
+  bool pedalling;
+  target(elapsed, targetRpm, targetKp, pedalling);
 
-  sample.rpm = rpm;
-  sample.kp = kp;
-  sample.power_w = pwr;
-  sample.adc_raw = 0; // No ADC in simulation
+  // Rider drifts a little around the target cadence
+  _wobbleRpm += uniform(-1.0f, 1.0f) * 4.0f * dt - _wobbleRpm * 0.5f * dt;
 
-  ready = true;
+  // Pendulum settles towards the set load
+  _kp += (targetKp - _kp) * (dt / PENDULUM_TAU_S);
+
+  // Brake torque consistent with P = kp * rpm * cycle constant
+  float omegaRad = _omega * TWO_PI;
+  float brake = _kp * _cycleConstant * 60.0f / TWO_PI;
+  if (_omega <= 0.0f) brake = 0.0f;
+
+  float rider = 0.0f;
+  if (pedalling) {
+    float targetRad = (targetRpm + _wobbleRpm) / 60.0f * TWO_PI;
+    rider = brake + FRICTION_NM + CRANK_INERTIA * RIDER_GAIN * (targetRad - omegaRad);
+    rider *= 1.0f + STROKE_RIPPLE * cosf(2.0f * TWO_PI * _theta);
+    if (rider < 0.0f) rider = 0.0f;  // Freewheel: the rider can't brake
+    if (rider > RIDER_MAX_NM) rider = RIDER_MAX_NM;
+  }
+
+  float friction = _omega > 0.0f ? FRICTION_NM : 0.0f;
+  omegaRad += (rider - brake - friction) / CRANK_INERTIA * dt;
+  if (omegaRad < 0.0f) omegaRad = 0.0f;
+  float omega = omegaRad / TWO_PI;
+
+  // Advance the crank; emit switch transitions at their exact crossing time
+  float from = _theta;
+  float to = _theta + omega * dt;
+  if (to > from) emitCrossings(from, to, dt);
+  _theta = to - floorf(to);
+  _omega = omega;
+}
+
+// First angle after 'from' that is 'at' modulo one rev
+static inline float nextCrossing(float from, float at) {
+  return floorf(from - at) + 1.0f + at;
+}
+
+void PowerSimulator::emitCrossings(float from, float to, float dt) {
+  // Every magnet arriving at (closing) or leaving (opening) the reed in
+  // (from, to], in time order. A step covers far less than the magnet
+  // spacing, so each transition happens at most once.
+  struct Crossing {
+    float at;
+    bool closed;
+    bool firstMagnet;
+  };
+  Crossing c[2 * CrankPulses::MAX_PULSES_PER_REV];
+  uint8_t count = 0;
+  uint8_t magnets = getPulsesPerRev();
+  for (uint8_t k = 0; k < magnets; k++) {
+    float closeAt = nextCrossing(from, _magnets[k]);
+    float openAt = nextCrossing(from, _magnets[k] + _closedRevs);
+    if (closeAt <= to) c[count++] = Crossing{closeAt, true, k == 0};
+    if (openAt <= to) c[count++] = Crossing{openAt, false, false};
+  }
+  for (uint8_t i = 1; i < count; i++) {
+    for (uint8_t j = i; j > 0 && c[j].at < c[j - 1].at; j--) {
+      Crossing t = c[j];
+      c[j] = c[j - 1];
+      c[j - 1] = t;
+    }
+  }
+
+  float spanUs = dt * 1e6f;
+  for (uint8_t i = 0; i < count; i++) {
+    emitSwitch(_simUs + (uint64_t)((c[i].at - from) / (to - from) * spanUs), c[i].closed);
+    if (!c[i].closed) continue;
+    _stats.truePulses++;
+    if (c[i].firstMagnet) _stats.trueRevs++;
+  }
+}
+
+void PowerSimulator::integrateTo(uint64_t t_us) {
+  if (t_us <= _simUs) return;
+  if (t_us - _simUs > SIM_MAX_LAG_US) {
+    // Far behind (e.g. a debugger stop): don't spend seconds catching up
+    _simUs = t_us - SIM_MAX_LAG_US;
+  }
+
+  while (_simUs + SIM_STEP_US <= t_us) {
+    stepPhysics(SIM_STEP_US * 1e-6f);
+    _simUs += SIM_STEP_US;
+    feedEdges(_simUs);
+
+    if (_simUs >= _nextAdcUs) {
+      _nextAdcUs += ADC_PERIOD_US;
+      float noise = (uniform(-1.0f, 1.0f) + uniform(-1.0f, 1.0f) + uniform(-1.0f, 1.0f)) * ADC_NOISE_MV;
+      AdcReading r{_simUs, _calibration->kpToAdc(_kp) + noise};
+      _adc.inject(r);
+    }
+  }
 }
 
-bool PowerSimulator::hasSample() const {
-  return ready;
+void PowerSimulator::update(uint64_t now_ms) {
+  integrateTo(Clock::nowUs());
+  PowerReal::update(now_ms);
 }
 
-PowerSample PowerSimulator::getSample() {
-  ready = false;
-  return sample;
+void PowerSimulator::step(uint64_t dtUs) {
+  Clock::advanceVirtual(dtUs);
+  update(Clock::nowMs());
 }
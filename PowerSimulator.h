@@ -1,20 +1,88 @@
 #pragma once
-#include "PowerSource.h"
+#include "PowerReal.h"
+#include "CrankDebouncer.h"
+#include "SimProfile.h"
 
-class PowerSimulator : public PowerSource {
+// Deterministic, seedable physics simulator. Models a flywheel (crank
+// inertia, pendulum brake torque, friction, freewheel) driven by a rider
+// following a profile, and feeds the result through the real PowerReal
+// pipeline: reed switch edges with bounce go through the same debouncer
+// as the ISR, and force readings go through the same ADC averaging via
+// the calibration inverse. With several magnets (setPulsesPerRev) each
+// one after the first is misplaced by up to +/-3 degrees, so the phase
+// learning has something to learn. Sim time is Clock time, so Clock::setScale()
+// runs it faster than real time on the device and Clock::useVirtual()
+// with step() runs it as fast as possible on a host.
+class PowerSimulator : public PowerReal {
 public:
-  explicit PowerSimulator(float cycleConstant = 1.05f);
+  struct Stats {
+    uint32_t trueRevs;    // Revolutions the crank actually made
+    uint32_t truePulses;  // Magnets that passed the reed
+    uint32_t edges;       // Switch transitions emitted (including bounce)
+    uint32_t counted;     // Pulses the debouncer counted
+  };
+
+  PowerSimulator(float cycleConstant, MonarkCalibration* calibration,
+                 SimProfile profile = SimProfile::Steady, uint32_t seed = 1);
 
   void begin() override;
-  void update(uint32_t now_ms) override;
-  bool hasSample() const override;
-  PowerSample getSample() override;
+  bool setPulsesPerRev(uint8_t n) override;
+
+  // Integrates the physics up to Clock::nowUs(), then runs PowerReal
+  void update(uint64_t now_ms) override;
+
+  // Host runs with Clock::useVirtual(): advance by dtUs and update
+  void step(uint64_t dtUs);
+
+  float getTrueRpm() const { return _omega * 60.0f; }
+  float getTrueKp() const { return _kp; }
+  float getMagnetAngle(uint8_t slot) const { return slot < CrankPulses::MAX_PULSES_PER_REV ? _magnets[slot] : 0.0f; }
+  const Stats& getStats() const { return _stats; }
+
+  static const char* profileName(SimProfile profile);
+  static SimProfile profileFromName(const char* name, SimProfile fallback);
 
 private:
-  float cycle_constant;
-  uint32_t last_ms = 0;
-  PowerSample sample{};
-  bool ready = false;
+  struct Edge {
+    uint64_t t_us;
+    bool closed;
+  };
+  static const uint8_t EDGE_QUEUE_SIZE = 16;
+
+  float _cycleConstant;
+  MonarkCalibration* _calibration;
+  SimProfile _profile;
+  uint32_t _rng;
+
+  AdcService _adc;
+  RevRing _revs;
+  CrankDebouncer _debouncer;
+
+  // Physics state
+  uint64_t _startUs = 0;
+  uint64_t _simUs = 0;      // Integrated up to here
+  uint64_t _nextAdcUs = 0;
+  float _omega = 0.0f;      // Crank speed (rev/s)
+  float _theta = 0.0f;      // Crank angle (revs, 0 = magnet at the reed)
+  float _kp = 0.0f;         // Pendulum load
+  float _wobbleRpm = 0.0f;  // Rider's drift around the target cadence
+  float _magnets[CrankPulses::MAX_PULSES_PER_REV] = {0.0f};  // Magnet angles (revs, first at 0)
+  float _closedRevs = 0.15f;  // Part of a rev each magnet holds the switch closed
+
+  // Switch transitions waiting for sim time to reach them (time ordered)
+  Edge _edges[EDGE_QUEUE_SIZE];
+  uint8_t _edgeHead = 0;
+  uint8_t _edgeCount = 0;
+
+  Stats _stats{};
 
-  float rev_accum = 0.0f;
+  void integrateTo(uint64_t t_us);
+  void stepPhysics(float dt_s);
+  void target(float elapsed_s, float& rpm, float& kp, bool& pedalling) const;
+  void emitSwitch(uint64_t t_us, bool closed);
+  void emitCrossings(float from, float to, float dt_s);
+  void pushEdge(uint64_t t_us, bool closed);
+  void feedEdges(uint64_t t_us);
+  uint32_t nextRandom();
+  float uniform(float lo, float hi) { return lo + (hi - lo) * (float)(nextRandom() >> 8) * (1.0f / 16777216.0f); }
 };
@@ -1,19 +1,112 @@
 #pragma once
+#include <stddef.h>
 #include "PowerSample.h"
+#include "CadenceFilterType.h"
+#include "CrankEdgeStats.h"
+#include "SpscRing.h"
 
 class PowerSource {
 public:
+  // Samples kept for drainSamples(): 1s at 8Hz
+  static const uint32_t SAMPLE_RING_SIZE = 8;
+
+  // Supported sample output rates (Hz). ERG apps react better above 1 Hz.
+  static const uint8_t OUTPUT_RATE_COUNT = 4;
+  static uint8_t outputRateAt(uint8_t index) {
+    static const uint8_t rates[OUTPUT_RATE_COUNT] = {1, 2, 4, 8};
+    return rates[index < OUTPUT_RATE_COUNT ? index : 0];
+  }
+
   virtual ~PowerSource() {}
 
   // Called once in setup()
   virtual void begin() = 0;
 
-  // Called every loop iteration
-  virtual void update(uint32_t now_ms) = 0;
+  // Called every loop iteration (now_ms from Clock::nowMs())
+  virtual void update(uint64_t now_ms) = 0;
+
+  // True if samples were produced since the last getSample()/drainSamples()
+  virtual bool hasSample() const { return produced.head() != drain_cursor; }
+
+  // Fetch the latest sample, discarding any older undrained ones
+  virtual PowerSample getSample() {
+    PowerSample s{};
+    if (produced.latest(s)) drain_cursor = s.source_seq + 1;
+    return s;
+  }
+
+  // Copy every sample produced since the last call into 'out' (oldest
+  // first, each with timestamp_us and source_seq) and return how many. Samples
+  // not drained within SAMPLE_RING_SIZE outputs are counted as lost.
+  virtual size_t drainSamples(PowerSample* out, size_t max) {
+    return produced.read(drain_cursor, out, (uint32_t)max, &samples_lost);
+  }
+  uint32_t getSamplesLost() const { return samples_lost; }
+
+  // Sample output rate. Smoothing is time based, so changing the rate
+  // changes how often numbers are produced, not what they are.
+  bool setOutputRate(uint8_t hz) {
+    if (outputRateIndex(hz) < 0) return false;
+    output_rate_hz = hz;
+    output_period_ms = 1000 / hz;
+    return true;
+  }
+  uint8_t getOutputRate() const { return output_rate_hz; }
+
+  // What produces a sample: the output-rate timer, or each counted crank
+  // revolution (exact event time per notification)
+  enum class SampleTrigger : uint8_t { Timer = 0, Revolution = 1 };
+
+  // Returns false if the source cannot honour the trigger (it then keeps
+  // its current one).
+  virtual bool setSampleTrigger(SampleTrigger trigger) { return trigger == SampleTrigger::Timer; }
+  SampleTrigger getSampleTrigger() const { return sample_trigger; }
+
+  // Route per-revolution wakeups to the calling task (the one that will
+  // run update()). Sources without events ignore it.
+  virtual void bindToCurrentTask() {}
+
+  // Cadence smoothing strategy; false if the source has no cadence sensor
+  virtual bool setCadenceFilter(CadenceFilterType /*type*/) { return false; }
+  CadenceFilterType getCadenceFilter() const { return filter_type; }
+
+  // Crank magnets (pulses per revolution). Call before begin(); false if
+  // the source can't use that many (it then keeps one).
+  virtual bool setPulsesPerRev(uint8_t n) { return n == 1; }
+  uint8_t getPulsesPerRev() const { return pulses_per_rev; }
+
+  // Angle (revs) from the previous magnet to each magnet, as learned, all
+  // from the same moment. 'out' holds getPulsesPerRev() entries; returns
+  // how many were written (0 if no consistent copy could be taken).
+  virtual uint8_t getMagnetGaps(float* out) const { out[0] = 1.0f; return 1; }
+
+  // Reed switch gate counters and current gates; false if the source has
+  // no edge filter (e.g. a replay of counted revs)
+  virtual bool getEdgeStats(CrankEdgeStats& /*out*/) const { return false; }
+
+  // Index for outputRateAt(), or -1 if the rate is not supported
+  static int8_t outputRateIndex(uint8_t hz) {
+    for (uint8_t i = 0; i < OUTPUT_RATE_COUNT; i++) {
+      if (outputRateAt(i) == hz) return (int8_t)i;
+    }
+    return -1;
+  }
+
+protected:
+  // Sources call this for each sample they produce; stamps source_seq
+  void emit(PowerSample& s) {
+    s.source_seq = produced.head();
+    produced.push(s);
+  }
 
-  // True if a fresh sample is ready
-  virtual bool hasSample() const = 0;
+  uint8_t output_rate_hz = 1;
+  uint32_t output_period_ms = 1000;
+  SampleTrigger sample_trigger = SampleTrigger::Timer;
+  CadenceFilterType filter_type = CadenceFilterType::Blend;
+  uint8_t pulses_per_rev = 1;
 
-  // Fetch latest sample
-  virtual PowerSample getSample() = 0;
+private:
+  SpscRing<PowerSample, SAMPLE_RING_SIZE> produced;
+  uint32_t drain_cursor = 0;
+  uint32_t samples_lost = 0;
 };
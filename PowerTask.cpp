@@ -0,0 +1,114 @@
+#include "PowerTask.h"
+#include "Clock.h"
+#include <esp_timer.h>
+#include <inttypes.h>
+
+static const uint32_t POWER_TASK_STACK = 4096;
+static const UBaseType_t POWER_TASK_PRIORITY = 3;  // Above the ADC task and loop()
+static const BaseType_t POWER_TASK_CORE = 1;
+static const uint64_t STATS_WINDOW_US = 1000000;
+
+// Scheduling and task timing run on the hardware timer: Clock may be
+// scaled or virtual, which would change the real period. Clock is only
+// used for the timestamps handed to the source.
+static inline uint64_t realUs() {
+  return (uint64_t)esp_timer_get_time();
+}
+
+PowerTask::PowerTask(PowerSource* source, SampleBus* bus, uint32_t periodMs)
+  : _source(source), _bus(bus), _periodUs((periodMs ? periodMs : 1) * 1000) {}
+
+bool PowerTask::begin() {
+  if (xTaskCreatePinnedToCore(taskEntry, "power", POWER_TASK_STACK, this,
+                              POWER_TASK_PRIORITY, nullptr, POWER_TASK_CORE) != pdPASS) {
+    Serial.println("Power task: create failed");
+    return false;
+  }
+  Serial.printf("Power task running every %" PRIu32 " us on core %d\n", _periodUs, (int)POWER_TASK_CORE);
+  return true;
+}
+
+void PowerTask::taskEntry(void* arg) {
+  static_cast<PowerTask*>(arg)->run();
+}
+
+void PowerTask::run() {
+  // Per-revolution wakeups now go to this task
+  _source->bindToCurrentTask();
+
+  uint64_t last = realUs();
+  uint64_t deadline = last + _periodUs;
+  _windowStart = last;
+
+  for (;;) {
+    // Sleep until the next deadline. A notification (counted crank
+    // revolution) ends the wait early so the sample goes out right away.
+    uint64_t now = realUs();
+    if (now < deadline) {
+      uint32_t waitMs = (uint32_t)((deadline - now + 999) / 1000);
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+      now = realUs();
+    }
+
+    if (now >= deadline) {
+      recordPeriod(now, (uint32_t)(now - last));
+      last = now;
+      deadline += _periodUs;
+      if (now >= deadline) {
+        // More than a period late: resynchronise instead of bursting
+        _window.overruns++;
+        deadline = now + _periodUs;
+      }
+    }
+
+    produce();
+  }
+}
+
+void PowerTask::produce() {
+  uint8_t slot = _pendingSlot;
+  if (slot != NO_SLOT) {
+    _pendingSlot = NO_SLOT;
+    _sourceMeter.select(slot);
+  }
+  _sourceMeter.start();
+
+  uint64_t start = realUs();
+  _source->update(Clock::nowMs());
+  uint32_t busy = (uint32_t)(realUs() - start);
+  if (busy > _window.maxUpdateUs) _window.maxUpdateUs = busy;
+
+  // Every sample produced since the last pass, not just the newest
+  PowerSample batch[PowerSource::SAMPLE_RING_SIZE];
+  size_t n = _source->drainSamples(batch, PowerSource::SAMPLE_RING_SIZE);
+  for (size_t i = 0; i < n; i++) {
+    _bus->publish(batch[i]);
+  }
+  _window.samples += n;
+  _sourceMeter.stop();
+}
+
+void PowerTask::recordPeriod(uint64_t now, uint32_t periodUs) {
+  if (_window.ticks == 0 || periodUs < _window.minUs) _window.minUs = periodUs;
+  if (periodUs > _window.maxUs) _window.maxUs = periodUs;
+  uint32_t jitter = periodUs > _periodUs ? periodUs - _periodUs : _periodUs - periodUs;
+  if (jitter > _window.maxJitterUs) _window.maxJitterUs = jitter;
+  _periodSum += periodUs;
+  _window.ticks++;
+
+  if (now - _windowStart < STATS_WINDOW_US) return;
+
+  _window.periodUs = _periodUs;
+  _window.sourceLost = _source->getSamplesLost();
+  _window.meanUs = (uint32_t)(_periodSum / _window.ticks);
+  _stats.push(_window);
+
+  // Period stats are per window; overruns and samples are totals
+  _windowStart = now;
+  _periodSum = 0;
+  _window.minUs = 0;
+  _window.maxUs = 0;
+  _window.maxJitterUs = 0;
+  _window.maxUpdateUs = 0;
+  _window.ticks = 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <Arduino.h>
+#include "PowerSource.h"
+#include "SampleBus.h"
+#include "SpscRing.h"
+#include "CpuMeter.h"
+
+// Timing of the power task, published once per second
+struct PowerTaskStats {
+  uint32_t periodUs;     // Configured period
+  uint32_t minUs;        // Shortest / longest / mean measured period
+  uint32_t maxUs;
+  uint32_t meanUs;
+  uint32_t maxJitterUs;  // Largest |measured - configured|
+  uint32_t maxUpdateUs;  // Longest PowerSource::update() call
+  uint32_t ticks;        // Periods in the window
+  uint32_t overruns;     // Total deadlines missed by more than a period
+  uint32_t samples;      // Total samples produced
+  uint32_t sourceLost;   // Total samples the task failed to drain in time
+};
+
+// Runs PowerSource::update() from a FreeRTOS task pinned to core 1 at a
+// fixed period, away from WiFi/BLE (core 0) and from loop() stalls such as
+// tryConnectWiFi() or long HTTP responses. Samples are published on a
+// SampleBus; consumers never hold the task back.
+class PowerTask {
+public:
+  static const uint32_t DEFAULT_PERIOD_MS = 5;  // Divides every output period
+
+  PowerTask(PowerSource* source, SampleBus* bus, uint32_t periodMs = DEFAULT_PERIOD_MS);
+
+  // Starts the task. Call after source->begin(), initial configuration and
+  // bus subscriptions.
+  bool begin();
+
+  // Latest published stats (false before the first full window)
+  bool getStats(PowerTaskStats& out) const { return _stats.latest(out); }
+
+  // Cost of producing samples (source update and publishing), bucketed
+  // per output rate like the loop's CpuMeter. The slot switches on the
+  // task's next pass.
+  void selectRate(uint8_t slot) { _pendingSlot = slot; }
+  const CpuMeter& getSourceMeter() const { return _sourceMeter; }
+
+private:
+  PowerSource* _source;
+  SampleBus* _bus;
+  uint32_t _periodUs;
+
+  // Window accumulators (task only)
+  uint64_t _windowStart = 0;
+  uint64_t _periodSum = 0;
+  PowerTaskStats _window{};
+
+  // Task -> readers (loop, web)
+  SpscRing<PowerTaskStats, 4> _stats;
+
+  static const uint8_t NO_SLOT = 0xFF;
+  CpuMeter _sourceMeter;  // Written by the task only
+  volatile uint8_t _pendingSlot = NO_SLOT;
+
+  static void taskEntry(void* arg);
+  void run();
+  void produce();
+  void recordPeriod(uint64_t now, uint32_t periodUs);
+};
@@ -1,58 +1,28 @@
 #include "PowerWebServer.h"
+#include "BleCps.h"
+#include "CadenceFilter.h"
+#include "CrankPulses.h"
+#include "PowerSimulator.h"
 #include <Update.h>
+#include <inttypes.h>
 
-PowerWebServer::PowerWebServer(SettingsManager* settings, MonarkCalibration* calibration, uint8_t adcPin)
-    : _server(80), _settings(settings), _calibration(calibration), _adcPin(adcPin) {
+PowerWebServer::PowerWebServer(SettingsManager* settings, MonarkCalibration* calibration, AdcService* adc)
+    : _server(80), _settings(settings), _calibration(calibration), _adc(adc) {
     memset(&_lastSample, 0, sizeof(_lastSample));
 }
 
-float PowerWebServer::readAdcQuick() {
-    // Quick ADC read (8 samples), returns calibrated millivolts
-    // Discard first 2 readings to avoid spikes from ADC settling
-    analogReadMilliVolts(_adcPin);
-    analogReadMilliVolts(_adcPin);
-
-    float sum = 0.0f;
-    for (int i = 0; i < 8; i++) {
-        sum += (float)analogReadMilliVolts(_adcPin);
-    }
-    yield();  // Let other tasks run
-    return sum / 8.0f;
-}
-
 float PowerWebServer::readAdcSmoothed() {
-    // Add new quick reading to ring buffer
-    float newReading = readAdcQuick();
-    _calAdcBuffer[_calAdcHead] = newReading;
-    _calAdcHead = (_calAdcHead + 1) % 20;
-    if (_calAdcCount < 20) _calAdcCount++;
-
-    // Return average of buffer (~1 second of readings)
-    float sum = 0.0f;
-    for (uint8_t i = 0; i < _calAdcCount; i++) {
-        sum += _calAdcBuffer[i];
-    }
-    yield();  // Let other tasks run
-    return sum / (float)_calAdcCount;
+    return _adc->read().avg1s;
 }
 
 float PowerWebServer::readAdcAvg() {
-    // Use the already-smoothed buffer (~1 second of readings)
-    // The RC filter + smoothing buffer provides stable readings
-    // No blocking needed - just return current smoothed value
-    return readAdcSmoothed();
+    return _adc->read().avg5s;
 }
 
 void PowerWebServer::begin(const char* apPassword) {
     _deviceName = _settings->loadDeviceName("MonarkPower");
     _apPassword = apPassword;
 
-    // Pre-fill ADC buffer to avoid startup delay
-    for (uint8_t i = 0; i < 20; i++) {
-        _calAdcBuffer[i] = readAdcQuick();
-    }
-    _calAdcCount = 20;
-
     // Try to connect to saved WiFi first
     if (!tryConnectWiFi()) {
         // Fall back to AP mode
@@ -139,7 +109,7 @@ bool PowerWebServer::isConnected() const {
 
 void PowerWebServer::updatePowerData(const PowerSample& sample) {
     _lastSample = sample;
-    _lastSampleTime = millis();
+    _lastSampleTime = (uint32_t)(sample.timestamp_us / 1000ULL);
 }
 
 void PowerWebServer::setupRoutes() {
@@ -206,6 +176,13 @@ void PowerWebServer::setupRoutes() {
     _server.on("/api/simulator", HTTP_GET, [this](AsyncWebServerRequest* request) {
         JsonDocument doc;
         doc["enabled"] = _settings->loadSimulatorMode(false);
+        SimProfile profile;
+        uint32_t seed;
+        uint8_t scale;
+        _settings->loadSimulatorConfig(profile, seed, scale);
+        doc["profile"] = PowerSimulator::profileName(profile);
+        doc["seed"] = seed;
+        doc["scale"] = scale;
         String json;
         serializeJson(doc, json);
         request->send(200, "application/json", json);
@@ -222,12 +199,124 @@ void PowerWebServer::setupRoutes() {
                 return;
             }
             bool enabled = doc["enabled"] | false;
+
+            // Optional workload settings; missing fields keep their value
+            SimProfile profile;
+            uint32_t seed;
+            uint8_t scale;
+            _settings->loadSimulatorConfig(profile, seed, scale);
+            profile = PowerSimulator::profileFromName(doc["profile"] | (const char*)nullptr, profile);
+            seed = doc["seed"] | seed;
+            int newScale = doc["scale"] | (int)scale;
+            if (newScale < 1 || newScale > 100) {
+                request->send(400, "application/json", "{\"success\":false,\"error\":\"Time scale must be 1-100\"}");
+                return;
+            }
+
             _settings->saveSimulatorMode(enabled);
-            Serial.printf("Simulator mode set to: %s\n", enabled ? "ON" : "OFF");
+            _settings->saveSimulatorConfig(profile, seed, (uint8_t)newScale);
+            Serial.printf("Simulator mode set to: %s (%s, seed %" PRIu32 ", x%d)\n", enabled ? "ON" : "OFF",
+                          PowerSimulator::profileName(profile), seed, newScale);
             request->send(200, "application/json", "{\"success\":true,\"message\":\"Restart required\"}");
         }
     );
 
+    // BLE service endpoints (services are registered at boot: restart required)
+    _server.on("/api/ble", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        uint8_t services = _settings->loadBleServices();
+        JsonDocument doc;
+        doc["cps"] = (services & BleServices::SERVICE_CPS) != 0;
+        doc["csc"] = (services & BleServices::SERVICE_CSC) != 0;
+        doc["cscWheel"] = (services & BleServices::SERVICE_CSC_WHEEL) != 0;
+        doc["ftms"] = (services & BleServices::SERVICE_FTMS) != 0;
+        doc["cpsTorque"] = (services & BleServices::SERVICE_CPS_TORQUE) != 0;
+        doc["cpsEnergy"] = (services & BleServices::SERVICE_CPS_ENERGY) != 0;
+        doc["crankLength"] = _settings->loadCrankLength() / 2.0f;  // mm, set by apps over CPS
+        doc["maxCentrals"] = BleCps::MAX_CENTRALS;
+        writeCentrals(doc["centrals"].to<JsonArray>());
+        if (_ble) {
+            const BleCps::NotifyStats& st = _ble->getNotifyStats();
+            JsonObject notify = doc["notify"].to<JsonObject>();
+            notify["sent"] = st.sent;
+            notify["skipped"] = st.skipped;
+            notify["failed"] = st.failed;
+        }
+        String json;
+        serializeJson(doc, json);
+        request->send(200, "application/json", json);
+    });
+
+    _server.on("/api/ble", HTTP_POST,
+        [](AsyncWebServerRequest* request) {},
+        nullptr,
+        [this](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, data, len);
+            if (error) {
+                request->send(400, "application/json", "{\"success\":false,\"error\":\"Invalid JSON\"}");
+                return;
+            }
+
+            // Missing fields keep their value
+            uint8_t services = _settings->loadBleServices();
+            bool cps = doc["cps"] | ((services & BleServices::SERVICE_CPS) != 0);
+            bool csc = doc["csc"] | ((services & BleServices::SERVICE_CSC) != 0);
+            bool wheel = doc["cscWheel"] | ((services & BleServices::SERVICE_CSC_WHEEL) != 0);
+            bool ftms = doc["ftms"] | ((services & BleServices::SERVICE_FTMS) != 0);
+            bool torque = doc["cpsTorque"] | ((services & BleServices::SERVICE_CPS_TORQUE) != 0);
+            bool energy = doc["cpsEnergy"] | ((services & BleServices::SERVICE_CPS_ENERGY) != 0);
+            if (!cps && !csc && !ftms) {
+                request->send(400, "application/json", "{\"success\":false,\"error\":\"Enable at least one service\"}");
+                return;
+            }
+
+            services = (cps ? BleServices::SERVICE_CPS : 0) | (csc ? BleServices::SERVICE_CSC : 0) |
+                       (wheel ? BleServices::SERVICE_CSC_WHEEL : 0) | (ftms ? BleServices::SERVICE_FTMS : 0) |
+                       (torque ? BleServices::SERVICE_CPS_TORQUE : 0) | (energy ? BleServices::SERVICE_CPS_ENERGY : 0);
+            _settings->saveBleServices(services);
+            Serial.printf("BLE services set to: CPS %s (torque %s, energy %s), CSC %s (wheel %s), FTMS %s\n",
+                          cps ? "ON" : "OFF", torque ? "ON" : "OFF", energy ? "ON" : "OFF",
+                          csc ? "ON" : "OFF", wheel ? "ON" : "OFF", ftms ? "ON" : "OFF");
+            request->send(200, "application/json", "{\"success\":true,\"message\":\"Restart required\"}");
+        }
+    );
+
+    // Output rate endpoints (applied live, no restart)
+    _server.on("/api/output", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        handleGetOutput(request);
+    });
+
+    _server.on("/api/output", HTTP_POST,
+        [](AsyncWebServerRequest* request) {},
+        nullptr,
+        [this](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            handleSetOutput(request, data, len);
+        }
+    );
+
+    // Cadence filter endpoints (applied live, no restart)
+    _server.on("/api/cadence", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        JsonDocument doc;
+        doc["filter"] = ICadenceFilter::typeName(_cadenceFilter);
+        JsonArray filters = doc["filters"].to<JsonArray>();
+        filters.add(ICadenceFilter::typeName(CadenceFilterType::Blend));
+        filters.add(ICadenceFilter::typeName(CadenceFilterType::AlphaBeta));
+        doc["pulsesPerRev"] = _settings->loadPulsesPerRev();
+        writeEdgeStats(doc["edges"].to<JsonObject>());
+        writeMagnetGaps(doc["magnets"].to<JsonArray>());
+        String json;
+        serializeJson(doc, json);
+        request->send(200, "application/json", json);
+    });
+
+    _server.on("/api/cadence", HTTP_POST,
+        [](AsyncWebServerRequest* request) {},
+        nullptr,
+        [this](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            handleSetCadenceFilter(request, data, len);
+        }
+    );
+
     // Combined status endpoint (power + calibration) - poll this at 1Hz
     _server.on("/api/status", HTTP_GET, [this](AsyncWebServerRequest* request) {
         JsonDocument doc;
@@ -239,14 +328,7 @@ void PowerWebServer::setupRoutes() {
         doc["adc"] = _lastSample.adc_raw;
 
         // Calibration state
-        const char* calStates[] = {"idle", "0kp", "6kp", "4kp", "2kp", "done"};
-        doc["cal"]["state"] = calStates[_calState];
-        doc["cal"]["step"] = (int)_calState;
-        doc["cal"]["adc"] = readAdcSmoothed();
-        doc["cal"]["values"]["adc0"] = _calValues[0];
-        doc["cal"]["values"]["adc2"] = _calValues[1];
-        doc["cal"]["values"]["adc4"] = _calValues[2];
-        doc["cal"]["values"]["adc6"] = _calValues[3];
+        writeCalibrationStatus(doc["cal"].to<JsonObject>());
 
         String json;
         serializeJson(doc, json);
@@ -254,9 +336,16 @@ void PowerWebServer::setupRoutes() {
     });
 
     // Calibration wizard endpoints
-    _server.on("/api/calibrate/start", HTTP_POST, [this](AsyncWebServerRequest* request) {
-        handleCalibrationStart(request);
-    });
+    // Optional body: {"kp":[0,2,...]} or {"maxKp":10,"stepKp":1}
+    _server.on("/api/calibrate/start", HTTP_POST,
+        [this](AsyncWebServerRequest* request) {
+            handleCalibrationStart(request);
+        },
+        nullptr,
+        [this](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            _calPlanError = parseCalibrationPlan(data, len);
+        }
+    );
     _server.on("/api/calibrate/next", HTTP_POST, [this](AsyncWebServerRequest* request) {
         handleCalibrationNext(request);
     });
@@ -345,7 +434,91 @@ void PowerWebServer::setupRoutes() {
                 <span>Simulator Mode</span>
             </label>
             <span id="simStatus" class="status"></span>
-            <p style="font-size:12px;color:#888;">Uses simulated power data instead of real sensors. Restart required.</p>
+            <div class="row">
+                <div class="col">
+                    <label>Profile<br>
+                        <select id="simProfile" onchange="saveSimulatorMode()">
+                            <option value="steady">Steady</option>
+                            <option value="intervals">Intervals</option>
+                            <option value="sprints">Sprints</option>
+                            <option value="coastdown">Coast-down</option>
+                        </select>
+                    </label>
+                </div>
+                <div class="col">
+                    <label>Seed<br><input type="number" id="simSeed" min="1" onchange="saveSimulatorMode()"></label>
+                </div>
+                <div class="col">
+                    <label>Speed (x real time)<br><input type="number" id="simScale" min="1" max="100" onchange="saveSimulatorMode()"></label>
+                </div>
+            </div>
+            <p style="font-size:12px;color:#888;">Uses a simulated rider and flywheel instead of real sensors. Speed above 1 stress-tests the pipeline. Restart required.</p>
+        </div>
+
+        <div style="margin-top:20px;padding-top:20px;border-top:1px solid #0f3460;">
+            <label style="display:flex;align-items:center;cursor:pointer;">
+                <input type="checkbox" id="bleCps" onchange="saveBleServices()" style="width:auto;margin-right:10px;">
+                <span>Cycling Power service</span>
+            </label>
+            <label style="display:flex;align-items:center;cursor:pointer;">
+                <input type="checkbox" id="bleCpsTorque" onchange="saveBleServices()" style="width:auto;margin-right:10px;">
+                <span>Accumulated torque (Cycling Power)</span>
+            </label>
+            <label style="display:flex;align-items:center;cursor:pointer;">
+                <input type="checkbox" id="bleCpsEnergy" onchange="saveBleServices()" style="width:auto;margin-right:10px;">
+                <span>Accumulated energy (Cycling Power)</span>
+            </label>
+            <label style="display:flex;align-items:center;cursor:pointer;">
+                <input type="checkbox" id="bleCsc" onchange="saveBleServices()" style="width:auto;margin-right:10px;">
+                <span>Speed &amp; Cadence service</span>
+            </label>
+            <label style="display:flex;align-items:center;cursor:pointer;">
+                <input type="checkbox" id="bleCscWheel" onchange="saveBleServices()" style="width:auto;margin-right:10px;">
+                <span>Virtual wheel speed (Speed &amp; Cadence)</span>
+            </label>
+            <label style="display:flex;align-items:center;cursor:pointer;">
+                <input type="checkbox" id="bleFtms" onchange="saveBleServices()" style="width:auto;margin-right:10px;">
+                <span>Fitness Machine service (Indoor Bike)</span>
+            </label>
+            <span id="bleStatus" class="status"></span>
+            <p id="bleCentrals" style="font-size:12px;color:#888;"></p>
+            <p style="font-size:12px;color:#888;">BLE services advertised to head units and apps. Restart required.</p>
+        </div>
+
+        <div style="margin-top:20px;padding-top:20px;border-top:1px solid #0f3460;">
+            <label>Output Rate (BLE, web & workout)<br>
+                <select id="outputRate" onchange="saveOutputRate()">
+                    <option value="1">1 Hz</option>
+                    <option value="2">2 Hz</option>
+                    <option value="4">4 Hz (ERG)</option>
+                    <option value="8">8 Hz</option>
+                </select>
+            </label>
+            <label style="display:flex;align-items:center;cursor:pointer;">
+                <input type="checkbox" id="revTrigger" onchange="saveOutputRate()" style="width:auto;margin-right:10px;">
+                <span>Notify on each crank revolution</span>
+            </label>
+            <span id="outputStatus" class="status"></span>
+            <p id="outputLoad" style="font-size:12px;color:#888;"></p>
+        </div>
+
+        <div style="margin-top:20px;padding-top:20px;border-top:1px solid #0f3460;">
+            <label>Cadence Filter<br>
+                <select id="cadenceFilter" onchange="saveCadenceFilter()">
+                    <option value="blend">Window blend (smooth)</option>
+                    <option value="alphabeta">Alpha-beta (responsive)</option>
+                </select>
+            </label>
+            <label>Crank Magnets (restart required)<br>
+                <select id="pulsesPerRev" onchange="savePulsesPerRev()">
+                    <option value="1">1</option>
+                    <option value="2">2</option>
+                    <option value="3">3</option>
+                    <option value="4">4</option>
+                </select>
+            </label>
+            <span id="cadenceStatus" class="status"></span>
+            <p id="cadenceEdges" style="font-size:12px;color:#888;"></p>
         </div>
     </div>
 
@@ -374,6 +547,10 @@ void PowerWebServer::setupRoutes() {
                 <strong id="calStep">Ready to calibrate</strong><br>
                 <span id="calMessage">Click Start to begin calibration process</span>
             </div>
+            <div id="calPlanRow" class="row" style="margin-bottom:15px;">
+                <div class="col"><label>Max kp (blank = current points)<br><input type="number" id="calMaxKp" step="0.5" min="1" max="20"></label></div>
+                <div class="col"><label>Step kp<br><input type="number" id="calStepKp" step="0.5" min="0.5" max="10" value="1"></label></div>
+            </div>
             <div id="calAdcRow" style="margin-bottom:15px;display:none;">
                 <span style="color:#888;">Current ADC: </span>
                 <span id="calAdc" style="font-size:24px;color:#4ecca3;">--</span>
@@ -386,17 +563,17 @@ void PowerWebServer::setupRoutes() {
 
     <div class="card">
         <h2>Manual Calibration</h2>
-        <div class="row">
-            <div class="col"><label>0 kp ADC<br><input type="number" id="adc0"></label></div>
-            <div class="col"><label>2 kp ADC<br><input type="number" id="adc2"></label></div>
-            <div class="col"><label>4 kp ADC<br><input type="number" id="adc4"></label></div>
-            <div class="col"><label>6 kp ADC<br><input type="number" id="adc6"></label></div>
-        </div>
+        <div class="row label"><div class="col">kp</div><div class="col">ADC</div><div class="col">Residual (kp)</div><div class="col"></div></div>
+        <div id="calPoints"></div>
+        <button onclick="addCalPoint()" style="padding:8px 16px;">Add Point</button>
         <div class="row" style="margin-top:15px;">
+            <div class="col"><label>Fit<br><select id="calFit" style="padding:10px;margin:5px 0;width:100%;background:#0f3460;border:1px solid #4ecca3;color:#eee;border-radius:5px;">
+                <option value="linear">Piecewise linear</option>
+                <option value="monotone">Monotone cubic</option>
+            </select></label></div>
             <div class="col"><label>Cycle Constant<br><input type="number" id="cycleConstant" step="0.01" min="0.5" max="2.0"></label></div>
             <div class="col"></div>
             <div class="col"></div>
-            <div class="col"></div>
         </div>
         <button onclick="saveCalibration()">Save Calibration</button>
         <span id="calStatus" class="status"></span>
@@ -423,7 +600,7 @@ void PowerWebServer::setupRoutes() {
 
     <script>
         // Track calibration state to avoid overwriting manual edits
-        let lastCalStep = -1;
+        let lastCalState = '';
 
         // Single unified status fetch at 1Hz
         async function fetchStatus() {
@@ -443,52 +620,63 @@ void PowerWebServer::setupRoutes() {
         }
 
         function updateCalibrationUI(cal) {
-            const stepNum = cal.step;
-            const kpOrder = [0, 0, 6, 4, 2, 0];
-
             // Only show live ADC when actively calibrating
-            if (stepNum >= 1 && stepNum <= 4) {
+            if (cal.state === 'capture') {
                 document.getElementById('calAdcRow').style.display = 'block';
                 document.getElementById('calAdc').textContent = cal.adc.toFixed(2);
             } else {
                 document.getElementById('calAdcRow').style.display = 'none';
             }
 
-            if (stepNum === 0) {
+            if (cal.state === 'idle') {
                 document.getElementById('calStep').textContent = 'Ready to calibrate';
-                document.getElementById('calMessage').textContent = 'Click Start to begin (0 -> 6 -> 4 -> 2 kp)';
+                document.getElementById('calMessage').textContent = 'Click Start to begin (lowest kp first, then highest down)';
+                document.getElementById('calPlanRow').style.display = 'flex';
                 document.getElementById('calStartBtn').style.display = 'inline-block';
                 document.getElementById('calNextBtn').style.display = 'none';
                 document.getElementById('calCancelBtn').style.display = 'none';
-            } else if (stepNum >= 1 && stepNum <= 4) {
-                const kpVal = kpOrder[stepNum];
-                document.getElementById('calStep').textContent = 'Step ' + stepNum + '/4: Set ' + kpVal + ' kp';
-                document.getElementById('calMessage').textContent = 'Position pendulum at ' + kpVal + ' kp, click Next';
+            } else if (cal.state === 'capture') {
+                document.getElementById('calStep').textContent = 'Step ' + cal.step + '/' + cal.steps + ': Set ' + cal.target + ' kp';
+                document.getElementById('calMessage').textContent = 'Position pendulum at ' + cal.target + ' kp, click Next';
+                document.getElementById('calPlanRow').style.display = 'none';
                 document.getElementById('calStartBtn').style.display = 'none';
                 document.getElementById('calNextBtn').style.display = 'inline-block';
                 document.getElementById('calCancelBtn').style.display = 'inline-block';
-            } else if (stepNum === 5) {
+            } else if (cal.state === 'done') {
                 document.getElementById('calStep').textContent = 'Calibration Complete!';
-                document.getElementById('calMessage').textContent = '0kp=' + cal.values.adc0 + ' 2kp=' + cal.values.adc2 + ' 4kp=' + cal.values.adc4 + ' 6kp=' + cal.values.adc6;
+                document.getElementById('calMessage').textContent = cal.values.map(function(p) { return p.kp + 'kp=' + p.adc; }).join(' ');
+                document.getElementById('calPlanRow').style.display = 'flex';
                 document.getElementById('calStartBtn').style.display = 'inline-block';
                 document.getElementById('calNextBtn').style.display = 'none';
                 document.getElementById('calCancelBtn').style.display = 'none';
-                // Only fetch calibration once when transitioning to step 5
-                if (lastCalStep !== 5) {
+                // Only fetch calibration once when transitioning to done
+                if (lastCalState !== 'done') {
                     fetchCalibration();
                 }
             }
-            lastCalStep = stepNum;
+            lastCalState = cal.state;
+        }
+
+        function addCalPoint(kp, adc, residual) {
+            const row = document.createElement('div');
+            row.className = 'row calPoint';
+            row.innerHTML = '<div class="col"><input type="number" class="calKp" step="0.5"></div>' +
+                '<div class="col"><input type="number" class="calAdc"></div>' +
+                '<div class="col calResidual" style="padding-top:15px;"></div>' +
+                '<div class="col"><button onclick="this.closest(\'.calPoint\').remove()" style="background:#e94560;padding:8px 16px;margin-top:5px;">Remove</button></div>';
+            row.querySelector('.calKp').value = (kp !== undefined) ? kp : '';
+            row.querySelector('.calAdc').value = (adc !== undefined) ? adc : '';
+            row.querySelector('.calResidual').textContent = (residual !== undefined) ? residual.toFixed(3) : '';
+            document.getElementById('calPoints').appendChild(row);
         }
 
         async function fetchCalibration() {
             try {
                 const res = await fetch('/api/calibration');
                 const data = await res.json();
-                document.getElementById('adc0').value = data.adc0;
-                document.getElementById('adc2').value = data.adc2;
-                document.getElementById('adc4').value = data.adc4;
-                document.getElementById('adc6').value = data.adc6;
+                document.getElementById('calPoints').innerHTML = '';
+                data.points.forEach(function(p) { addCalPoint(p.kp, p.adc, p.residual); });
+                document.getElementById('calFit').value = data.fit;
                 document.getElementById('cycleConstant').value = data.cycleConstant;
             } catch (e) {}
         }
@@ -507,17 +695,74 @@ void PowerWebServer::setupRoutes() {
                 const res = await fetch('/api/simulator');
                 const data = await res.json();
                 document.getElementById('simulatorMode').checked = data.enabled;
+                document.getElementById('simProfile').value = data.profile;
+                document.getElementById('simSeed').value = data.seed;
+                document.getElementById('simScale').value = data.scale;
+            } catch (e) {}
+        }
+
+        async function fetchBleServices() {
+            try {
+                const res = await fetch('/api/ble');
+                const data = await res.json();
+                document.getElementById('bleCps').checked = data.cps;
+                document.getElementById('bleCsc').checked = data.csc;
+                document.getElementById('bleCscWheel').checked = data.cscWheel;
+                document.getElementById('bleFtms').checked = data.ftms;
+                document.getElementById('bleCpsTorque').checked = data.cpsTorque;
+                document.getElementById('bleCpsEnergy').checked = data.cpsEnergy;
+                // Connected centrals: what each subscribed to and its sample-to-notify latency
+                const centrals = data.centrals || [];
+                document.getElementById('bleCentrals').textContent = 'Crank length ' + data.crankLength.toFixed(1) + ' mm | Connected ' + centrals.length + '/' + data.maxCentrals +
+                    centrals.map(function(c) {
+                        const subs = ['cps', 'csc', 'ftms'].filter(function(k) { return c[k]; }).join('+') || 'none';
+                        return ' | #' + c.handle + ' ' + subs + ', latency ' + (c.latencyUs / 1000).toFixed(1) +
+                            ' ms (max ' + (c.maxLatencyUs / 1000).toFixed(1) + ')';
+                    }).join('');
+                if (data.notify) {
+                    document.getElementById('bleCentrals').textContent += ' | Notify: sent ' + data.notify.sent +
+                        ', skipped ' + data.notify.skipped + ', failed ' + data.notify.failed;
+                }
             } catch (e) {}
         }
 
+        async function saveBleServices() {
+            const status = document.getElementById('bleStatus');
+            const body = {
+                cps: document.getElementById('bleCps').checked,
+                csc: document.getElementById('bleCsc').checked,
+                cscWheel: document.getElementById('bleCscWheel').checked,
+                ftms: document.getElementById('bleFtms').checked,
+                cpsTorque: document.getElementById('bleCpsTorque').checked,
+                cpsEnergy: document.getElementById('bleCpsEnergy').checked
+            };
+            try {
+                const res = await fetch('/api/ble', {
+                    method: 'POST',
+                    headers: {'Content-Type': 'application/json'},
+                    body: JSON.stringify(body)
+                });
+                const result = await res.json();
+                status.textContent = result.success ? 'Saved! Restart required.' : (result.error || 'Error');
+                status.className = 'status ' + (result.success ? 'success' : 'error');
+                setTimeout(function() { status.textContent = ""; }, 3000);
+            } catch (e) {
+                status.textContent = 'Network error';
+                status.className = 'status error';
+            }
+        }
+
         async function saveSimulatorMode() {
             const status = document.getElementById('simStatus');
             const enabled = document.getElementById('simulatorMode').checked;
+            const profile = document.getElementById('simProfile').value;
+            const seed = parseInt(document.getElementById('simSeed').value) || 1;
+            const scale = parseInt(document.getElementById('simScale').value) || 1;
             try {
                 const res = await fetch('/api/simulator', {
                     method: 'POST',
                     headers: {'Content-Type': 'application/json'},
-                    body: JSON.stringify({ enabled: enabled })
+                    body: JSON.stringify({ enabled: enabled, profile: profile, seed: seed, scale: scale })
                 });
                 const result = await res.json();
                 status.textContent = result.success ? 'Saved! Restart required.' : (result.error || 'Error');
@@ -529,13 +774,120 @@ void PowerWebServer::setupRoutes() {
             }
         }
 
+        async function fetchOutput() {
+            try {
+                const res = await fetch('/api/output');
+                const data = await res.json();
+                document.getElementById('outputRate').value = data.rate;
+                document.getElementById('revTrigger').checked = data.perRev;
+                const cost = function(name, c) {
+                    return c ? ' ' + name + ' ' + c.percent.toFixed(2) + '% (' + c.usPerRun + ' us/run, max ' + c.maxUs + ' us)' : '';
+                };
+                document.getElementById('outputLoad').textContent = 'CPU: ' + data.load.map(function(l) {
+                    return l.rate + ' Hz' + cost('source', l.source) + cost('fan-out', l.fanout);
+                }).join(', ');
+                if (data.task && data.task.periodUs) {
+                    document.getElementById('outputLoad').textContent += ' | Task period ' + data.task.meanUs +
+                        ' us (min ' + data.task.minUs + ', max ' + data.task.maxUs + '), overruns ' + data.task.overruns;
+                }
+                if (data.bus && data.bus.length) {
+                    document.getElementById('outputLoad').textContent += ' | Lag: ' + data.bus.map(function(b) {
+                        return b.name + ' ' + b.lag + '/' + b.maxLag + ' (lost ' + b.lost + ')';
+                    }).join(', ');
+                }
+            } catch (e) {}
+        }
+
+        async function saveOutputRate() {
+            const status = document.getElementById('outputStatus');
+            const rate = parseInt(document.getElementById('outputRate').value);
+            const perRev = document.getElementById('revTrigger').checked;
+            try {
+                const res = await fetch('/api/output', {
+                    method: 'POST',
+                    headers: {'Content-Type': 'application/json'},
+                    body: JSON.stringify({ rate: rate, perRev: perRev })
+                });
+                const result = await res.json();
+                status.textContent = result.success ? 'Saved!' : (result.error || 'Error');
+                status.className = 'status ' + (result.success ? 'success' : 'error');
+                setTimeout(function() { status.textContent = ""; }, 3000);
+            } catch (e) {
+                status.textContent = 'Network error';
+                status.className = 'status error';
+            }
+        }
+
+        async function fetchCadenceFilter() {
+            try {
+                const res = await fetch('/api/cadence');
+                const data = await res.json();
+                document.getElementById('cadenceFilter').value = data.filter;
+                document.getElementById('pulsesPerRev').value = data.pulsesPerRev;
+                const e = data.edges;
+                if (e && e.edges !== undefined) {
+                    document.getElementById('cadenceEdges').textContent = 'Edges ' + e.edges + ', revs ' + e.counted +
+                        ' | Rejected: bounce ' + e.bounced + ', glitches ' + e.glitches + ', too soon ' + e.tooSoon +
+                        ' | Gates: debounce ' + (e.debounceUs / 1000).toFixed(1) + ' ms, min rev ' + (e.minRevPeriodUs / 1000).toFixed(0) + ' ms';
+                }
+                if (data.magnets && data.magnets.length > 1) {
+                    document.getElementById('cadenceEdges').textContent += ' | Magnet gaps: ' + data.magnets.map(function(d) {
+                        return d.toFixed(1) + '\u00b0';
+                    }).join(', ');
+                }
+            } catch (e) {}
+        }
+
+        async function saveCadenceFilter() {
+            const status = document.getElementById('cadenceStatus');
+            const filter = document.getElementById('cadenceFilter').value;
+            try {
+                const res = await fetch('/api/cadence', {
+                    method: 'POST',
+                    headers: {'Content-Type': 'application/json'},
+                    body: JSON.stringify({ filter: filter })
+                });
+                const result = await res.json();
+                status.textContent = result.success ? 'Saved!' : (result.error || 'Error');
+                status.className = 'status ' + (result.success ? 'success' : 'error');
+                setTimeout(function() { status.textContent = ""; }, 3000);
+            } catch (e) {
+                status.textContent = 'Network error';
+                status.className = 'status error';
+            }
+        }
+
+        async function savePulsesPerRev() {
+            const status = document.getElementById('cadenceStatus');
+            const n = parseInt(document.getElementById('pulsesPerRev').value);
+            try {
+                const res = await fetch('/api/cadence', {
+                    method: 'POST',
+                    headers: {'Content-Type': 'application/json'},
+                    body: JSON.stringify({ pulsesPerRev: n })
+                });
+                const result = await res.json();
+                status.textContent = result.success ? (result.message || 'Saved!') : (result.error || 'Error');
+                status.className = 'status ' + (result.success ? 'success' : 'error');
+                setTimeout(function() { status.textContent = ""; }, 3000);
+            } catch (e) {
+                status.textContent = 'Network error';
+                status.className = 'status error';
+            }
+        }
+
         async function saveCalibration() {
             const status = document.getElementById('calStatus');
+            const points = [];
+            document.querySelectorAll('#calPoints .calPoint').forEach(function(row) {
+                points.push({
+                    kp: parseFloat(row.querySelector('.calKp').value),
+                    adc: parseInt(row.querySelector('.calAdc').value)
+                });
+            });
             const data = {
-                adc0: parseInt(document.getElementById('adc0').value),
-                adc2: parseInt(document.getElementById('adc2').value),
-                adc4: parseInt(document.getElementById('adc4').value),
-                adc6: parseInt(document.getElementById('adc6').value),
+                points: points,
+                fit: document.getElementById('calFit').value,
                 cycleConstant: parseFloat(document.getElementById('cycleConstant').value)
             };
             try {
@@ -547,6 +899,7 @@ void PowerWebServer::setupRoutes() {
                 const result = await res.json();
                 status.textContent = result.success ? 'Saved!' : (result.error || 'Error');
                 status.className = 'status ' + (result.success ? 'success' : 'error');
+                if (result.success) fetchCalibration();  // Refresh residuals
                 setTimeout(function() { status.textContent = ""; }, 3000);
             } catch (e) {
                 status.textContent = 'Error';
@@ -639,8 +992,20 @@ void PowerWebServer::setupRoutes() {
         // Calibration Wizard
         async function startCalibration() {
             try {
-                const res = await fetch('/api/calibrate/start', { method: 'POST' });
+                const plan = {};
+                const maxKp = parseFloat(document.getElementById('calMaxKp').value);
+                const stepKp = parseFloat(document.getElementById('calStepKp').value);
+                if (maxKp > 0 && stepKp > 0) {
+                    plan.maxKp = maxKp;
+                    plan.stepKp = stepKp;
+                }
+                const res = await fetch('/api/calibrate/start', {
+                    method: 'POST',
+                    headers: {'Content-Type': 'application/json'},
+                    body: JSON.stringify(plan)
+                });
                 const result = await res.json();
+                if (!result.success) document.getElementById('calMessage').textContent = result.error || 'Error';
             } catch (e) {}
         }
 
@@ -693,6 +1058,12 @@ void PowerWebServer::setupRoutes() {
         // Initial fetches (one-time)
         fetchDeviceName();
         fetchSimulatorMode();
+        fetchBleServices();
+        fetchOutput();
+        fetchCadenceFilter();
+        setInterval(fetchCadenceFilter, 5000);
+        setInterval(fetchBleServices, 5000);
+        setInterval(fetchOutput, 5000);
         fetchCalibration();
         fetchWiFi();
 
@@ -723,10 +1094,15 @@ void PowerWebServer::handleGetPower(AsyncWebServerRequest* request) {
 
 void PowerWebServer::handleGetCalibration(AsyncWebServerRequest* request) {
     JsonDocument doc;
-    doc["adc0"] = _calibration->getAdc0();
-    doc["adc2"] = _calibration->getAdc2();
-    doc["adc4"] = _calibration->getAdc4();
-    doc["adc6"] = _calibration->getAdc6();
+    JsonArray points = doc["points"].to<JsonArray>();
+    for (uint8_t i = 0; i < _calibration->getPointCount(); i++) {
+        const CalPoint& p = _calibration->getPoint(i);
+        JsonObject o = points.add<JsonObject>();
+        o["kp"] = p.kp;
+        o["adc"] = p.adc;
+        o["residual"] = _calibration->getResidual(i);
+    }
+    doc["fit"] = MonarkCalibration::fitName(_calibration->getFit());
     doc["cycleConstant"] = _settings->loadCycleConstant(1.05f);
 
     String json;
@@ -743,30 +1119,57 @@ void PowerWebServer::handleSetCalibration(AsyncWebServerRequest* request, uint8_
         return;
     }
 
-    int adc0 = doc["adc0"] | -1;
-    int adc2 = doc["adc2"] | -1;
-    int adc4 = doc["adc4"] | -1;
-    int adc6 = doc["adc6"] | -1;
-    float cycleConstant = doc["cycleConstant"] | -1.0f;
+    CalPoint points[MonarkCalibration::MAX_POINTS];
+    uint8_t count = 0;
 
-    if (adc0 < 0 || adc2 < 0 || adc4 < 0 || adc6 < 0) {
-        request->send(400, "application/json", "{\"success\":false,\"error\":\"Missing calibration values\"}");
+    if (doc["points"].is<JsonArray>()) {
+        for (JsonVariant p : doc["points"].as<JsonArray>()) {
+            if (count >= MonarkCalibration::MAX_POINTS) {
+                request->send(400, "application/json", "{\"success\":false,\"error\":\"Too many calibration points\"}");
+                return;
+            }
+            float kp = p["kp"] | -1.0f;
+            int adc = p["adc"] | -1;
+            if (kp < 0.0f || adc < 0) {
+                request->send(400, "application/json", "{\"success\":false,\"error\":\"Invalid calibration point\"}");
+                return;
+            }
+            points[count++] = {kp, adc};
+        }
+    } else {
+        // Legacy 4-point body: adc0/adc2/adc4/adc6
+        const char* keys[] = {"adc0", "adc2", "adc4", "adc6"};
+        for (uint8_t i = 0; i < 4; i++) {
+            int adc = doc[keys[i]] | -1;
+            if (adc < 0) {
+                request->send(400, "application/json", "{\"success\":false,\"error\":\"Missing calibration values\"}");
+                return;
+            }
+            points[count++] = {(float)(i * 2), adc};
+        }
+    }
+
+    if (count < 2) {
+        request->send(400, "application/json", "{\"success\":false,\"error\":\"At least 2 calibration points required\"}");
         return;
     }
 
+    float cycleConstant = doc["cycleConstant"] | -1.0f;
     if (cycleConstant < 0.5f || cycleConstant > 2.0f) {
         request->send(400, "application/json", "{\"success\":false,\"error\":\"Cycle constant must be 0.5-2.0\"}");
         return;
     }
 
-    // Save to NVS
-    _settings->saveCalibration(adc0, adc2, adc4, adc6);
-    _settings->saveCycleConstant(cycleConstant);
+    CalFit fit = MonarkCalibration::fitFromName(doc["fit"] | (const char*)nullptr, _calibration->getFit());
 
-    // Update live calibration
-    _calibration->updateValues(adc0, adc2, adc4, adc6);
+    // Update live calibration; loop() saves it to NVS
+    if (!_calibration->updateValues(points, count, fit)) {
+        request->send(400, "application/json", "{\"success\":false,\"error\":\"ADC and kp must both increase from point to point\"}");
+        return;
+    }
+    _settings->saveCycleConstant(cycleConstant);
 
-    Serial.printf("Calibration saved via web: %d %d %d %d, cycle=%.2f\n", adc0, adc2, adc4, adc6, cycleConstant);
+    Serial.printf("Calibration saved via web: %u points (%s), cycle=%.2f\n", count, MonarkCalibration::fitName(fit), cycleConstant);
 
     request->send(200, "application/json", "{\"success\":true,\"message\":\"Restart for cycle constant to take effect\"}");
 }
@@ -885,27 +1288,292 @@ void PowerWebServer::handleClearWiFi(AsyncWebServerRequest* request) {
     request->send(200, "application/json", "{\"success\":true,\"message\":\"WiFi cleared. Restart to use AP mode\"}");
 }
 
-void PowerWebServer::handleCalibrationStatus(AsyncWebServerRequest* request) {
+uint8_t PowerWebServer::takeOutputRateRequest() {
+    uint8_t hz = _pendingOutputRate;
+    _pendingOutputRate = 0;
+    return hz;
+}
+
+int8_t PowerWebServer::takeRevTriggerRequest() {
+    int8_t enabled = _pendingRevTrigger;
+    _pendingRevTrigger = -1;
+    return enabled;
+}
+
+bool PowerWebServer::takeCadenceFilterRequest(CadenceFilterType& type) {
+    int8_t pending = _pendingCadenceFilter;
+    if (pending < 0) return false;
+    _pendingCadenceFilter = -1;
+    type = (CadenceFilterType)pending;
+    return true;
+}
+
+void PowerWebServer::handleSetCadenceFilter(AsyncWebServerRequest* request, uint8_t* data, size_t len) {
     JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, data, len);
+
+    if (error) {
+        request->send(400, "application/json", "{\"success\":false,\"error\":\"Invalid JSON\"}");
+        return;
+    }
+
+    // Magnet count: takes effect after a restart
+    bool restart = false;
+    if (!doc["pulsesPerRev"].isNull()) {
+        int n = doc["pulsesPerRev"] | 0;
+        if (n < 1 || n > CrankPulses::MAX_PULSES_PER_REV) {
+            request->send(400, "application/json", "{\"success\":false,\"error\":\"Pulses per rev must be 1-4\"}");
+            return;
+        }
+        restart = n != _settings->loadPulsesPerRev();
+        _settings->savePulsesPerRev((uint8_t)n);
+        Serial.printf("Pulses per rev set to: %d\n", n);
+    }
+
+    if (!doc["filter"].isNull()) {
+        const char* name = doc["filter"] | "";
+        CadenceFilterType type = ICadenceFilter::typeFromName(name, CadenceFilterType::Blend);
+        if (strcmp(name, ICadenceFilter::typeName(type)) != 0) {
+            request->send(400, "application/json", "{\"success\":false,\"error\":\"Unknown cadence filter\"}");
+            return;
+        }
+
+        _settings->saveCadenceFilter(type);
+        _pendingCadenceFilter = (int8_t)type;
+        Serial.printf("Cadence filter set to: %s\n", name);
+    }
 
-    const char* stateNames[] = {"idle", "0kp", "6kp", "4kp", "2kp", "done"};
-    doc["state"] = stateNames[_calState];
-    doc["step"] = (int)_calState;
-    doc["adc"] = readAdcSmoothed();
-    doc["values"]["adc0"] = _calValues[0];
-    doc["values"]["adc2"] = _calValues[1];
-    doc["values"]["adc4"] = _calValues[2];
-    doc["values"]["adc6"] = _calValues[3];
+    request->send(200, "application/json", restart ? "{\"success\":true,\"message\":\"Restart required\"}"
+                                                   : "{\"success\":true}");
+}
+
+void PowerWebServer::handleGetOutput(AsyncWebServerRequest* request) {
+    JsonDocument doc;
+    doc["rate"] = _outputRate;
+    doc["perRev"] = _revTrigger;
+
+    JsonArray rates = doc["rates"].to<JsonArray>();
+    JsonArray load = doc["load"].to<JsonArray>();
+    for (uint8_t i = 0; i < PowerSource::OUTPUT_RATE_COUNT; i++) {
+        uint8_t hz = PowerSource::outputRateAt(i);
+        rates.add(hz);
+
+        // CPU load is only known for rates that have run for a full window.
+        // "source": the power task updating the source and publishing;
+        // "fanout": loop() handing the samples to BLE, web and workout.
+        const CpuMeter* source = _powerTask ? &_powerTask->getSourceMeter() : nullptr;
+        bool hasSource = source && source->hasLoad(i);
+        bool hasFanout = _cpuMeter && _cpuMeter->hasLoad(i);
+        if (!hasSource && !hasFanout) continue;
+        JsonObject o = load.add<JsonObject>();
+        o["rate"] = hz;
+        if (hasSource) writeLoad(o["source"].to<JsonObject>(), source->getLoad(i));
+        if (hasFanout) writeLoad(o["fanout"].to<JsonObject>(), _cpuMeter->getLoad(i));
+    }
+
+    writeTaskStats(doc["task"].to<JsonObject>());
+    writeBusStats(doc["bus"].to<JsonArray>());
+
+    String json;
+    serializeJson(doc, json);
+    request->send(200, "application/json", json);
+}
+
+void PowerWebServer::writeLoad(JsonObject o, const CpuMeter::Load& l) {
+    o["percent"] = l.percent;
+    o["usPerRun"] = l.usPerRun;
+    o["maxUs"] = l.maxUs;
+}
+
+void PowerWebServer::writeTaskStats(JsonObject task) {
+    PowerTaskStats st;
+    if (!_powerTask || !_powerTask->getStats(st)) return;
+
+    task["periodUs"] = st.periodUs;
+    task["minUs"] = st.minUs;
+    task["maxUs"] = st.maxUs;
+    task["meanUs"] = st.meanUs;
+    task["maxJitterUs"] = st.maxJitterUs;
+    task["maxUpdateUs"] = st.maxUpdateUs;
+    task["overruns"] = st.overruns;
+    task["samples"] = st.samples;
+    task["sourceLost"] = st.sourceLost;
+}
+
+void PowerWebServer::writeEdgeStats(JsonObject edges) {
+    CrankEdgeStats st;
+    if (!_power || !_power->getEdgeStats(st)) return;
+
+    edges["edges"] = st.edges;
+    edges["counted"] = st.counted;
+    edges["bounced"] = st.bounced;
+    edges["glitches"] = st.glitches;
+    edges["tooSoon"] = st.tooSoon;
+    edges["restarts"] = st.restarts;
+    edges["revPeriodUs"] = st.revPeriodUs;
+    edges["debounceUs"] = st.debounceUs;
+    edges["minRevPeriodUs"] = st.minRevPeriodUs;
+}
+
+void PowerWebServer::writeMagnetGaps(JsonArray magnets) {
+    if (!_power) return;
+    // Learned angle from the previous magnet, in degrees
+    float gaps[CrankPulses::MAX_PULSES_PER_REV];
+    uint8_t n = _power->getMagnetGaps(gaps);
+    for (uint8_t i = 0; i < n; i++) {
+        magnets.add(gaps[i] * 360.0f);
+    }
+}
+
+void PowerWebServer::writeCentrals(JsonArray centrals) {
+    if (!_ble) return;
+    BleCps::CentralStats st[BleCps::MAX_CENTRALS];
+    uint8_t n = _ble->getCentrals(st, BleCps::MAX_CENTRALS);
+    for (uint8_t i = 0; i < n; i++) {
+        JsonObject c = centrals.add<JsonObject>();
+        c["handle"] = st[i].connHandle;
+        c["cps"] = (st[i].subscriptions & BleServices::SERVICE_CPS) != 0;
+        c["csc"] = (st[i].subscriptions & BleServices::SERVICE_CSC) != 0;
+        c["ftms"] = (st[i].subscriptions & BleServices::SERVICE_FTMS) != 0;
+        c["notifies"] = st[i].notifies;
+        c["latencyUs"] = st[i].latencyUs;
+        c["maxLatencyUs"] = st[i].maxLatencyUs;
+    }
+}
+
+void PowerWebServer::writeBusStats(JsonArray subscribers) {
+    if (!_bus) return;
+    for (uint8_t i = 0; i < _bus->subscriberCount(); i++) {
+        const SampleBus::SubscriberStats& st = _bus->getStats(i);
+        JsonObject o = subscribers.add<JsonObject>();
+        o["name"] = st.name;
+        o["received"] = st.received;
+        o["lost"] = st.lost;
+        o["skipped"] = st.skipped;
+        o["lag"] = st.lag;
+        o["maxLag"] = st.maxLag;
+    }
+}
+
+void PowerWebServer::handleSetOutput(AsyncWebServerRequest* request, uint8_t* data, size_t len) {
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, data, len);
+
+    if (error) {
+        request->send(400, "application/json", "{\"success\":false,\"error\":\"Invalid JSON\"}");
+        return;
+    }
+
+    // Both fields are optional
+    if (doc["rate"].is<int>()) {
+        uint8_t hz = doc["rate"] | 0;
+        if (PowerSource::outputRateIndex(hz) < 0) {
+            request->send(400, "application/json", "{\"success\":false,\"error\":\"Rate must be 1, 2, 4 or 8 Hz\"}");
+            return;
+        }
+        _settings->saveOutputRate(hz);
+        _pendingOutputRate = hz;
+        Serial.printf("Output rate set to %u Hz via web\n", hz);
+    }
+
+    if (doc["perRev"].is<bool>()) {
+        bool perRev = doc["perRev"].as<bool>();
+        _settings->saveRevTrigger(perRev);
+        _pendingRevTrigger = perRev ? 1 : 0;
+        Serial.printf("Per-revolution notify set to: %s\n", perRev ? "ON" : "OFF");
+    }
+
+    request->send(200, "application/json", "{\"success\":true}");
+}
+
+void PowerWebServer::writeCalibrationStatus(JsonObject cal) {
+    const char* stateNames[] = {"idle", "capture", "done"};
+    cal["state"] = stateNames[_calState];
+    cal["step"] = (_calState == CAL_CAPTURE) ? _calStep + 1 : 0;
+    cal["steps"] = _calPlanCount;
+    if (_calState == CAL_CAPTURE) {
+        cal["target"] = _calPlan[_calStep];
+    }
+    cal["adc"] = readAdcSmoothed();
+
+    JsonArray values = cal["values"].to<JsonArray>();
+    uint8_t captured = (_calState == CAL_DONE) ? _calPlanCount : _calStep;
+    for (uint8_t i = 0; i < captured; i++) {
+        JsonObject o = values.add<JsonObject>();
+        o["kp"] = _calCaptured[i].kp;
+        o["adc"] = _calCaptured[i].adc;
+    }
+}
+
+void PowerWebServer::handleCalibrationStatus(AsyncWebServerRequest* request) {
+    JsonDocument doc;
+    writeCalibrationStatus(doc.to<JsonObject>());
 
     String json;
     serializeJson(doc, json);
     request->send(200, "application/json", json);
 }
 
+const char* PowerWebServer::parseCalibrationPlan(uint8_t* data, size_t len) {
+    JsonDocument doc;
+    if (deserializeJson(doc, data, len)) return "Invalid JSON";
+
+    float kps[MonarkCalibration::MAX_POINTS];
+    uint8_t count = 0;
+
+    if (doc["kp"].is<JsonArray>()) {
+        for (JsonVariant v : doc["kp"].as<JsonArray>()) {
+            if (count >= MonarkCalibration::MAX_POINTS) return "Too many calibration points";
+            if (!v.is<float>()) return "kp values must be numbers";
+            kps[count++] = v.as<float>();
+        }
+    } else if (!doc["maxKp"].isNull() || !doc["stepKp"].isNull()) {
+        // 0..maxKp in stepKp increments
+        float maxKp = doc["maxKp"] | 0.0f;
+        float stepKp = doc["stepKp"] | 0.0f;
+        if (!(maxKp > 0.0f) || !(stepKp > 0.0f)) return "maxKp and stepKp must be positive";
+        for (float kp = 0.0f; kp <= maxKp + 0.001f; kp += stepKp) {
+            if (count >= MonarkCalibration::MAX_POINTS) return "Too many calibration points";
+            kps[count++] = kp;
+        }
+    } else {
+        return nullptr;  // No plan: re-capture the current points
+    }
+
+    // Checked here, before any weight is hung: the capture would be
+    // rejected at save time otherwise
+    if (count < 2) return "At least 2 calibration points needed";
+    for (uint8_t i = 0; i < count; i++) {
+        if (!(kps[i] >= 0.0f) || !isfinite(kps[i])) return "kp values must be 0 or more";
+        if (i > 0 && !(kps[i] > kps[i - 1])) return "kp values must be increasing, without duplicates";
+    }
+    _calPlanCount = MonarkCalibration::captureOrder(kps, count, _calPlan);
+    _calPlanPending = true;
+    return nullptr;
+}
+
 void PowerWebServer::handleCalibrationStart(AsyncWebServerRequest* request) {
-    _calState = CAL_0KP;
-    _calValues[0] = _calValues[1] = _calValues[2] = _calValues[3] = 0;
-    Serial.println("Web calibration started");
+    // The body (if any) has been parsed by now
+    if (_calPlanError) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "{\"success\":false,\"error\":\"%s\"}", _calPlanError);
+        _calPlanError = nullptr;
+        _calPlanPending = false;
+        request->send(400, "application/json", msg);
+        return;
+    }
+    if (!_calPlanPending) {
+        // No plan in the body - re-capture the current kp points
+        float kps[MonarkCalibration::MAX_POINTS];
+        uint8_t n = _calibration->getPointCount();
+        for (uint8_t i = 0; i < n; i++) kps[i] = _calibration->getPoint(i).kp;
+        _calPlanCount = MonarkCalibration::captureOrder(kps, n, _calPlan);
+    }
+    _calPlanPending = false;
+
+    _calStep = 0;
+    _calState = CAL_CAPTURE;
+    Serial.printf("Web calibration started: %u points\n", _calPlanCount);
     request->send(200, "application/json", "{\"success\":true}");
 }
 
@@ -915,54 +1583,46 @@ void PowerWebServer::handleCalibrationNext(AsyncWebServerRequest* request) {
         return;
     }
 
-    // Read current smoothed ADC value
+    if (_calState == CAL_DONE) {
+        _calState = CAL_IDLE;
+        Serial.println("Web calibration finished");
+        request->send(200, "application/json", "{\"success\":true,\"message\":\"Calibration finished\"}");
+        return;
+    }
+
+    // Capture the 5-second mean of the ADC service
     float adcFloat = readAdcAvg();
     int adcValue = (int)roundf(adcFloat);
-    Serial.printf("Captured ADC: %.2f (rounded: %d) for state %d\n", adcFloat, adcValue, (int)_calState);
-
-    // Order: 0kp -> 6kp -> 4kp -> 2kp (easier to remove weights)
-    switch (_calState) {
-        case CAL_0KP:
-            _calValues[0] = adcValue;
-            _calState = CAL_6KP;
-            Serial.printf("0kp ADC: %d, moving to state %d (CAL_6KP)\n", adcValue, (int)_calState);
-            request->send(200, "application/json", "{\"success\":true,\"message\":\"Set pendulum to 6 kp and click Next\"}");
-            break;
-        case CAL_6KP:
-            _calValues[3] = adcValue;
-            _calState = CAL_4KP;
-            Serial.printf("6kp ADC: %d, moving to state %d (CAL_4KP)\n", adcValue, (int)_calState);
-            request->send(200, "application/json", "{\"success\":true,\"message\":\"Set pendulum to 4 kp and click Next\"}");
-            break;
-        case CAL_4KP:
-            _calValues[2] = adcValue;
-            _calState = CAL_2KP;
-            Serial.printf("4kp ADC: %d, moving to state %d (CAL_2KP)\n", adcValue, (int)_calState);
-            request->send(200, "application/json", "{\"success\":true,\"message\":\"Set pendulum to 2 kp and click Next\"}");
-            break;
-        case CAL_2KP:
-            _calValues[1] = adcValue;
-            Serial.printf("2kp ADC: %d\n", adcValue);
-
-            // Save calibration
-            _settings->saveCalibration(_calValues[0], _calValues[1], _calValues[2], _calValues[3]);
-            _calibration->updateValues(_calValues[0], _calValues[1], _calValues[2], _calValues[3]);
-
-            Serial.printf("Calibration saved: 0kp=%d 2kp=%d 4kp=%d 6kp=%d\n", _calValues[0], _calValues[1], _calValues[2], _calValues[3]);
-            _calState = CAL_DONE;
-            Serial.printf("Moving to state %d (CAL_DONE)\n", (int)_calState);
-            request->send(200, "application/json", "{\"success\":true,\"message\":\"Calibration complete and saved!\"}");
-            break;
-        case CAL_DONE:
-            _calState = CAL_IDLE;
-            Serial.printf("Moving to state %d (CAL_IDLE)\n", (int)_calState);
-            request->send(200, "application/json", "{\"success\":true,\"message\":\"Calibration finished\"}");
-            break;
-        default:
-            Serial.printf("ERROR: Unknown state %d in switch!\n", (int)_calState);
-            request->send(400, "application/json", "{\"success\":false,\"error\":\"Invalid state\"}");
-            break;
+    Serial.printf("Captured ADC: %.2f (rounded: %d) for %gkp (step %u/%u)\n",
+                  adcFloat, adcValue, _calPlan[_calStep], _calStep + 1, _calPlanCount);
+
+    // Order: lowest kp first, then highest down (easier to remove weights)
+    _calCaptured[_calStep] = {_calPlan[_calStep], adcValue};
+    _calStep++;
+
+    if (_calStep < _calPlanCount) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "{\"success\":true,\"message\":\"Set pendulum to %g kp and click Next\"}", _calPlan[_calStep]);
+        request->send(200, "application/json", msg);
+        return;
+    }
+
+    // All points captured - apply (loop() saves it), keeping the current fit
+    CalFit fit = _calibration->getFit();
+    if (!_calibration->updateValues(_calCaptured, _calPlanCount, fit)) {
+        _calState = CAL_IDLE;
+        request->send(400, "application/json", "{\"success\":false,\"error\":\"Invalid calibration\"}");
+        return;
     }
+
+    Serial.print("Calibration saved:");
+    for (uint8_t i = 0; i < _calPlanCount; i++) {
+        Serial.printf(" %gkp=%d", _calCaptured[i].kp, _calCaptured[i].adc);
+    }
+    Serial.println();
+
+    _calState = CAL_DONE;
+    request->send(200, "application/json", "{\"success\":true,\"message\":\"Calibration complete and saved!\"}");
 }
 
 void PowerWebServer::handleCalibrationCancel(AsyncWebServerRequest* request) {
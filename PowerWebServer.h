@@ -6,14 +6,35 @@
 #include "PowerSource.h"
 #include "SettingsManager.h"
 #include "Calibration.h"
+#include "AdcService.h"
+#include "CpuMeter.h"
+#include "PowerTask.h"
+
+class BleCps;
 
 class PowerWebServer {
 public:
-    PowerWebServer(SettingsManager* settings, MonarkCalibration* calibration, uint8_t adcPin);
+    PowerWebServer(SettingsManager* settings, MonarkCalibration* calibration, AdcService* adc);
 
     void begin(const char* apPassword = "monark123");
     void updatePowerData(const PowerSample& sample);
 
+    // Output rate: the loop reports the active rate and CPU meter, and
+    // applies changes requested over the web (0 = no pending change)
+    void setOutputRate(uint8_t hz) { _outputRate = hz; }
+    void setRevTrigger(bool enabled) { _revTrigger = enabled; }
+    void setCpuMeter(const CpuMeter* meter) { _cpuMeter = meter; }
+    void setPowerTask(const PowerTask* task) { _powerTask = task; }
+    void setSampleBus(const SampleBus* bus) { _bus = bus; }
+    void setPowerSource(const PowerSource* power) { _power = power; }
+    void setBle(const BleCps* ble) { _ble = ble; }
+    uint8_t takeOutputRateRequest();
+    int8_t takeRevTriggerRequest();  // -1 = no pending change
+
+    // Cadence filter: same pattern as the output rate
+    void setCadenceFilter(CadenceFilterType type) { _cadenceFilter = type; }
+    bool takeCadenceFilterRequest(CadenceFilterType& type);
+
     String getIPAddress() const;
     String getDeviceName() const { return _deviceName; }
     bool isAPMode() const { return _isAPMode; }
@@ -26,25 +47,38 @@ private:
     String _deviceName;
     String _apPassword;
     bool _isAPMode = true;
-    uint8_t _adcPin;
+    AdcService* _adc;
 
     // Current power data
     PowerSample _lastSample;
-    uint32_t _lastSampleTime = 0;
+    uint32_t _lastSampleTime = 0;  // Sample production time (Clock ms)
 
-    // Web calibration state (order: 0kp -> 6kp -> 4kp -> 2kp)
-    enum CalibState { CAL_IDLE, CAL_0KP, CAL_6KP, CAL_4KP, CAL_2KP, CAL_DONE };
-    CalibState _calState = CAL_IDLE;
-    int _calValues[4] = {0, 0, 0, 0};  // 0kp, 2kp, 4kp, 6kp
+    // Output rate (changes are applied by the loop, not the web task)
+    uint8_t _outputRate = 1;
+    volatile uint8_t _pendingOutputRate = 0;
+    bool _revTrigger = false;
+    volatile int8_t _pendingRevTrigger = -1;
+    CadenceFilterType _cadenceFilter = CadenceFilterType::Blend;
+    volatile int8_t _pendingCadenceFilter = -1;
+    const CpuMeter* _cpuMeter = nullptr;
+    const PowerTask* _powerTask = nullptr;
+    const SampleBus* _bus = nullptr;
+    const PowerSource* _power = nullptr;  // Read-only: reed switch gate stats
+    const BleCps* _ble = nullptr;         // Read-only: connected centrals
 
-    float readAdcQuick();  // Quick read (8 samples)
-    float readAdcSmoothed();  // Smoothed read for calibration display (~1s)
-    float readAdcAvg();    // 5-second smoothed read for calibration capture
+    // Web calibration state (order: lowest kp, then highest down)
+    enum CalibState { CAL_IDLE, CAL_CAPTURE, CAL_DONE };
+    CalibState _calState = CAL_IDLE;
+    float _calPlan[MonarkCalibration::MAX_POINTS];   // kp targets in capture order
+    uint8_t _calPlanCount = 0;
+    uint8_t _calStep = 0;
+    bool _calPlanPending = false;  // Plan parsed from the start request body
+    const char* _calPlanError = nullptr;  // Why that plan was rejected
+    CalPoint _calCaptured[MonarkCalibration::MAX_POINTS];
 
-    // ADC smoothing buffer for calibration display (~1 second at 200ms polling)
-    float _calAdcBuffer[20] = {0};
-    uint8_t _calAdcHead = 0;
-    uint8_t _calAdcCount = 0;
+    // Cached values from the shared ADC service - never blocks a handler
+    float readAdcSmoothed();  // 1-second mean for calibration display
+    float readAdcAvg();       // 5-second mean for calibration capture
 
     bool tryConnectWiFi();
     void startAPMode();
@@ -57,8 +91,19 @@ private:
     void handleGetWiFi(AsyncWebServerRequest* request);
     void handleSetWiFi(AsyncWebServerRequest* request, uint8_t* data, size_t len);
     void handleClearWiFi(AsyncWebServerRequest* request);
+    void handleGetOutput(AsyncWebServerRequest* request);
+    void writeLoad(JsonObject o, const CpuMeter::Load& l);
+    void writeTaskStats(JsonObject task);
+    void writeBusStats(JsonArray subscribers);
+    void writeEdgeStats(JsonObject edges);
+    void writeMagnetGaps(JsonArray magnets);
+    void writeCentrals(JsonArray centrals);
+    void handleSetOutput(AsyncWebServerRequest* request, uint8_t* data, size_t len);
+    void handleSetCadenceFilter(AsyncWebServerRequest* request, uint8_t* data, size_t len);
 
     // Calibration wizard
+    void writeCalibrationStatus(JsonObject cal);
+    const char* parseCalibrationPlan(uint8_t* data, size_t len);  // nullptr or why the plan is invalid
     void handleCalibrationStatus(AsyncWebServerRequest* request);
     void handleCalibrationStart(AsyncWebServerRequest* request);
     void handleCalibrationNext(AsyncWebServerRequest* request);
@@ -0,0 +1,57 @@
+#include "SampleBus.h"
+
+int8_t SampleBus::subscribe(const char* name) {
+  if (_count >= MAX_SUBSCRIBERS) return -1;
+  Subscriber& sub = _subs[_count];
+  sub.cursor = _ring.head();
+  sub.stats = SubscriberStats{};
+  sub.stats.name = name;
+  return (int8_t)_count++;
+}
+
+void SampleBus::publish(PowerSample& s) {
+  // Single producer: the next ring sequence is this sample's
+  s.bus_seq = _ring.head();
+  _ring.push(s);
+}
+
+void SampleBus::noteLag(Subscriber& sub, uint32_t head) {
+  uint32_t lag = head - sub.cursor;
+  sub.stats.lag = lag;
+  if (lag > sub.stats.maxLag) sub.stats.maxLag = lag;
+}
+
+bool SampleBus::read(int8_t id, PowerSample& out) {
+  Subscriber* sub = get(id);
+  if (!sub) return false;
+
+  uint32_t head = _ring.head();
+  if (head == sub->cursor) {
+    sub->stats.lag = 0;
+    return false;
+  }
+  noteLag(*sub, head);
+
+  if (_ring.read(sub->cursor, &out, 1, &sub->stats.lost) == 0) return false;
+  sub->stats.received++;
+  return true;
+}
+
+bool SampleBus::readLatest(int8_t id, PowerSample& out) {
+  Subscriber* sub = get(id);
+  if (!sub) return false;
+
+  uint32_t head = _ring.head();
+  if (head == sub->cursor) {
+    sub->stats.lag = 0;
+    return false;
+  }
+  noteLag(*sub, head);
+
+  // The producer may have moved on since head(); bus_seq tells what we got
+  if (!_ring.latest(out)) return false;
+  sub->stats.skipped += out.bus_seq - sub->cursor;
+  sub->cursor = out.bus_seq + 1;
+  sub->stats.received++;
+  return true;
+}
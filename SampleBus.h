@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+#include "PowerSample.h"
+#include "SpscRing.h"
+
+// Publish/subscribe bus for power samples. One producer (the power task)
+// publishes into a ring of timestamped samples; every subscriber reads
+// through its own cursor, so a slow consumer (display) can skip ahead to
+// the newest sample without holding back a fast one (BLE). A subscriber
+// that falls more than RING_SIZE behind loses the oldest samples; that is
+// counted, never blocks the producer.
+class SampleBus {
+public:
+  static const uint32_t RING_SIZE = 32;  // Power of two; 4s at 8Hz
+  static const uint8_t MAX_SUBSCRIBERS = 6;
+
+  struct SubscriberStats {
+    const char* name;
+    uint32_t received;  // Samples delivered
+    uint32_t lost;      // Overwritten before read()
+    uint32_t skipped;   // Passed over by readLatest()
+    uint32_t lag;       // Samples pending at the last read
+    uint32_t maxLag;
+  };
+
+  // Register a consumer (setup only). It sees samples published from now
+  // on. Returns its id, or -1 if MAX_SUBSCRIBERS are registered.
+  int8_t subscribe(const char* name);
+
+  // Producer: stamps s.bus_seq and publishes (source_seq is kept)
+  void publish(PowerSample& s);
+
+  // Next sample in order for subscriber 'id'. False when caught up.
+  bool read(int8_t id, PowerSample& out);
+
+  // Newest sample for subscriber 'id', skipping anything older. False if
+  // nothing new was published since its last read.
+  bool readLatest(int8_t id, PowerSample& out);
+
+  uint32_t published() const { return _ring.head(); }
+  uint8_t subscriberCount() const { return _count; }
+  const SubscriberStats& getStats(uint8_t id) const { return _subs[id < _count ? id : 0].stats; }
+
+private:
+  struct Subscriber {
+    uint32_t cursor;  // Sequence of the next sample to deliver
+    SubscriberStats stats;
+  };
+
+  SpscRing<PowerSample, RING_SIZE> _ring;
+  Subscriber _subs[MAX_SUBSCRIBERS] = {};
+  uint8_t _count = 0;
+
+  Subscriber* get(int8_t id) { return (id >= 0 && id < _count) ? &_subs[id] : nullptr; }
+  void noteLag(Subscriber& sub, uint32_t head);
+};
@@ -1,4 +1,5 @@
 #include "SettingsManager.h"
+#include "CrankPulses.h"
 
 SettingsManager::SettingsManager() {}
 
@@ -6,40 +7,67 @@ void SettingsManager::begin() {
     // Preferences library handles NVS initialization automatically on ESP32
 }
 
-void SettingsManager::saveCalibration(int adc0, int adc2, int adc4, int adc6) {
+void SettingsManager::saveCalibration(const CalPoint* points, uint8_t count, CalFit fit) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    if (count > MonarkCalibration::MAX_POINTS) count = MonarkCalibration::MAX_POINTS;
+
     preferences.begin(NAMESPACE, false); // false = read/write
-    preferences.putInt("adc0", adc0);
-    preferences.putInt("adc2", adc2);
-    preferences.putInt("adc4", adc4);
-    preferences.putInt("adc6", adc6);
+    preferences.putBytes("calpts", points, sizeof(CalPoint) * count);
+    preferences.putUChar("calfit", (uint8_t)fit);
+    // Drop the old fixed 4-point keys so they are not converted again
+    preferences.remove("adc0");
+    preferences.remove("adc2");
+    preferences.remove("adc4");
+    preferences.remove("adc6");
     preferences.end();
 }
 
-bool SettingsManager::loadCalibration(int& adc0, int& adc2, int& adc4, int& adc6) {
+bool SettingsManager::loadCalibration(CalPoint* points, uint8_t& count, CalFit& fit) {
+    std::lock_guard<std::mutex> lock(prefsLock);
     preferences.begin(NAMESPACE, true); // true = read-only
 
-    // Check if keys exist (simple check using one key)
-    if (!preferences.isKey("adc0")) {
-        preferences.end();
-        return false;
+    if (preferences.isKey("calpts")) {
+        size_t len = preferences.getBytesLength("calpts");
+        uint8_t n = (uint8_t)(len / sizeof(CalPoint));
+        if (len % sizeof(CalPoint) == 0 && n >= 2 && n <= MonarkCalibration::MAX_POINTS) {
+            preferences.getBytes("calpts", points, len);
+            // A non-monotone curve can't be fitted - use the defaults instead
+            if (MonarkCalibration::isMonotone(points, n)) {
+                count = n;
+                fit = (CalFit)preferences.getUChar("calfit", (uint8_t)CalFit::Linear);
+                preferences.end();
+                return true;
+            }
+        }
     }
 
-    adc0 = preferences.getInt("adc0", 78);
-    adc2 = preferences.getInt("adc2", 125);
-    adc4 = preferences.getInt("adc4", 177);
-    adc6 = preferences.getInt("adc6", 226);
+    // Legacy 4-point calibration (0/2/4/6 kp)
+    if (preferences.isKey("adc0")) {
+        points[0] = {0.0f, preferences.getInt("adc0", 78)};
+        points[1] = {2.0f, preferences.getInt("adc2", 125)};
+        points[2] = {4.0f, preferences.getInt("adc4", 177)};
+        points[3] = {6.0f, preferences.getInt("adc6", 226)};
+        if (MonarkCalibration::isMonotone(points, 4)) {
+            count = 4;
+            fit = CalFit::Linear;
+            preferences.end();
+            return true;
+        }
+    }
 
     preferences.end();
-    return true;
+    return false;
 }
 
 void SettingsManager::saveDeviceName(const char* name) {
+    std::lock_guard<std::mutex> lock(prefsLock);
     preferences.begin(NAMESPACE, false);
     preferences.putString("devname", name);
     preferences.end();
 }
 
 String SettingsManager::loadDeviceName(const char* defaultName) {
+    std::lock_guard<std::mutex> lock(prefsLock);
     preferences.begin(NAMESPACE, true);
     String name = preferences.getString("devname", defaultName);
     preferences.end();
@@ -47,12 +75,14 @@ String SettingsManager::loadDeviceName(const char* defaultName) {
 }
 
 void SettingsManager::saveCycleConstant(float value) {
+    std::lock_guard<std::mutex> lock(prefsLock);
     preferences.begin(NAMESPACE, false);
     preferences.putFloat("cyclec", value);
     preferences.end();
 }
 
 float SettingsManager::loadCycleConstant(float defaultValue) {
+    std::lock_guard<std::mutex> lock(prefsLock);
     preferences.begin(NAMESPACE, true);
     float value = preferences.getFloat("cyclec", defaultValue);
     preferences.end();
@@ -60,6 +90,7 @@ float SettingsManager::loadCycleConstant(float defaultValue) {
 }
 
 void SettingsManager::saveWiFi(const char* ssid, const char* password) {
+    std::lock_guard<std::mutex> lock(prefsLock);
     preferences.begin(NAMESPACE, false);
     preferences.putString("wifi_ssid", ssid);
     preferences.putString("wifi_pass", password);
@@ -67,6 +98,7 @@ void SettingsManager::saveWiFi(const char* ssid, const char* password) {
 }
 
 bool SettingsManager::loadWiFi(String& ssid, String& password) {
+    std::lock_guard<std::mutex> lock(prefsLock);
     preferences.begin(NAMESPACE, true);
     if (!preferences.isKey("wifi_ssid")) {
         preferences.end();
@@ -79,6 +111,7 @@ bool SettingsManager::loadWiFi(String& ssid, String& password) {
 }
 
 void SettingsManager::clearWiFi() {
+    std::lock_guard<std::mutex> lock(prefsLock);
     preferences.begin(NAMESPACE, false);
     preferences.remove("wifi_ssid");
     preferences.remove("wifi_pass");
@@ -86,14 +119,126 @@ void SettingsManager::clearWiFi() {
 }
 
 void SettingsManager::saveSimulatorMode(bool enabled) {
+    std::lock_guard<std::mutex> lock(prefsLock);
     preferences.begin(NAMESPACE, false);
     preferences.putBool("simulator", enabled);
     preferences.end();
 }
 
 bool SettingsManager::loadSimulatorMode(bool defaultValue) {
+    std::lock_guard<std::mutex> lock(prefsLock);
     preferences.begin(NAMESPACE, true);
     bool value = preferences.getBool("simulator", defaultValue);
     preferences.end();
     return value;
 }
+
+void SettingsManager::saveSimulatorConfig(SimProfile profile, uint32_t seed, uint8_t timeScale) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    preferences.begin(NAMESPACE, false);
+    preferences.putUChar("simprofile", (uint8_t)profile);
+    preferences.putUInt("simseed", seed);
+    preferences.putUChar("simscale", timeScale);
+    preferences.end();
+}
+
+void SettingsManager::loadSimulatorConfig(SimProfile& profile, uint32_t& seed, uint8_t& timeScale) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    preferences.begin(NAMESPACE, true);
+    uint8_t p = preferences.getUChar("simprofile", (uint8_t)SimProfile::Steady);
+    seed = preferences.getUInt("simseed", 1);
+    timeScale = preferences.getUChar("simscale", 1);
+    preferences.end();
+    profile = (p <= (uint8_t)SimProfile::CoastDown) ? (SimProfile)p : SimProfile::Steady;
+    if (timeScale == 0) timeScale = 1;
+}
+
+void SettingsManager::saveOutputRate(uint8_t hz) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    preferences.begin(NAMESPACE, false);
+    preferences.putUChar("outrate", hz);
+    preferences.end();
+}
+
+uint8_t SettingsManager::loadOutputRate(uint8_t defaultValue) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    preferences.begin(NAMESPACE, true);
+    uint8_t value = preferences.getUChar("outrate", defaultValue);
+    preferences.end();
+    return value;
+}
+
+void SettingsManager::saveRevTrigger(bool enabled) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    preferences.begin(NAMESPACE, false);
+    preferences.putBool("revtrigger", enabled);
+    preferences.end();
+}
+
+bool SettingsManager::loadRevTrigger(bool defaultValue) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    preferences.begin(NAMESPACE, true);
+    bool value = preferences.getBool("revtrigger", defaultValue);
+    preferences.end();
+    return value;
+}
+
+void SettingsManager::saveCadenceFilter(CadenceFilterType type) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    preferences.begin(NAMESPACE, false);
+    preferences.putUChar("cadfilter", (uint8_t)type);
+    preferences.end();
+}
+
+CadenceFilterType SettingsManager::loadCadenceFilter(CadenceFilterType defaultValue) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    preferences.begin(NAMESPACE, true);
+    uint8_t value = preferences.getUChar("cadfilter", (uint8_t)defaultValue);
+    preferences.end();
+    return value == (uint8_t)CadenceFilterType::AlphaBeta ? CadenceFilterType::AlphaBeta : CadenceFilterType::Blend;
+}
+
+void SettingsManager::savePulsesPerRev(uint8_t n) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    preferences.begin(NAMESPACE, false);
+    preferences.putUChar("pulsesrev", n);
+    preferences.end();
+}
+
+uint8_t SettingsManager::loadPulsesPerRev(uint8_t defaultValue) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    preferences.begin(NAMESPACE, true);
+    uint8_t value = preferences.getUChar("pulsesrev", defaultValue);
+    preferences.end();
+    return (value >= 1 && value <= CrankPulses::MAX_PULSES_PER_REV) ? value : defaultValue;
+}
+
+void SettingsManager::saveBleServices(uint8_t services) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    preferences.begin(NAMESPACE, false);
+    preferences.putUChar("bleservices", services);
+    preferences.end();
+}
+
+uint8_t SettingsManager::loadBleServices(uint8_t defaultValue) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    preferences.begin(NAMESPACE, true);
+    uint8_t value = preferences.getUChar("bleservices", defaultValue);
+    preferences.end();
+    return value;
+}
+
+void SettingsManager::saveCrankLength(uint16_t halfMm) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    preferences.begin(NAMESPACE, false);
+    preferences.putUShort("cranklen", halfMm);
+    preferences.end();
+}
+
+uint16_t SettingsManager::loadCrankLength(uint16_t defaultValue) {
+    std::lock_guard<std::mutex> lock(prefsLock);
+    preferences.begin(NAMESPACE, true);
+    uint16_t value = preferences.getUShort("cranklen", defaultValue);
+    preferences.end();
+    return (value >= BleServices::CRANK_LENGTH_MIN && value <= BleServices::CRANK_LENGTH_MAX) ? value : defaultValue;
+}
@@ -1,18 +1,28 @@
 #pragma once
 #include <Arduino.h>
 #include <Preferences.h>
+#include <mutex>
 #include "Calibration.h"
+#include "CadenceFilterType.h"
+#include "BleServices.h"
+#include "SimProfile.h"
 
+// NVS settings. Every call opens and closes the namespace on one shared
+// Preferences object under prefsLock, so the web server, BLE and loop()
+// tasks may call in at the same time.
 class SettingsManager {
 public:
     SettingsManager();
     void begin();
 
-    // Save calibration values
-    void saveCalibration(int adc0, int adc2, int adc4, int adc6);
+    // Save calibration points (up to MonarkCalibration::MAX_POINTS) and fit.
+    // Only loop() calls this, with a MonarkCalibration::getPoints() copy
+    void saveCalibration(const CalPoint* points, uint8_t count, CalFit fit);
 
-    // Load calibration values (returns true if loaded, false if defaults used)
-    bool loadCalibration(int& adc0, int& adc2, int& adc4, int& adc6);
+    // Load calibration points (returns true if loaded, false if defaults used).
+    // 'points' must hold MonarkCalibration::MAX_POINTS entries. Older 4-point
+    // settings (adc0/adc2/adc4/adc6) are converted on load.
+    bool loadCalibration(CalPoint* points, uint8_t& count, CalFit& fit);
 
     // Device name (used for BLE and WiFi)
     void saveDeviceName(const char* name);
@@ -31,7 +41,36 @@ public:
     void saveSimulatorMode(bool enabled);
     bool loadSimulatorMode(bool defaultValue = false);
 
+    // Simulator workload: profile, random seed and time scale (1 = real time)
+    void saveSimulatorConfig(SimProfile profile, uint32_t seed, uint8_t timeScale);
+    void loadSimulatorConfig(SimProfile& profile, uint32_t& seed, uint8_t& timeScale);
+
+    // Power sample output rate in Hz (1, 2, 4 or 8)
+    void saveOutputRate(uint8_t hz);
+    uint8_t loadOutputRate(uint8_t defaultValue = 1);
+
+    // Send a power sample on each crank revolution instead of on the timer
+    void saveRevTrigger(bool enabled);
+    bool loadRevTrigger(bool defaultValue = false);
+
+    // Cadence smoothing strategy
+    void saveCadenceFilter(CadenceFilterType type);
+    CadenceFilterType loadCadenceFilter(CadenceFilterType defaultValue = CadenceFilterType::Blend);
+
+    // Crank magnets: cadence pulses per revolution (1-4)
+    void savePulsesPerRev(uint8_t n);
+    uint8_t loadPulsesPerRev(uint8_t defaultValue = 1);
+
+    // BLE services to register (BleServices::SERVICE_* bitmask)
+    void saveBleServices(uint8_t services);
+    uint8_t loadBleServices(uint8_t defaultValue = BleServices::SERVICES_DEFAULT);
+
+    // Crank length reported over CPS, in 0.5 mm (set by apps)
+    void saveCrankLength(uint16_t halfMm);
+    uint16_t loadCrankLength(uint16_t defaultValue = BleServices::CRANK_LENGTH_DEFAULT);
+
 private:
     Preferences preferences;
+    std::mutex prefsLock;  // Held from preferences.begin() to end()
     const char* NAMESPACE = "monark";
 };
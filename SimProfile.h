@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+
+// Rider workload the simulator follows (PowerSimulator). Kept apart so
+// settings can store one without pulling in the simulator.
+enum class SimProfile : uint8_t {
+  Steady = 0,     // 90 rpm at 2 kp
+  Intervals = 1,  // 4 min hard / 2 min easy
+  Sprints = 2,    // 10 s sprint every minute
+  CoastDown = 3   // 30 s pedalling, 30 s coasting
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+// Wait-free single-producer / single-consumer ring with free-running
+// sequence counters. The producer (e.g. an ISR) never blocks and never
+// waits for the consumer: once the consumer falls more than N entries
+// behind, the oldest entries are overwritten and the consumer sees the gap
+// through the sequence numbers instead of reading torn data.
+// No interrupt masking is needed on either side.
+template <typename T, uint32_t N>
+class SpscRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+  // ---- Producer side ----
+  // always_inline so the ISR does not call into flash
+  inline __attribute__((always_inline)) void push(const T& v) {
+    uint32_t seq = _head.load(std::memory_order_relaxed);
+    _buf[seq & (N - 1)] = v;
+    _head.store(seq + 1, std::memory_order_release);
+  }
+
+  // ---- Consumer side ----
+  // Sequence number of the next entry to be written (= total pushed)
+  uint32_t head() const { return _head.load(std::memory_order_acquire); }
+
+  // Copy up to 'max' entries pushed since 'cursor' into 'out', oldest first,
+  // and advance 'cursor'. Entries overwritten before they could be read are
+  // skipped and added to 'lost' (if given). Returns the number copied.
+  uint32_t read(uint32_t& cursor, T* out, uint32_t max, uint32_t* lost = nullptr) const {
+    uint32_t h = head();
+    uint32_t skipped = 0;
+
+    if (h - cursor > N) {
+      skipped += (h - N) - cursor;
+      cursor = h - N;
+    }
+    uint32_t n = h - cursor;
+    if (n > max) n = max;
+
+    for (uint32_t i = 0; i < n; i++) {
+      out[i] = _buf[(cursor + i) & (N - 1)];
+    }
+
+    // Anything the producer lapped while we were copying may be torn - drop
+    // it, including the slot of the push that may be in progress (seq h2)
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t h2 = _head.load(std::memory_order_relaxed);
+    if (h2 - cursor >= N) {
+      uint32_t torn = (h2 - N) - cursor + 1;
+      if (torn > n) torn = n;
+      for (uint32_t i = torn; i < n; i++) out[i - torn] = out[i];
+      n -= torn;
+      cursor += torn;
+      skipped += torn;
+    }
+
+    cursor += n;
+    if (lost) *lost += skipped;
+    return n;
+  }
+
+  // Copy the newest entry without consuming anything. Safe to call from
+  // any number of readers. Returns false if nothing has been pushed yet.
+  bool latest(T& out) const {
+    for (;;) {
+      uint32_t h = head();
+      if (h == 0) return false;
+      out = _buf[(h - 1) & (N - 1)];
+      std::atomic_thread_fence(std::memory_order_acquire);
+      // Retry if the producer lapped the slot while we copied it, or may be
+      // writing it right now (push of seq h - 1 + N not yet published)
+      if (_head.load(std::memory_order_relaxed) - h < N - 1) return true;
+    }
+  }
+
+private:
+  T _buf[N];
+  std::atomic<uint32_t> _head{0};
+};
@@ -1,4 +1,5 @@
 #include "Workout.h"
+#include "Clock.h"
 
 Workout::Workout() {
     _state = STOPPED;
@@ -6,7 +7,7 @@ Workout::Workout() {
 
 void Workout::start() {
     if (_state == STOPPED) {
-        _startTime = millis();
+        _startTime = Clock::nowMs();
         _lapStartTime = _startTime;
         _totalPausedMs = 0;
         _lapPausedMs = 0;
@@ -21,14 +22,14 @@ void Workout::start() {
 
 void Workout::pause() {
     if (_state == RUNNING) {
-        _pausedTime = millis();
+        _pausedTime = Clock::nowMs();
         _state = PAUSED;
     }
 }
 
 void Workout::resume() {
     if (_state == PAUSED) {
-        uint32_t pauseDuration = millis() - _pausedTime;
+        uint64_t pauseDuration = Clock::nowMs() - _pausedTime;
         _totalPausedMs += pauseDuration;
         _lapPausedMs += pauseDuration;
         _state = RUNNING;
@@ -52,7 +53,7 @@ void Workout::lap() {
     _lapCount++;
 
     // Reset lap stats
-    _lapStartTime = millis();
+    _lapStartTime = Clock::nowMs();
     _lapPausedMs = 0;
     _lapPowerSum = 0;
     _lapSampleCount = 0;
@@ -71,15 +72,15 @@ void Workout::addPowerSample(float power) {
 uint32_t Workout::getElapsedMs() const {
     if (_state == STOPPED) return 0;
 
-    uint32_t now = (_state == PAUSED) ? _pausedTime : millis();
-    return (now - _startTime) - _totalPausedMs;
+    uint64_t now = (_state == PAUSED) ? _pausedTime : Clock::nowMs();
+    return (uint32_t)((now - _startTime) - _totalPausedMs);
 }
 
 uint32_t Workout::getCurrentLapMs() const {
     if (_state == STOPPED) return 0;
 
-    uint32_t now = (_state == PAUSED) ? _pausedTime : millis();
-    return (now - _lapStartTime) - _lapPausedMs;
+    uint64_t now = (_state == PAUSED) ? _pausedTime : Clock::nowMs();
+    return (uint32_t)((now - _lapStartTime) - _lapPausedMs);
 }
 
 float Workout::getTotalAvgPower() const {
@@ -49,12 +49,13 @@ public:
 private:
     State _state = STOPPED;
 
-    uint32_t _startTime = 0;
-    uint32_t _pausedTime = 0;
-    uint32_t _totalPausedMs = 0;
+    // Timestamps from Clock::nowMs() (64-bit, never wraps)
+    uint64_t _startTime = 0;
+    uint64_t _pausedTime = 0;
+    uint64_t _totalPausedMs = 0;
 
-    uint32_t _lapStartTime = 0;
-    uint32_t _lapPausedMs = 0;
+    uint64_t _lapStartTime = 0;
+    uint64_t _lapPausedMs = 0;
 
     // Total stats
     float _totalPowerSum = 0;
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdio.h>
+
+// Minimal host test helpers: CHECK records a failure and keeps going,
+// finish() prints the verdict and gives the exit code for ctest.
+static int g_failures = 0;
+
+#define CHECK(cond, ...)                                       \
+  do {                                                         \
+    if (!(cond)) {                                             \
+      g_failures++;                                            \
+      printf("FAIL %s:%d: %s: ", __FILE__, __LINE__, #cond);   \
+      printf(__VA_ARGS__);                                     \
+      printf("\n");                                            \
+    }                                                          \
+  } while (0)
+
+static inline int finish(const char* name) {
+  printf("%s: %s\n", name, g_failures ? "FAILED" : "ok");
+  return g_failures ? 1 : 0;
+}
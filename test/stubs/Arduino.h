@@ -0,0 +1,58 @@
+#pragma once
+// Host stand-in for the few Arduino/FreeRTOS pieces the tested sources use
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#define IRAM_ATTR
+#define INPUT_PULLUP 2
+#define INPUT 1
+#define OUTPUT 3
+#define LOW 0
+#define HIGH 1
+#define CHANGE 3
+#define FALLING 2
+#define RISING 1
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFF
+#define portYIELD_FROM_ISR() do {} while (0)
+#define pdMS_TO_TICKS(x) (x)
+typedef void* TaskHandle_t;
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+typedef unsigned int UBaseType_t;
+inline void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t*) {}
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return (TaskHandle_t)1; }
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+inline BaseType_t xTaskCreatePinnedToCore(void(*)(void*), const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*, BaseType_t) { return pdPASS; }
+inline void vTaskDelay(TickType_t) {}
+inline void pinMode(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return HIGH; }
+inline int digitalPinToInterrupt(int p) { return p; }
+inline void attachInterrupt(int, void(*)(), int) {}
+inline void delay(uint32_t) {}
+inline void yield() {}
+inline unsigned long millis() { return 0; }
+inline unsigned long micros() { return 0; }
+class String : public std::string {
+public:
+  String() {}
+  String(const char* s) : std::string(s ? s : "") {}
+  String(const std::string& s) : std::string(s) {}
+  String(int v) : std::string(std::to_string(v)) {}
+  const char* c_str() const { return std::string::c_str(); }
+  unsigned length() const { return (unsigned)size(); }
+};
+struct SerialStub {
+  template <typename... A> int printf(const char* f, A... a) { return ::printf(f, a...); }
+  void println(const char* s = "") { ::puts(s); }
+  void println(const String& s) { ::puts(s.c_str()); }
+  void print(const char* s) { ::fputs(s, stdout); }
+  void begin(int) {}
+  void flush() {}
+};
+inline SerialStub Serial;
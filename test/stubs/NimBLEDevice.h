@@ -0,0 +1,176 @@
+#pragma once
+// Host stand-in for the slice of NimBLE-Arduino 2.x that BleCps uses.
+// Nothing goes over the air: notifications and indications are recorded
+// in fakeBle, and a test plays the central by calling the callbacks BleCps
+// registered (connect, subscribe, write).
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#define ESP_PWR_LVL_P9 9
+
+class NimBLECharacteristic;
+class NimBLEServerCallbacks;
+
+struct NimBLEUUID {
+  uint16_t uuid16;
+  NimBLEUUID(uint16_t v) : uuid16(v) {}
+};
+
+struct NimBLEConnInfo {
+  uint16_t connHandle;
+  uint16_t getConnHandle() const { return connHandle; }
+};
+
+struct NimBLEAttValue {
+  std::vector<uint8_t> bytes;
+  const uint8_t* data() const { return bytes.data(); }
+  size_t size() const { return bytes.size(); }
+};
+
+namespace NIMBLE_PROPERTY {
+enum { READ = 0x02, WRITE = 0x08, NOTIFY = 0x10, INDICATE = 0x20 };
+}
+
+// Everything the stack was asked to send, plus the connection state
+struct FakeBle {
+  struct Sent {
+    uint16_t uuid;
+    uint16_t connHandle;  // 0xFFFF: all subscribers
+    bool indication;
+    std::vector<uint8_t> payload;
+  };
+  std::vector<NimBLECharacteristic*> characteristics;
+  std::vector<Sent> sent;
+  NimBLEServerCallbacks* server = nullptr;
+  uint8_t connected = 0;
+  uint32_t advertisingStarts = 0;
+  bool refuseNotify = false;  // Act out of buffers
+
+  NimBLECharacteristic* find(uint16_t uuid) const;
+  uint32_t count(uint16_t uuid, uint16_t connHandle, bool indication = false) const {
+    uint32_t n = 0;
+    for (const Sent& s : sent) {
+      if (s.uuid == uuid && s.connHandle == connHandle && s.indication == indication) n++;
+    }
+    return n;
+  }
+};
+inline FakeBle fakeBle;
+
+class NimBLECharacteristicCallbacks {
+public:
+  virtual ~NimBLECharacteristicCallbacks() {}
+  virtual void onWrite(NimBLECharacteristic*, NimBLEConnInfo&) {}
+  virtual void onSubscribe(NimBLECharacteristic*, NimBLEConnInfo&, uint16_t) {}
+};
+
+class NimBLECharacteristic {
+public:
+  explicit NimBLECharacteristic(uint16_t uuid) : uuid(uuid) {}
+
+  void setValue(const uint8_t* data, size_t len) { value.bytes.assign(data, data + len); }
+  NimBLEAttValue getValue() const { return value; }
+  void setCallbacks(NimBLECharacteristicCallbacks* cb) { callbacks = cb; }
+
+  bool notify(uint16_t connHandle = 0xFFFF) { return send(value.data(), value.size(), connHandle, false); }
+  bool notify(const uint8_t* data, size_t len, uint16_t connHandle = 0xFFFF) {
+    return send(data, len, connHandle, false);
+  }
+  bool indicate(uint16_t connHandle = 0xFFFF) { return send(value.data(), value.size(), connHandle, true); }
+
+  // Test side: what a central does
+  void write(uint16_t connHandle, std::vector<uint8_t> data) {
+    value.bytes = data;
+    NimBLEConnInfo info{connHandle};
+    if (callbacks) callbacks->onWrite(this, info);
+  }
+  void subscribe(uint16_t connHandle, uint16_t subValue) {
+    NimBLEConnInfo info{connHandle};
+    if (callbacks) callbacks->onSubscribe(this, info, subValue);
+  }
+
+  const uint16_t uuid;
+
+private:
+  NimBLEAttValue value;
+  NimBLECharacteristicCallbacks* callbacks = nullptr;
+
+  bool send(const uint8_t* data, size_t len, uint16_t connHandle, bool indication) {
+    if (fakeBle.refuseNotify) return false;
+    fakeBle.sent.push_back({uuid, connHandle, indication, std::vector<uint8_t>(data, data + len)});
+    return true;
+  }
+};
+
+inline NimBLECharacteristic* FakeBle::find(uint16_t uuid) const {
+  for (NimBLECharacteristic* c : characteristics) {
+    if (c->uuid == uuid) return c;
+  }
+  return nullptr;
+}
+
+class NimBLEService {
+public:
+  NimBLECharacteristic* createCharacteristic(NimBLEUUID uuid, uint32_t) {
+    NimBLECharacteristic* c = new NimBLECharacteristic(uuid.uuid16);
+    fakeBle.characteristics.push_back(c);
+    return c;
+  }
+  bool start() { return true; }
+};
+
+class NimBLEServer;
+
+class NimBLEServerCallbacks {
+public:
+  virtual ~NimBLEServerCallbacks() {}
+  virtual void onConnect(NimBLEServer*, NimBLEConnInfo&) {}
+  virtual void onDisconnect(NimBLEServer*, NimBLEConnInfo&, int) {}
+};
+
+class NimBLEServer {
+public:
+  NimBLEService* createService(NimBLEUUID) { return new NimBLEService; }
+  void setCallbacks(NimBLEServerCallbacks* cb) { fakeBle.server = cb; }
+  uint8_t getConnectedCount() const { return fakeBle.connected; }
+};
+
+class NimBLEAdvertising {
+public:
+  bool addServiceUUID(NimBLEUUID) { return true; }
+  bool setServiceData(const NimBLEUUID&, const uint8_t*, size_t) { return true; }
+  bool start() {
+    fakeBle.advertisingStarts++;
+    return true;
+  }
+};
+
+class NimBLEDevice {
+public:
+  static void init(const char*) {}
+  static void setPower(int) {}
+  static NimBLEServer* createServer() {
+    static NimBLEServer server;
+    return &server;
+  }
+  static NimBLEAdvertising* getAdvertising() {
+    static NimBLEAdvertising adv;
+    return &adv;
+  }
+  static bool startAdvertising() { return getAdvertising()->start(); }
+};
+
+// Test side: a central connecting and dropping (the stack stops
+// advertising on connect)
+inline void fakeConnect(uint16_t connHandle) {
+  fakeBle.connected++;
+  NimBLEConnInfo info{connHandle};
+  fakeBle.server->onConnect(NimBLEDevice::createServer(), info);
+}
+
+inline void fakeDisconnect(uint16_t connHandle) {
+  fakeBle.connected--;
+  NimBLEConnInfo info{connHandle};
+  fakeBle.server->onDisconnect(NimBLEDevice::createServer(), info, 0x13);
+}
@@ -0,0 +1,3 @@
+#pragma once
+// Host stand-in: no IRAM placement off target
+#define IRAM_ATTR
@@ -0,0 +1,109 @@
+// Synthetic pendulum steps at 100 Hz with 1.5 mV of noise, through
+// AdcStepFilter and the plain 1 s running mean it replaces for power.
+// The pendulum settles exponentially (fast or slow) with or without a
+// swing. Settle time is how long until the output stays within 1 mV of
+// the new level (about 0.04 kp). The step filter must never settle later
+// than the 1 s mean, must follow fast steps well inside a second, and
+// must smooth as much as the 1 s mean while settled.
+#include "AdcStepFilter.h"
+#include "TestCheck.h"
+#include <math.h>
+
+static const float RATE_HZ = 100.0f;
+static const float STEP_AT_S = 3.0f;
+static const float END_S = 10.0f;
+static const uint32_t MEAN_LEN = 100;  // 1 s
+static const float SETTLED_MV = 1.0f;
+
+static uint32_t g_rng = 7;
+static float noise() {
+  // Sum of three uniforms: roughly normal, within +/-1.5 mV
+  float sum = 0.0f;
+  for (int i = 0; i < 3; i++) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    sum += (float)(g_rng >> 8) / 16777216.0f * 2.0f - 1.0f;
+  }
+  return sum * 1.5f;
+}
+
+struct StepResult {
+  float settleS;      // Step filter
+  float meanSettleS;  // 1 s mean
+  float rmsMv;        // Settled error before the step, step filter
+  float meanRmsMv;    // ... and 1 s mean
+  uint32_t falseSteps;  // Restarts while settled
+};
+
+static StepResult runStep(float fromMv, float toMv, float tauS, bool swing) {
+  AdcStepFilter filter(MEAN_LEN);
+  float ring[MEAN_LEN] = {0};
+  double meanSum = 0.0;
+  uint32_t meanLen = 0;
+
+  StepResult r = {-1.0f, -1.0f, 0.0f, 0.0f, 0};
+  double sq = 0.0, meanSq = 0.0;
+  uint32_t n = 0, stepsBefore = 0;
+  uint32_t total = (uint32_t)(END_S * RATE_HZ);
+  for (uint32_t i = 0; i < total; i++) {
+    float t = (float)i / RATE_HZ;
+    float level = fromMv;
+    if (t >= STEP_AT_S) {
+      float s = t - STEP_AT_S;
+      float left = expf(-s / tauS) * (swing ? cosf(2.0f * (float)M_PI * 1.5f * s) : 1.0f);
+      level = toMv + (fromMv - toMv) * left;
+    }
+    float mv = level + noise();
+
+    float out = filter.push(mv);
+    meanSum += mv - ring[i % MEAN_LEN];
+    ring[i % MEAN_LEN] = mv;
+    if (meanLen < MEAN_LEN) meanLen++;
+    float mean = (float)(meanSum / meanLen);
+
+    if (t >= STEP_AT_S) {
+      float s = t - STEP_AT_S;
+      if (fabsf(out - toMv) > SETTLED_MV) r.settleS = -1.0f;
+      else if (r.settleS < 0.0f) r.settleS = s;
+      if (fabsf(mean - toMv) > SETTLED_MV) r.meanSettleS = -1.0f;
+      else if (r.meanSettleS < 0.0f) r.meanSettleS = s;
+    } else if (t >= STEP_AT_S / 2.0f) {
+      // Settled half before the step: full windows on both
+      if (n == 0) stepsBefore = filter.steps();
+      sq += (out - fromMv) * (out - fromMv);
+      meanSq += (mean - fromMv) * (mean - fromMv);
+      n++;
+      r.falseSteps = filter.steps() - stepsBefore;
+    }
+  }
+  r.rmsMv = (float)sqrt(sq / n);
+  r.meanRmsMv = (float)sqrt(meanSq / n);
+  return r;
+}
+
+int main() {
+  // kp 2, 3 and 4 in mV at the ADC pin, both ways, a big and a small step
+  const float steps[][2] = {{125.0f, 177.0f}, {177.0f, 125.0f}, {78.0f, 226.0f}, {125.0f, 130.0f}};
+  const float taus[] = {0.05f, 0.3f};
+
+  for (const auto& st : steps) {
+    for (float tau : taus) {
+      for (int swing = 0; swing < 2; swing++) {
+        StepResult r = runStep(st[0], st[1], tau, swing != 0);
+        printf("%3.0f -> %3.0f mV, tau %.2f s%s: settle %.2f s (1 s mean %.2f s), settled rms %.3f mV (%.3f mV)\n",
+               st[0], st[1], tau, swing ? ", swing" : "       ", r.settleS, r.meanSettleS, r.rmsMv, r.meanRmsMv);
+        CHECK(r.settleS >= 0.0f, "%.0f -> %.0f mV never settled", st[0], st[1]);
+        CHECK(r.settleS <= r.meanSettleS + 0.01f, "%.0f -> %.0f mV, tau %.2f: %.2f s, slower than the 1 s mean (%.2f s)",
+              st[0], st[1], tau, r.settleS, r.meanSettleS);
+        if (tau < 0.1f) {
+          CHECK(r.settleS < 0.7f, "%.0f -> %.0f mV, fast step: %.2f s to settle", st[0], st[1], r.settleS);
+        }
+        CHECK(r.rmsMv <= r.meanRmsMv * 1.1f, "%.0f -> %.0f mV: settled rms %.3f mV vs %.3f mV for the 1 s mean",
+              st[0], st[1], r.rmsMv, r.meanRmsMv);
+        CHECK(r.falseSteps == 0, "%.0f -> %.0f mV: %u restarts on noise alone", st[0], st[1], r.falseSteps);
+      }
+    }
+  }
+  return finish("test_adc_step_filter");
+}
@@ -0,0 +1,249 @@
+// BleCps against a fake NimBLE (test/stubs/NimBLEDevice.h) with several
+// centrals: each connection handle must receive exactly the measurements
+// it subscribed to, advertising must keep going while there is a free
+// connection, and FTMS control must belong to one central at a time.
+// Measurements nobody subscribed to are skipped, not sent. CPS and FTMS
+// Control Point requests are queued per central and every response, errors
+// included, goes out from the task that takes them.
+#include "BleCps.h"
+#include "Clock.h"
+#include "TestCheck.h"
+#include <NimBLEDevice.h>
+
+static const uint16_t CPM = 0x2A63;   // Cycling Power Measurement
+static const uint16_t CSM = 0x2A5B;   // CSC Measurement
+static const uint16_t IBD = 0x2AD2;   // Indoor Bike Data
+static const uint16_t FMCP = 0x2AD9;  // Fitness Machine Control Point
+static const uint16_t CPCP = 0x2A66;  // Cycling Power Control Point
+
+static const uint16_t NOTIFY = 0x0001;
+static const uint16_t INDICATE = 0x0002;
+
+// What loop() does with FTMS Control Point requests: takes each one, applies
+// it (here: remembers the command) and answers it
+static FtmsCommand applied = FtmsCommand::None;
+
+static void serveFtms(BleCps& ble) {
+  FtmsControlRequest req;
+  while (ble.takeFtmsRequest(req)) {
+    applied = req.cmd;
+    ble.respondFtms(req, BlePackets::FTMS_SUCCESS);
+  }
+}
+
+// Writes an FTMS Control Point request, returns the result code indicated
+// back. Nothing may be indicated before loop() serves the request.
+static uint8_t ftmsWrite(BleCps& ble, uint16_t handle, std::vector<uint8_t> req) {
+  size_t before = fakeBle.sent.size();
+  fakeBle.find(FMCP)->write(handle, req);
+  if (fakeBle.sent.size() != before) return 0;
+  serveFtms(ble);
+  if (fakeBle.sent.size() != before + 1) return 0;
+  const FakeBle::Sent& r = fakeBle.sent.back();
+  if (!r.indication || r.connHandle != handle || r.payload.size() != 3) return 0;
+  return r.payload[2];
+}
+
+static void sendSamples(BleCps& ble, uint32_t n) {
+  PowerSample s{};
+  for (uint32_t i = 0; i < n; i++) {
+    s.timestamp_us = Clock::nowUs();
+    Clock::advanceVirtual(50000);
+    ble.notify(s);
+  }
+}
+
+static void testNoSubscribers(BleCps& ble) {
+  // Nothing connected, then a central that has not subscribed yet
+  sendSamples(ble, 10);
+  fakeConnect(9);
+  sendSamples(ble, 10);
+  fakeDisconnect(9);
+  const BleCps::NotifyStats& st = ble.getNotifyStats();
+  CHECK(st.sent == 0 && st.skipped == 60 && st.failed == 0, "no subscribers: sent %u, skipped %u, failed %u",
+        st.sent, st.skipped, st.failed);
+  CHECK(fakeBle.sent.empty(), "%zu notifications with no subscribers", fakeBle.sent.size());
+}
+
+static void testCentrals(BleCps& ble) {
+  uint32_t adv = fakeBle.advertisingStarts;
+  fakeConnect(1);
+  fakeConnect(2);
+  CHECK(fakeBle.advertisingStarts == adv + 2, "advertising restarted %u times for two connects",
+        fakeBle.advertisingStarts - adv);
+  fakeConnect(3);
+  CHECK(fakeBle.advertisingStarts == adv + 2, "advertising restarted with all %u connections taken",
+        BleCps::MAX_CENTRALS);
+
+  // 1: power; 2: speed/cadence and bike data; 3: power, then unsubscribed
+  fakeBle.find(CPM)->subscribe(1, NOTIFY);
+  fakeBle.find(CSM)->subscribe(2, NOTIFY);
+  fakeBle.find(IBD)->subscribe(2, NOTIFY);
+  fakeBle.find(CPM)->subscribe(3, NOTIFY);
+  fakeBle.find(CPM)->subscribe(3, 0);
+
+  // Live counters, and a copy taken before each step
+  const BleCps::NotifyStats& stats = ble.getNotifyStats();
+  fakeBle.sent.clear();
+  BleCps::NotifyStats before = stats;
+  sendSamples(ble, 30);
+  const uint16_t uuids[] = {CPM, CSM, IBD};
+  const uint32_t want[3][3] = {{30, 0, 0}, {0, 30, 30}, {0, 0, 0}};
+  for (uint16_t h = 1; h <= 3; h++) {
+    for (int u = 0; u < 3; u++) {
+      uint32_t got = fakeBle.count(uuids[u], h);
+      CHECK(got == want[h - 1][u], "central %u got %u notifications of %04x, want %u", h, got, uuids[u],
+            want[h - 1][u]);
+    }
+  }
+  CHECK(fakeBle.sent.size() == 90, "%zu notifications in all, want 90", fakeBle.sent.size());
+
+  // Every measurement was wanted by someone
+  CHECK(stats.sent - before.sent == 90 && stats.skipped == before.skipped, "sent %u, skipped %u",
+        stats.sent - before.sent, stats.skipped - before.skipped);
+
+  BleCps::CentralStats st[BleCps::MAX_CENTRALS];
+  uint8_t n = ble.getCentrals(st, BleCps::MAX_CENTRALS);
+  CHECK(n == 3, "%u centrals listed", n);
+  const uint8_t subs[3] = {BleServices::SERVICE_CPS, BleServices::SERVICE_CSC | BleServices::SERVICE_FTMS, 0};
+  uint32_t perCentral = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    CHECK(st[i].connHandle == i + 1, "central %u listed with handle %u", i + 1, st[i].connHandle);
+    CHECK(st[i].subscriptions == subs[i], "central %u subscriptions 0x%02x", st[i].connHandle, st[i].subscriptions);
+    perCentral += st[i].notifies;
+  }
+  CHECK(perCentral == stats.sent, "per-central notifies add up to %u, sent %u", perCentral, stats.sent);
+
+  // Only central 1 wants power: the other two measurements are skipped
+  fakeBle.find(CSM)->subscribe(2, 0);
+  fakeBle.find(IBD)->subscribe(2, 0);
+  before = stats;
+  sendSamples(ble, 10);
+  CHECK(stats.sent - before.sent == 10 && stats.skipped - before.skipped == 20, "power only: sent %u, skipped %u",
+        stats.sent - before.sent, stats.skipped - before.skipped);
+
+  // The stack refusing a notify is counted, not sent
+  fakeBle.refuseNotify = true;
+  before = stats;
+  sendSamples(ble, 5);
+  fakeBle.refuseNotify = false;
+  CHECK(stats.failed - before.failed == 5 && stats.sent == before.sent, "refused: failed %u, sent %u",
+        stats.failed - before.failed, stats.sent - before.sent);
+
+  fakeDisconnect(3);
+  CHECK(ble.getCentrals(st, BleCps::MAX_CENTRALS) == 2, "disconnected central still listed");
+}
+
+static void testFtmsOwnership(BleCps& ble) {
+  NimBLECharacteristic* cp = fakeBle.find(FMCP);
+  cp->subscribe(1, INDICATE);
+  cp->subscribe(2, INDICATE);
+
+  // Only the owner may start; a second central is refused until the owner drops
+  CHECK(ftmsWrite(ble, 1, {0x07}) == BlePackets::FTMS_CONTROL_NOT_PERMITTED, "start without control");
+  CHECK(ftmsWrite(ble, 1, {0x00}) == BlePackets::FTMS_SUCCESS, "central 1 request control");
+  CHECK(ftmsWrite(ble, 2, {0x00}) == BlePackets::FTMS_CONTROL_NOT_PERMITTED,
+        "central 2 request control while 1 owns it");
+  CHECK(ftmsWrite(ble, 2, {0x07}) == BlePackets::FTMS_CONTROL_NOT_PERMITTED, "central 2 start while 1 owns it");
+  CHECK(applied == FtmsCommand::None, "refused start or request control was applied");
+  CHECK(ftmsWrite(ble, 1, {0x07}) == BlePackets::FTMS_SUCCESS, "owner start");
+  CHECK(applied == FtmsCommand::Start, "owner start not applied");
+
+  // Both write before loop() runs: each gets its own response
+  fakeBle.sent.clear();
+  cp->write(1, {0x08, 2});
+  cp->write(2, {0x08, 2});
+  cp->write(1, {0x08, 1});  // Previous one from 1 still in flight
+  CHECK(fakeBle.sent.empty(), "%zu indications from the write callback", fakeBle.sent.size());
+  serveFtms(ble);
+  CHECK(fakeBle.count(FMCP, 1, true) == 1 && fakeBle.count(FMCP, 2, true) == 1, "responses: %u to 1, %u to 2",
+        fakeBle.count(FMCP, 1, true), fakeBle.count(FMCP, 2, true));
+  for (const FakeBle::Sent& r : fakeBle.sent) {
+    uint8_t want = r.connHandle == 1 ? BlePackets::FTMS_SUCCESS : BlePackets::FTMS_CONTROL_NOT_PERMITTED;
+    CHECK(r.payload.size() == 3 && r.payload[1] == 0x08 && r.payload[2] == want, "central %u got result %u",
+          r.connHandle, r.payload.size() == 3 ? r.payload[2] : 0);
+  }
+
+  // Without indications enabled the write is refused, not queued
+  cp->subscribe(2, 0);
+  fakeBle.sent.clear();
+  cp->write(2, {0x00});
+  serveFtms(ble);
+  CHECK(fakeBle.sent.empty(), "write without indications answered");
+  cp->subscribe(2, INDICATE);
+
+  fakeDisconnect(1);
+  CHECK(ftmsWrite(ble, 2, {0x00}) == BlePackets::FTMS_SUCCESS, "central 2 request control after the owner dropped");
+  applied = FtmsCommand::None;
+  CHECK(ftmsWrite(ble, 2, {0x08, 2}) == BlePackets::FTMS_SUCCESS, "new owner pause");
+  CHECK(applied == FtmsCommand::Pause, "new owner pause not applied");
+  fakeDisconnect(2);
+}
+
+// The CPS Control Point responses indicated to a central, in order
+static std::vector<std::vector<uint8_t>> cpsResponses(uint16_t handle) {
+  std::vector<std::vector<uint8_t>> out;
+  for (const FakeBle::Sent& s : fakeBle.sent) {
+    if (s.uuid == CPCP && s.indication && s.connHandle == handle) out.push_back(s.payload);
+  }
+  return out;
+}
+
+static void testCpsControl(BleCps& ble) {
+  NimBLECharacteristic* cp = fakeBle.find(CPCP);
+  fakeConnect(4);
+  fakeConnect(5);
+  fakeBle.sent.clear();
+  CpsControlRequest req;
+
+  // Without indications enabled the write is refused, not queued
+  cp->write(4, {0x05});
+  CHECK(!ble.takeCpsRequest(req), "request queued without indications enabled");
+  CHECK(fakeBle.sent.empty(), "refused write answered");
+
+  // Both centrals write; nothing is sent from the write callback
+  cp->subscribe(4, INDICATE);
+  cp->subscribe(5, INDICATE);
+  cp->write(4, {0x05});
+  cp->write(5, {0x04, 0x01});  // Set Crank Length, value missing
+  cp->write(4, {0x0E});        // Previous one from 4 still in flight
+  CHECK(fakeBle.sent.empty(), "%zu indications from the write callback", fakeBle.sent.size());
+
+  // One take: the good request comes back, the bad one is answered on the way
+  CHECK(ble.takeCpsRequest(req), "request from 4 not queued");
+  CHECK(req.op == BlePackets::CPS_OP_REQUEST_CRANK_LENGTH && req.connHandle == 4, "took op 0x%02x from %u", req.op,
+        req.connHandle);
+  uint8_t param[2] = {0x54, 0x01};
+  ble.respondCps(req, BlePackets::CPS_SUCCESS, param, 2);
+  CHECK(!ble.takeCpsRequest(req), "second request from 4 was queued while the first was in flight");
+
+  std::vector<std::vector<uint8_t>> to4 = cpsResponses(4), to5 = cpsResponses(5);
+  CHECK(to4.size() == 1 && to4[0] == std::vector<uint8_t>({0x20, 0x05, 0x01, 0x54, 0x01}),
+        "central 4 got %zu responses", to4.size());
+  CHECK(to5.size() == 1 && to5[0] == std::vector<uint8_t>({0x20, 0x04, BlePackets::CPS_INVALID_PARAMETER}),
+        "central 5 got %zu responses", to5.size());
+
+  // Answered, so 4 may write again; indications off again refuses it
+  cp->write(4, {0x0E});
+  CHECK(ble.takeCpsRequest(req) && req.op == BlePackets::CPS_OP_REQUEST_SAMPLING_RATE, "follow-up request from 4");
+  cp->subscribe(4, 0);
+  cp->write(4, {0x0E});
+  CHECK(!ble.takeCpsRequest(req), "request queued after indications were disabled");
+
+  // A request left behind by a central that dropped is never answered
+  cp->write(5, {0x0E});
+  fakeDisconnect(5);
+  CHECK(!ble.takeCpsRequest(req), "request from a disconnected central");
+  fakeDisconnect(4);
+}
+
+int main() {
+  Clock::useVirtual(1000000);
+  BleCps ble;
+  ble.begin("test", BleServices::SERVICE_CPS | BleServices::SERVICE_CSC | BleServices::SERVICE_FTMS);
+  testNoSubscribers(ble);
+  testCentrals(ble);
+  testFtmsOwnership(ble);
+  testCpsControl(ble);
+  return finish("test_ble_cps");
+}
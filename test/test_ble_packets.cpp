@@ -0,0 +1,270 @@
+// GATT payload encoders and the derived crank quantities behind them:
+// byte layouts as the Bluetooth SIG specs give them, and long rides
+// through the 16-bit rollovers for the values apps compute from deltas.
+#include "BlePackets.h"
+#include "TestCheck.h"
+#include <math.h>
+#include <initializer_list>
+
+static uint16_t u16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static uint32_t u32(const uint8_t* p) { return (uint32_t)u16(p) | ((uint32_t)u16(p + 2) << 16); }
+
+// Payload equals the listed bytes
+static bool bytesAre(const uint8_t* got, size_t n, std::initializer_list<uint8_t> want) {
+  if (n != want.size()) return false;
+  size_t i = 0;
+  for (uint8_t w : want) {
+    if (got[i++] != w) return false;
+  }
+  return true;
+}
+
+static void testCpsLayout() {
+  uint8_t b[BlePackets::MAX_PAYLOAD];
+  // Crank revolution data, offset compensation, crank length adjustment
+  size_t n = BlePackets::cpsFeature(false, false, b);
+  CHECK(bytesAre(b, n, {0x08, 0x12, 0x00, 0x00}), "CPS feature");
+  n = BlePackets::cpsFeature(true, false, b);
+  CHECK(bytesAre(b, n, {0x0A, 0x12, 0x00, 0x00}), "CPS feature with accumulated torque");
+  n = BlePackets::cpsFeature(false, true, b);
+  CHECK(bytesAre(b, n, {0x88, 0x12, 0x00, 0x00}), "CPS feature with accumulated energy");
+  n = BlePackets::cpsFeature(true, true, b);
+  CHECK(bytesAre(b, n, {0x8A, 0x12, 0x00, 0x00}), "CPS feature with both");
+
+  // 10 revs at 2 kp: 1260 J, 6417/32 Nm, 1 kJ
+  CrankWork work(1.05f);
+  work.onCrank(0, 2.0f);
+  work.onCrank(10, 2.0f);
+  PowerSample s{};
+  s.power_w = 225.0f;
+  s.crank_revs = 0x1234;
+  s.crank_evt_1024 = 0xABCD;
+  n = BlePackets::cpsMeasurement(s, b);
+  CHECK(bytesAre(b, n, {0x20, 0x00, 0xE1, 0x00, 0x34, 0x12, 0xCD, 0xAB}), "CPS measurement");
+  n = BlePackets::cpsMeasurement(s, b, nullptr, true, true);
+  CHECK(bytesAre(b, n, {0x20, 0x00, 0xE1, 0x00, 0x34, 0x12, 0xCD, 0xAB}), "CPS measurement, flags without work");
+  n = BlePackets::cpsMeasurement(s, b, &work, true, false);
+  CHECK(bytesAre(b, n, {0x2C, 0x00, 0xE1, 0x00, 0x11, 0x19, 0x34, 0x12, 0xCD, 0xAB}), "CPS measurement with torque");
+  n = BlePackets::cpsMeasurement(s, b, &work, false, true);
+  CHECK(bytesAre(b, n, {0x20, 0x08, 0xE1, 0x00, 0x34, 0x12, 0xCD, 0xAB, 0x01, 0x00}), "CPS measurement with energy");
+  n = BlePackets::cpsMeasurement(s, b, &work, true, true);
+  CHECK(bytesAre(b, n, {0x2C, 0x08, 0xE1, 0x00, 0x11, 0x19, 0x34, 0x12, 0xCD, 0xAB, 0x01, 0x00}),
+        "CPS measurement with both");
+  s.power_w = -40000.0f;
+  n = BlePackets::cpsMeasurement(s, b);
+  CHECK(n == 8 && b[2] == 0x00 && b[3] == 0x80, "CPS power saturates at -32768");
+}
+
+static void testCpsControlPoint() {
+  const uint8_t setLength[] = {0x04, 0x54, 0x01}, tooShort[] = {0x04, 0xC7, 0x00}, tooLong[] = {0x04, 0xB9, 0x01};
+  const uint8_t requestLength[] = {0x05}, offset[] = {0x0C}, rate[] = {0x0E}, rateExtra[] = {0x0E, 0x00};
+  const uint8_t cumulative[] = {0x01, 0x00, 0x00, 0x00, 0x00};
+  struct Case {
+    const char* name;
+    const uint8_t* req;
+    size_t len;
+    uint8_t result;
+    uint16_t value;
+  };
+  const Case cases[] = {
+    {"set crank length 170 mm", setLength, 3, BlePackets::CPS_SUCCESS, 340},
+    {"set crank length 99.5 mm", tooShort, 3, BlePackets::CPS_INVALID_PARAMETER, 0},
+    {"set crank length 220.5 mm", tooLong, 3, BlePackets::CPS_INVALID_PARAMETER, 0},
+    {"set crank length, short", setLength, 2, BlePackets::CPS_INVALID_PARAMETER, 0},
+    {"request crank length", requestLength, 1, BlePackets::CPS_SUCCESS, 0},
+    {"start offset compensation", offset, 1, BlePackets::CPS_SUCCESS, 0},
+    {"request sampling rate", rate, 1, BlePackets::CPS_SUCCESS, 0},
+    {"request sampling rate, extra byte", rateExtra, 2, BlePackets::CPS_INVALID_PARAMETER, 0},
+    {"set cumulative value", cumulative, 5, BlePackets::CPS_NOT_SUPPORTED, 0},
+    {"empty", offset, 0, BlePackets::CPS_INVALID_PARAMETER, 0},
+  };
+  for (const Case& c : cases) {
+    CpsControlRequest req = {};
+    uint8_t result = BlePackets::cpsControlPoint(c.req, c.len, req);
+    CHECK(result == c.result && req.value == c.value, "CPS control point %s: result %u, value %u", c.name, result,
+          req.value);
+    if (c.len) CHECK(req.op == c.req[0], "CPS control point %s: op 0x%02x", c.name, req.op);
+  }
+
+  uint8_t b[BlePackets::MAX_PAYLOAD];
+  const uint8_t offsetN[] = {0xFB, 0xFF};  // -5 N
+  size_t n = BlePackets::cpsControlResponse(0x0C, BlePackets::CPS_SUCCESS, offsetN, 2, b);
+  CHECK(bytesAre(b, n, {0x20, 0x0C, 0x01, 0xFB, 0xFF}), "CPS control point response");
+  n = BlePackets::cpsControlResponse(0x01, BlePackets::CPS_NOT_SUPPORTED, nullptr, 0, b);
+  CHECK(bytesAre(b, n, {0x20, 0x01, 0x02}), "CPS control point error response");
+
+  // 0.1 kp on 172.5 mm cranks: 1.003 Nm, 5.8 N at the pedal
+  int16_t force = BlePackets::cpsOffsetForce(0.1f, 1.05f, 345);
+  CHECK(force == 6, "offset of 0.1 kp reported as %d N, want 6", force);
+  force = BlePackets::cpsOffsetForce(-0.1f, 1.05f, 345);
+  CHECK(force == -6, "offset of -0.1 kp reported as %d N, want -6", force);
+  CHECK(BlePackets::cpsOffsetForce(0.1f, 1.05f, 0) == 0, "offset force without a crank length");
+  CHECK(BlePackets::cpsOffsetForce(1e6f, 1.05f, 345) == 32767, "offset force does not saturate");
+}
+
+static void testCrankWorkRide() {
+  // An hour at 4 samples/s with cadence and load both swinging, so the
+  // 16-bit torque field rolls over many times
+  const float CC = 1.05f;
+  const double DT = 0.25;
+  CrankWork work(CC);
+  double pos = 0.0, perRev = 0.0, fromTorque = 0.0;
+  uint16_t revs = 0, prevTorque = 0;
+  bool first = true;
+  for (double t = 0.0; t < 3600.0; t += DT) {
+    double rpm = 80.0 + 20.0 * sin(t / 97.0);
+    float kp = (float)(2.5 + 1.5 * sin(t / 41.0));
+    double next = pos + rpm / 60.0 * DT;
+    // Every rev completed in this sample is done at the sample's load
+    uint32_t done = (uint32_t)floor(next) - (uint32_t)floor(pos);
+    if (!first) perRev += done * (double)kp * (double)CC * 60.0;
+    pos = next;
+    revs = (uint16_t)(revs + done);
+    work.onCrank(revs, kp);
+
+    // What an app integrates: torque deltas times 2 pi per rev
+    if (!first) fromTorque += (uint16_t)(work.torque32() - prevTorque) / 32.0 * 6.283185307179586;
+    prevTorque = work.torque32();
+    first = false;
+  }
+  double err = fabs(fromTorque - perRev) / perRev;
+  printf("crank work: %.1f kJ per rev, %.1f kJ from torque deltas (%.4f%%), energy field %u kJ\n", perRev / 1000.0,
+         fromTorque / 1000.0, err * 100.0, work.energyKj());
+  CHECK(err < 0.0005, "energy from torque deltas off by %.4f%%", err * 100.0);
+  CHECK(work.energyKj() == (uint16_t)(perRev / 1000.0), "energy field %u kJ, want %u", work.energyKj(),
+        (unsigned)(uint16_t)(perRev / 1000.0));
+}
+
+static void testCscLayout() {
+  PowerSample s{};
+  s.crank_revs = 0x1234;
+  s.crank_evt_1024 = 0xABCD;
+  uint8_t b[BlePackets::MAX_PAYLOAD];
+
+  // Crank data only: flags, revs, event time
+  size_t n = BlePackets::cscMeasurement(s, nullptr, b);
+  CHECK(n == 5, "CSC crank-only length %zu", n);
+  CHECK(b[0] == 0x02, "CSC crank-only flags 0x%02x", b[0]);
+  CHECK(u16(&b[1]) == 0x1234 && u16(&b[3]) == 0xABCD, "CSC crank fields %04x %04x", u16(&b[1]), u16(&b[3]));
+
+  // Wheel data goes first
+  VirtualWheel wheel;
+  wheel.onCrank(0, 0);
+  wheel.onCrank(10, 6827);  // 10 revs in 6.67 s: 60 m, 28 wheel revs
+  n = BlePackets::cscMeasurement(s, &wheel, b);
+  CHECK(n == 11, "CSC wheel length %zu", n);
+  CHECK(b[0] == 0x03, "CSC wheel flags 0x%02x", b[0]);
+  CHECK(u32(&b[1]) == 28, "CSC wheel revs %u", u32(&b[1]));
+  CHECK(u16(&b[5]) == wheel.eventTime1024(), "CSC wheel event %u", u16(&b[5]));
+  CHECK(u16(&b[7]) == 0x1234 && u16(&b[9]) == 0xABCD, "CSC crank fields after wheel");
+}
+
+static void testVirtualWheelRide() {
+  // 90 rpm for 70000 revs: both 16-bit crank fields roll over
+  const double RPM = 90.0;
+  const uint32_t REVS = 70000;
+  const double WANT_KMH = RPM * 6.0 * 60.0 / 1000.0;  // 32.4
+  VirtualWheel wheel;
+  uint32_t prevRevs = 0, badSpeed = 0, wheelEvents = 0;
+  uint16_t prevEvt = 0;
+  double t = 0.0;
+  for (uint32_t r = 0; r < REVS; r++) {
+    t += 60.0 / RPM;
+    wheel.onCrank((uint16_t)r, (uint16_t)(uint64_t)(t * 1024.0));
+    if (wheel.revs() == prevRevs) continue;
+    if (r > 10) {
+      // What a head unit computes from two wheel events
+      double dt = (uint16_t)(wheel.eventTime1024() - prevEvt) / 1024.0;
+      double kmh = (wheel.revs() - prevRevs) * 2.096 / dt * 3.6;
+      if (fabs(kmh - WANT_KMH) > 0.5) badSpeed++;
+      wheelEvents++;
+    }
+    prevRevs = wheel.revs();
+    prevEvt = wheel.eventTime1024();
+  }
+  uint32_t want = (uint32_t)floor((REVS - 1) * 6.0 / 2.096);
+  printf("virtual wheel: %u revs over %u crank revs (want %u), %u of %u speeds off by > 0.5 km/h\n",
+         wheel.revs(), REVS, want, badSpeed, wheelEvents);
+  CHECK(wheel.revs() == want, "wheel revs %u, want %u", wheel.revs(), want);
+  CHECK(badSpeed == 0, "%u wheel speeds off by more than 0.5 km/h", badSpeed);
+}
+
+static void testFtmsLayout() {
+  uint8_t b[BlePackets::MAX_PAYLOAD];
+  size_t n = BlePackets::ftmsFeature(b);
+  // Cadence, resistance level, elapsed time, power; no target settings
+  CHECK(bytesAre(b, n, {0x82, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}), "FTMS feature");
+
+  // 90 rpm at 6 m per rev: 32.40 km/h, 180 half-rpm, kp 2.5 as level 25
+  PowerSample s{};
+  s.rpm = 90.0f;
+  s.kp = 2.5f;
+  s.power_w = 225.0f;
+  n = BlePackets::indoorBikeData(s, 61500, b);
+  CHECK(bytesAre(b, n, {0x64, 0x08, 0xA8, 0x0C, 0xB4, 0x00, 25, 0x00, 0xE1, 0x00, 61, 0x00}), "Indoor Bike Data");
+
+  // Out of range values saturate instead of wrapping
+  s.rpm = 0.0f;
+  s.kp = 0.0f;
+  s.power_w = -5.0f;
+  n = BlePackets::indoorBikeData(s, 0xFFFFFFFF, b);
+  CHECK(bytesAre(b, n, {0x64, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFB, 0xFF, 0xFF, 0xFF}),
+        "Indoor Bike Data saturation");
+}
+
+static void testFtmsControlPoint() {
+  const uint8_t requestControl[] = {0x00}, reset[] = {0x01}, start[] = {0x07};
+  const uint8_t stop[] = {0x08, 1}, pause[] = {0x08, 2}, badStop[] = {0x08, 3};
+  const uint8_t unsupported[] = {0x05, 0x00, 0x00};
+  struct Case {
+    const char* name;
+    const uint8_t* req;
+    size_t len;
+    bool hasControl;
+    uint8_t result;
+    FtmsCommand cmd;
+  };
+  const Case cases[] = {
+    {"request control", requestControl, 1, false, BlePackets::FTMS_SUCCESS, FtmsCommand::RequestControl},
+    {"start without control", start, 1, false, BlePackets::FTMS_CONTROL_NOT_PERMITTED, FtmsCommand::None},
+    {"start", start, 1, true, BlePackets::FTMS_SUCCESS, FtmsCommand::Start},
+    {"stop", stop, 2, true, BlePackets::FTMS_SUCCESS, FtmsCommand::Stop},
+    {"pause", pause, 2, true, BlePackets::FTMS_SUCCESS, FtmsCommand::Pause},
+    {"stop, bad parameter", badStop, 2, true, BlePackets::FTMS_INVALID_PARAMETER, FtmsCommand::None},
+    {"stop, no parameter", stop, 1, true, BlePackets::FTMS_INVALID_PARAMETER, FtmsCommand::None},
+    {"reset", reset, 1, true, BlePackets::FTMS_SUCCESS, FtmsCommand::Reset},
+    {"unsupported", unsupported, 3, true, BlePackets::FTMS_NOT_SUPPORTED, FtmsCommand::None},
+    {"empty", requestControl, 0, true, BlePackets::FTMS_INVALID_PARAMETER, FtmsCommand::None},
+  };
+  for (const Case& c : cases) {
+    FtmsCommand cmd = FtmsCommand::None;
+    uint8_t result = BlePackets::ftmsControlPoint(c.req, c.len, c.hasControl, cmd);
+    CHECK(result == c.result && cmd == c.cmd, "FTMS control point %s: result %u, command %u", c.name, result,
+          (unsigned)cmd);
+  }
+
+  uint8_t b[BlePackets::MAX_PAYLOAD];
+  size_t n = BlePackets::ftmsControlResponse(0x08, BlePackets::FTMS_SUCCESS, b);
+  CHECK(bytesAre(b, n, {0x80, 0x08, 0x01}), "FTMS control point response");
+  n = BlePackets::ftmsStatus(FtmsCommand::Start, b);
+  CHECK(bytesAre(b, n, {0x04}), "FTMS status started");
+  n = BlePackets::ftmsStatus(FtmsCommand::Stop, b);
+  CHECK(bytesAre(b, n, {0x02, 0x01}), "FTMS status stopped");
+  n = BlePackets::ftmsStatus(FtmsCommand::Pause, b);
+  CHECK(bytesAre(b, n, {0x02, 0x02}), "FTMS status paused");
+  n = BlePackets::ftmsStatus(FtmsCommand::Reset, b);
+  CHECK(bytesAre(b, n, {0x01}), "FTMS status reset");
+  n = BlePackets::ftmsStatus(FtmsCommand::RequestControl, b);
+  CHECK(n == 0, "FTMS status for request control: %zu bytes", n);
+}
+
+int main() {
+  testCpsLayout();
+  testCpsControlPoint();
+  testCrankWorkRide();
+  testCscLayout();
+  testVirtualWheelRide();
+  testFtmsLayout();
+  testFtmsControlPoint();
+  return finish("test_ble_packets");
+}
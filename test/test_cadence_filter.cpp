@@ -0,0 +1,91 @@
+// Replays one synthetic ride through both cadence filters, read at 4 Hz
+// like the BLE output: steady pedalling with per-stroke jitter, a step
+// from 70 to 95 rpm, a step back down and a stop. Reports the step
+// latency (time to cover 90% of the step), RMS error on the steady parts
+// and how long each takes to read zero after the last rev.
+#include "CadenceFilter.h"
+#include "TestCheck.h"
+#include <math.h>
+#include <stdlib.h>
+
+static const uint64_t S = 1000000;
+static const uint64_t OUTPUT_US = 250000;  // 4 Hz
+static const uint64_t STEP_UP_US = 60 * S;
+static const uint64_t STEP_DOWN_US = 120 * S;
+static const uint64_t STOP_US = 180 * S;
+static const uint64_t END_US = 200 * S;
+
+static float trueRpm(uint64_t t) {
+  if (t < STEP_UP_US) return 70.0f;
+  if (t < STEP_DOWN_US) return 95.0f;
+  return 70.0f;
+}
+
+struct Result {
+  float upLatencyS;
+  float downLatencyS;
+  float rmsRpm;
+  float zeroAfterS;
+};
+
+static Result replay(ICadenceFilter& f) {
+  srand(1234);
+  Result r = {-1.0f, -1.0f, 0.0f, -1.0f};
+  uint64_t nextRev = S;
+  uint64_t lastRev = 0;
+  double sq = 0.0;
+  uint32_t n = 0;
+  for (uint64_t t = 0; t <= END_US; t += OUTPUT_US) {
+    while (nextRev <= t && nextRev < STOP_US) {
+      f.onRev(nextRev);
+      lastRev = nextRev;
+      // +-3% stroke-to-stroke jitter
+      float jitter = 1.0f + 0.03f * ((float)rand() / RAND_MAX * 2.0f - 1.0f);
+      nextRev += (uint64_t)(60.0e6f / trueRpm(nextRev) * jitter);
+    }
+    float rpm = f.rpm(t, OUTPUT_US / 1e6f);
+
+    if (t >= STEP_UP_US && r.upLatencyS < 0 && rpm >= 70.0f + 0.9f * 25.0f) {
+      r.upLatencyS = (t - STEP_UP_US) / 1e6f;
+    }
+    if (t >= STEP_DOWN_US && r.downLatencyS < 0 && rpm <= 95.0f - 0.9f * 25.0f) {
+      r.downLatencyS = (t - STEP_DOWN_US) / 1e6f;
+    }
+    if (t >= STOP_US && r.zeroAfterS < 0 && rpm == 0.0f) {
+      r.zeroAfterS = (t - lastRev) / 1e6f;
+    }
+    // Steady: settled parts of each segment
+    bool steady = (t > 20 * S && t < STEP_UP_US) || (t > STEP_UP_US + 20 * S && t < STEP_DOWN_US) ||
+                  (t > STEP_DOWN_US + 20 * S && t < STOP_US);
+    if (steady) {
+      double e = rpm - trueRpm(t);
+      sq += e * e;
+      n++;
+    }
+  }
+  r.rmsRpm = (float)sqrt(sq / n);
+  return r;
+}
+
+static void report(const char* name, const Result& r) {
+  printf("%-9s step up %.2f s, step down %.2f s, steady RMS %.2f rpm, zero %.1f s after last rev\n",
+         name, r.upLatencyS, r.downLatencyS, r.rmsRpm, r.zeroAfterS);
+}
+
+int main() {
+  BlendCadenceFilter blend;
+  AlphaBetaCadenceFilter ab;
+  Result b = replay(blend);
+  Result a = replay(ab);
+  report("blend", b);
+  report("alphabeta", a);
+
+  CHECK(a.upLatencyS >= 0 && b.upLatencyS >= 0, "a filter never reached the step up");
+  CHECK(a.downLatencyS >= 0 && b.downLatencyS >= 0, "a filter never reached the step down");
+  CHECK(a.zeroAfterS >= 0 && b.zeroAfterS >= 0, "a filter never read zero after the stop");
+  // The tracker exists to follow changes faster without being noisier
+  CHECK(a.upLatencyS < b.upLatencyS, "alpha-beta step up %.2f s, blend %.2f s", a.upLatencyS, b.upLatencyS);
+  CHECK(a.downLatencyS < b.downLatencyS, "alpha-beta step down %.2f s, blend %.2f s", a.downLatencyS, b.downLatencyS);
+  CHECK(a.rmsRpm < 2.0f && b.rmsRpm < 2.0f, "steady RMS alpha-beta %.2f, blend %.2f", a.rmsRpm, b.rmsRpm);
+  return finish("test_cadence_filter");
+}
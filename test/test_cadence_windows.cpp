@@ -0,0 +1,88 @@
+// CadenceWindows against the per-update history rescan it replaced: both
+// see the same varying-cadence edge stream and are read for the 3 s and
+// 10 s windows after every edge. Results must match; the run time of each
+// is printed as a microbenchmark.
+#include "CadenceWindows.h"
+#include "TestCheck.h"
+#include <math.h>
+#include <chrono>
+
+static const uint64_t WINDOW_SHORT_US = 3000000;
+static const uint64_t WINDOW_LONG_US = 10000000;
+static const uint32_t EDGES = 200000;
+
+// The previous PowerReal approach: walk the history from the oldest edge
+// on every read
+struct RescanWindows {
+  static const uint32_t SIZE = CadenceWindows::HIST_SIZE;
+  uint64_t hist[SIZE] = {0};
+  uint32_t head = 0;
+  uint32_t count = 0;
+
+  void onRev(uint64_t t) {
+    hist[head] = t;
+    head = (head + 1) % SIZE;
+    if (count < SIZE) count++;
+  }
+  uint64_t revAt(uint32_t i) const { return hist[(head + SIZE - count + i) % SIZE]; }
+  float rpm(uint64_t windowUs) const {
+    if (count < 2) return 0.0f;
+    uint64_t newest = revAt(count - 1);
+    uint32_t first = 0;
+    while (first < count && (newest - revAt(first)) > windowUs) first++;
+    uint32_t n = count - first;
+    if (n < 2) return 0.0f;
+    uint64_t dt = newest - revAt(first);
+    if (dt == 0) return 0.0f;
+    return (float)(n - 1) * 60000000.0f / (float)dt;
+  }
+};
+
+// Cadence sweeping 40..220 rpm so window fill varies
+static uint64_t edgeTime(uint32_t i) {
+  static uint64_t t = 1000000;
+  double rpm = 130.0 + 90.0 * sin(i * 0.001);
+  t += (uint64_t)(60.0e6 / rpm);
+  return t;
+}
+
+int main() {
+  static uint64_t times[EDGES];
+  for (uint32_t i = 0; i < EDGES; i++) times[i] = edgeTime(i);
+
+  static float inc[EDGES][2], ref[EDGES][2];
+  CadenceWindows cw;
+  int8_t wShort = cw.addWindow(WINDOW_SHORT_US);
+  int8_t wLong = cw.addWindow(WINDOW_LONG_US);
+  RescanWindows rw;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < EDGES; i++) {
+    cw.onRev(times[i]);
+    inc[i][0] = cw.rpm(wShort);
+    inc[i][1] = cw.rpm(wLong);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < EDGES; i++) {
+    rw.onRev(times[i]);
+    ref[i][0] = rw.rpm(WINDOW_SHORT_US);
+    ref[i][1] = rw.rpm(WINDOW_LONG_US);
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; i < EDGES; i++) {
+    for (int w = 0; w < 2; w++) {
+      if (fabsf(inc[i][w] - ref[i][w]) > 1e-4f * fmaxf(1.0f, ref[i][w])) {
+        if (mismatches++ < 5) printf("edge %u window %d: %f vs %f\n", i, w, inc[i][w], ref[i][w]);
+      }
+    }
+  }
+
+  double incNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / EDGES;
+  double refNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / EDGES;
+  printf("per edge + two reads: incremental %.1f ns, rescan %.1f ns (%.1fx)\n",
+         incNs, refNs, refNs / incNs);
+  CHECK(mismatches == 0, "%u of %u readings differ from the rescan", mismatches, EDGES * 2);
+  return finish("test_cadence_windows");
+}
@@ -0,0 +1,166 @@
+// The compiled calibration table against the exact fit it is built from:
+// lookup error over the whole ADC range for both fits, lookup speed, and
+// back-to-back updates while reader threads keep looking up. A reader must
+// always get a value from one complete table, never a half-written one.
+// Zero offset moves and updates from other threads must not interleave.
+#include "Calibration.h"
+#include "TestCheck.h"
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+static const CalPoint POINTS[] = {{0.0f, 78}, {2.0f, 125}, {4.0f, 177}, {6.0f, 226}};
+static const CalPoint WIDE[] = {{0.0f, 100}, {1.0f, 400}, {3.5f, 1200}, {7.0f, 2400}, {9.0f, 3100}};
+
+// Worst |table - exact| over 0..3.4 V in 0.1 mV steps
+static float maxTableError(MonarkCalibration& cal) {
+  float worst = 0.0f;
+  for (int i = 0; i <= 34000; i++) {
+    float mv = i * 0.1f;
+    float e = fabsf(cal.adcToKp(mv) - cal.adcToKpExact(mv));
+    if (e > worst) worst = e;
+  }
+  return worst;
+}
+
+static void checkAccuracy() {
+  struct Case { const char* name; const CalPoint* pts; uint8_t n; CalFit fit; };
+  const Case cases[] = {
+    {"default linear", POINTS, 4, CalFit::Linear},
+    {"default monotone", POINTS, 4, CalFit::MonotoneCubic},
+    {"wide monotone", WIDE, 5, CalFit::MonotoneCubic},
+  };
+  for (const Case& c : cases) {
+    MonarkCalibration cal(c.pts, c.n, c.fit);
+    float err = maxTableError(cal);
+    printf("%s: max table error %.5f kp\n", c.name, err);
+    // Worst case is a linear-fit kink between grid steps: slope change *
+    // STEP_MV / 4 = 0.002 kp on the default curve, 0.05 mV - far below noise
+    CHECK(err < 0.0025f, "%s: table off by %.5f kp", c.name, err);
+  }
+}
+
+static void benchmark() {
+  MonarkCalibration cal(POINTS, 4, CalFit::MonotoneCubic);
+  const int N = 2000000;
+  volatile float sink = 0.0f;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < N; i++) sink = sink + cal.adcToKp(60.0f + (i & 1023) * 0.2f);
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < N; i++) sink = sink + cal.adcToKpExact(60.0f + (i & 1023) * 0.2f);
+  auto t2 = std::chrono::steady_clock::now();
+  double tableNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / N;
+  double exactNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / N;
+  printf("lookup: table %.1f ns, exact fit %.1f ns; %zu bytes per table\n",
+         tableNs, exactNs, sizeof(CalibrationTable));
+}
+
+// Two curves whose values never overlap at the probe point, so a reading
+// tells which table it came from - or that it came from neither
+static void checkBackToBackUpdates() {
+  const CalPoint low[] = {{0.0f, 0}, {1.0f, 3000}};
+  const CalPoint high[] = {{5.0f, 0}, {6.0f, 3000}};
+  const float probeMv = 1500.0f;
+  MonarkCalibration cal(low, 2, CalFit::Linear);
+
+  std::atomic<bool> stop{false};
+  std::atomic<uint32_t> bad{0}, reads{0};
+  auto reader = [&]() {
+    while (!stop.load()) {
+      float kp = cal.adcToKp(probeMv);
+      if (fabsf(kp - 0.5f) > 0.01f && fabsf(kp - 5.5f) > 0.01f) bad++;
+      reads++;
+    }
+  };
+  std::thread r1(reader), r2(reader);
+  const int UPDATES = 2000;
+  for (int i = 0; i < UPDATES; i++) {
+    cal.updateValues((i & 1) ? low : high, 2, CalFit::Linear);
+  }
+  stop = true;
+  r1.join();
+  r2.join();
+  printf("%d back-to-back updates, %u reads, %u torn\n", UPDATES, reads.load(), bad.load());
+  CHECK(bad.load() == 0, "%u reads from a table being rewritten", bad.load());
+}
+
+// Non-monotone points are rejected and keep the previous calibration
+static void checkMonotone() {
+  const CalPoint unsorted[] = {{4.0f, 177}, {0.0f, 78}, {6.0f, 226}, {2.0f, 125}};
+  const CalPoint dupAdc[] = {{0.0f, 78}, {2.0f, 125}, {4.0f, 125}};
+  const CalPoint kpDown[] = {{0.0f, 78}, {4.0f, 125}, {2.0f, 177}};
+  const CalPoint kpFlat[] = {{0.0f, 78}, {2.0f, 125}, {2.0f, 177}};
+  const CalPoint kpNan[] = {{0.0f, 78}, {NAN, 125}, {4.0f, 177}};
+  CHECK(MonarkCalibration::isMonotone(unsorted, 4), "unsorted but monotone points rejected");
+  CHECK(!MonarkCalibration::isMonotone(dupAdc, 3), "duplicate ADC accepted");
+  CHECK(!MonarkCalibration::isMonotone(kpDown, 3), "decreasing kp accepted");
+  CHECK(!MonarkCalibration::isMonotone(kpFlat, 3), "repeated kp accepted");
+  CHECK(!MonarkCalibration::isMonotone(kpNan, 3), "NaN kp accepted");
+  CHECK(!MonarkCalibration::isMonotone(POINTS, 1), "single point accepted");
+
+  MonarkCalibration cal(POINTS, 4, CalFit::Linear);
+  float before = cal.adcToKp(150.0f);
+  CHECK(!cal.updateValues(kpDown, 3, CalFit::Linear), "updateValues took decreasing kp");
+  CHECK(cal.adcToKp(150.0f) == before && cal.getPointCount() == 4, "rejected update changed the calibration");
+  CHECK(cal.updateValues(unsorted, 4, CalFit::Linear) && cal.getPoint(0).adc == 78, "unsorted update not sorted");
+
+  // Invalid points at construction still give a usable (flat) table
+  MonarkCalibration fallback(kpDown, 3, CalFit::Linear);
+  CHECK(fallback.adcToKp(150.0f) == 0.0f, "fallback curve not flat 0 kp");
+}
+
+// Zero offset: a uniform shift, refused when too far or without a 0 kp
+// point, and never mixing its points with a concurrent update's
+static void checkMoveZero() {
+  MonarkCalibration cal(POINTS, 4, CalFit::Linear);
+  uint32_t revision = cal.getRevision();
+  int shift = 0;
+  CHECK(cal.moveZero(83.4f, 25.0f, shift) && shift == 5, "zero moved %d mV, want 5", shift);
+  CHECK(cal.getRevision() == revision + 1, "move did not bump the revision (loop() would not save it)");
+  CalPoint pts[MonarkCalibration::MAX_POINTS];
+  CalFit fit;
+  uint8_t n = cal.getPoints(pts, fit);
+  CHECK(n == 4 && pts[0].adc == 83 && pts[3].adc == 231 && fit == CalFit::Linear, "points after the move");
+  CHECK(fabsf(cal.adcToKp(130.0f) - 2.0f) < 0.01f, "table not rebuilt after the move");
+  CHECK(!cal.moveZero(120.0f, 25.0f, shift), "moved 37 mV with a 25 mV limit");
+  CHECK(!cal.moveZero(NAN, 25.0f, shift), "moved to a NaN zero");
+  CHECK(cal.getPoint(0).adc == 83 && cal.getRevision() == revision + 1, "refused move changed the points");
+  const CalPoint noZero[] = {{1.0f, 100}, {3.0f, 160}};
+  MonarkCalibration loaded(noZero, 2, CalFit::Linear);
+  CHECK(!loaded.moveZero(105.0f, 25.0f, shift), "moved without a 0 kp point");
+
+  // Two point sets told apart by their spacing; moves keep the spacing
+  const CalPoint a[] = {{0.0f, 100}, {2.0f, 150}, {4.0f, 210}};
+  const CalPoint b[] = {{0.0f, 100}, {2.0f, 170}, {4.0f, 250}};
+  MonarkCalibration shared(a, 3, CalFit::Linear);
+  std::atomic<bool> stop{false};
+  std::thread updater([&]() {
+    for (int i = 0; !stop.load(); i++) shared.updateValues((i & 1) ? a : b, 3, CalFit::Linear);
+  });
+  std::thread mover([&]() {
+    int s = 0;
+    for (int i = 0; !stop.load(); i++) shared.moveZero((i & 1) ? 97.0f : 103.0f, 25.0f, s);
+  });
+  uint32_t mixed = 0;
+  const int SNAPSHOTS = 200000;
+  for (int i = 0; i < SNAPSHOTS; i++) {
+    n = shared.getPoints(pts, fit);
+    int d1 = pts[1].adc - pts[0].adc, d2 = pts[2].adc - pts[1].adc;
+    if (n != 3 || !((d1 == 50 && d2 == 60) || (d1 == 70 && d2 == 80))) mixed++;
+  }
+  stop = true;
+  updater.join();
+  mover.join();
+  printf("%d snapshots during updates and zero moves, %u mixed\n", SNAPSHOTS, mixed);
+  CHECK(mixed == 0, "%u snapshots mixed two point sets", mixed);
+}
+
+int main() {
+  checkMonotone();
+  checkAccuracy();
+  benchmark();
+  checkBackToBackUpdates();
+  checkMoveZero();
+  return finish("test_calibration_table");
+}
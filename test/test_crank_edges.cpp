@@ -0,0 +1,82 @@
+// Synthetic reed switch edge trains through the edge filter and the BLE
+// event time conversion: every revolution is counted, and the Last Crank
+// Event Time is the true closing time truncated to 1/1024 s, never off by
+// the up to 1 ms that millisecond stamps added.
+#include "CrankDebouncer.h"
+#include "Clock.h"
+#include "TestCheck.h"
+#include <math.h>
+
+// Closing-edge bounce: a few short open/close pairs after the real closing
+static const int BOUNCES = 3;
+static const uint64_t BOUNCE_US = 300;
+
+struct TrainResult {
+  uint32_t revs;
+  uint32_t counted;
+  double maxErrTicks;     // BLE event time vs exact, 1/1024 s
+  double maxMsErrTicks;   // Same, had the edge been stamped in whole ms
+  uint32_t badDeltas;     // Consecutive event time deltas off by > 1 tick
+};
+
+static TrainResult runTrain(double rpm, uint32_t revs, uint64_t startUs) {
+  CrankDebouncer deb;
+  TrainResult r = {revs, 0, 0.0, 0.0, 0};
+  double periodUs = 60.0e6 / rpm;
+  uint64_t closedUs = (uint64_t)(periodUs * 0.2);
+  bool havePrev = false;
+  uint16_t prevEvt = 0;
+  double prevExact = 0.0;
+
+  for (uint32_t i = 0; i < revs; i++) {
+    // Odd microsecond offsets so truncation is exercised
+    uint64_t t = startUs + (uint64_t)llround(periodUs * i) + (i * 7919) % 977;
+    // Counted once the switch opens for good, stamped with the closing
+    uint32_t counts = deb.onEdge(t, true) ? 1 : 0;
+    for (int b = 1; b <= BOUNCES; b++) {
+      counts += deb.onEdge(t + b * BOUNCE_US, false) ? 1 : 0;
+      counts += deb.onEdge(t + b * BOUNCE_US + 100, true) ? 1 : 0;
+    }
+    counts += deb.onEdge(t + closedUs, false) ? 1 : 0;
+    CHECK(counts <= 1, "rev %u counted %u times", i, counts);
+    if (counts == 0) continue;
+    r.counted++;
+    uint64_t countedAt = deb.lastRevUs();
+    CHECK(countedAt == t, "rev %u stamped on a bounce at +%llu us", i, (unsigned long long)(countedAt - t));
+
+    uint16_t evt = Clock::toBle1024(countedAt);
+    double exact = (double)t * 1024.0 / 1.0e6;
+    double err = fmod(exact, 65536.0) - (double)evt;
+    if (err < 0) err += 65536.0;
+    if (err > r.maxErrTicks) r.maxErrTicks = err;
+
+    double msExact = (double)(t / 1000) * 1024.0 / 1000.0;
+    double msErr = exact - msExact;
+    if (msErr > r.maxMsErrTicks) r.maxMsErrTicks = msErr;
+
+    if (havePrev) {
+      double want = exact - prevExact;
+      double got = (double)(uint16_t)(evt - prevEvt);
+      if (fabs(got - want) > 1.0) r.badDeltas++;
+    }
+    havePrev = true;
+    prevEvt = evt;
+    prevExact = exact;
+  }
+  return r;
+}
+
+int main() {
+  const double cadences[] = {30, 60, 90, 120, 150, 200, 250};
+  // Start past the 70-minute point where 32-bit ms * 1024 used to overflow
+  const uint64_t startUs = 71ULL * 60 * 1000000 + 123;
+  for (double rpm : cadences) {
+    TrainResult r = runTrain(rpm, 2000, startUs);
+    printf("%5.0f rpm: counted %u/%u, event time error max %.3f ticks (ms stamps %.3f), bad deltas %u\n",
+           rpm, r.counted, r.revs, r.maxErrTicks, r.maxMsErrTicks, r.badDeltas);
+    CHECK(r.counted == r.revs, "%.0f rpm: counted %u of %u", rpm, r.counted, r.revs);
+    CHECK(r.maxErrTicks < 1.0, "%.0f rpm: event time off by %.3f ticks", rpm, r.maxErrTicks);
+    CHECK(r.badDeltas == 0, "%.0f rpm: %u event deltas off by more than a tick", rpm, r.badDeltas);
+  }
+  return finish("test_crank_edges");
+}
@@ -0,0 +1,57 @@
+// Fast-forwards the virtual clock past the points where the old 32-bit
+// time math broke: ms * 1024 overflowed after ~70 minutes and millis()
+// wraps after ~49.7 days. BLE event time deltas and workout elapsed time
+// must stay exact across both.
+#include "Clock.h"
+#include "Workout.h"
+#include "TestCheck.h"
+
+static const uint64_t MIN_US = 60ULL * 1000000;
+static const uint64_t DAY_US = 24ULL * 60 * MIN_US;
+
+// Steps a 90 rpm crank across 'spanUs' around 'centerUs' and checks every
+// 16-bit event time delta against the exact interval
+static void checkBleDeltas(const char* label, uint64_t centerUs, uint64_t spanUs) {
+  const uint64_t periodUs = 666667;
+  Clock::useVirtual(centerUs - spanUs / 2);
+  uint16_t prev = Clock::toBle1024(Clock::nowUs());
+  uint64_t prevUs = Clock::nowUs();
+  uint32_t bad = 0, steps = 0;
+  while (Clock::nowUs() < centerUs + spanUs / 2) {
+    Clock::advanceVirtual(periodUs);
+    uint64_t now = Clock::nowUs();
+    uint16_t evt = Clock::toBle1024(now);
+    uint16_t got = (uint16_t)(evt - prev);
+    uint64_t want = (now * 1024 / 1000000) - (prevUs * 1024 / 1000000);
+    if (got != (uint16_t)want) bad++;
+    prev = evt;
+    prevUs = now;
+    steps++;
+  }
+  printf("%s: %u steps, %u bad deltas\n", label, steps, bad);
+  CHECK(bad == 0, "%s: %u of %u deltas wrong", label, bad, steps);
+}
+
+static void checkWorkout(const char* label, uint64_t startUs, uint64_t runUs) {
+  Clock::useVirtual(startUs);
+  Workout w;
+  w.start();
+  Clock::advanceVirtual(runUs / 2);
+  w.pause();
+  Clock::advanceVirtual(10 * MIN_US);  // Paused time must not count
+  w.resume();
+  Clock::advanceVirtual(runUs / 2);
+  uint32_t want = (uint32_t)(runUs / 1000);
+  printf("%s: elapsed %u ms, want %u ms\n", label, w.getElapsedMs(), want);
+  CHECK(w.getElapsedMs() == want, "%s: elapsed %u, want %u", label, w.getElapsedMs(), want);
+}
+
+int main() {
+  // 32-bit ms * 1024 overflowed at 2^32 / 1024 ms = 69.9 min
+  checkBleDeltas("70 min", 4194304ULL * 1000, 10 * MIN_US);
+  // millis() wraps at 2^32 ms = 49.7 days
+  checkBleDeltas("49.7 days", 4294967296ULL * 1000, 10 * MIN_US);
+  checkWorkout("workout across 70 min", 65 * MIN_US, 20 * MIN_US);
+  checkWorkout("workout across 49.7 days", 49 * DAY_US + 16 * 60 * MIN_US, 3 * 60 * MIN_US);
+  return finish("test_virtual_clock");
+}
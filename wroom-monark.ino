@@ -15,6 +15,11 @@
 #include "SettingsManager.h"
 #include "CalibrationProcess.h"
 #include "PowerWebServer.h"
+#include "AdcService.h"
+#include "Clock.h"
+#include "CpuMeter.h"
+#include "PowerTask.h"
+#include "SampleBus.h"
 
 #include "BoardConfig.h"
 
@@ -22,27 +27,197 @@
 static const float CYCLE_CONSTANT = 1.05f;
 static const bool DEVELOPER_MODE = true; // If true, skip auto-calibration on missing settings
 
+// Force ADC: background conversions per second, decimated to outputs per second
+static const uint32_t ADC_SAMPLE_RATE_HZ = 4000;
+static const uint32_t ADC_OUTPUT_RATE_HZ = 100;
+
+// CPS offset compensation: flywheel must be stopped, and the zero may not
+// move further than this (more means a load is on the pendulum)
+static const float ZERO_OFFSET_MAX_RPM = 1.0f;
+static const float ZERO_OFFSET_MAX_MV = 25.0f;
 
 static const int DISPLAY_TYPE = DISPLAY_TO_USE; // Change to DISPLAY_TYPE_TFT for new display
 
-// Default / Developer Calibration Values
-static const int CAL_DEF_0KP = 78;
-static const int CAL_DEF_2KP = 125;
-static const int CAL_DEF_4KP = 177;
-static const int CAL_DEF_6KP = 226;
+// Default / Developer Calibration Values (kp, ADC mV)
+static const CalPoint CAL_DEFAULT_POINTS[] = {
+  {0.0f, 78},
+  {2.0f, 125},
+  {4.0f, 177},
+  {6.0f, 226},
+};
+static const uint8_t CAL_DEFAULT_COUNT = sizeof(CAL_DEFAULT_POINTS) / sizeof(CAL_DEFAULT_POINTS[0]);
 
 // Pins are now defined in BoardConfig.h
 // I2C_SDA_PIN, I2C_SCL_PIN, CADENCE_PIN, ADC_PIN, LCD_ADDR, CAL_BUTTON_PIN
 
 // -------- Objects --------
 PowerSource* power = nullptr;
+PowerTask* powerTask = nullptr;  // Runs power->update() at a fixed period
+SampleBus sampleBus;             // Power task -> consumers below
+
+// Sample bus subscribers
+int8_t subBle = -1;      // Every sample, in order (revs and event times)
+int8_t subWorkout = -1;  // Every sample, in order (averages)
+int8_t subDisplay = -1;  // Newest only - slow to draw
+int8_t subWeb = -1;      // Newest only - polled by the browser
+AdcService* adcService = nullptr;
 BleCps ble;
 IDisplay* display = nullptr;
 MonarkCalibration* calibration = nullptr;
+uint32_t savedCalRevision = 0;  // Calibration revision last written to NVS
 SettingsManager settings;
 CalibrationProcess* calProcess = nullptr;
 Workout workout;
 PowerWebServer* webServer = nullptr;
+CpuMeter cpuMeter;  // Cost of fanning samples out in loop(), per output rate (production: PowerTask)
+float bleRpm = 0.0f;  // Cadence of the last sample sent over BLE
+float cycleConstant = CYCLE_CONSTANT;  // As loaded at boot; changes need a restart
+
+// Switch the power source to a new output rate and start measuring its cost
+static void applyOutputRate(uint8_t hz) {
+  if (!power->setOutputRate(hz)) {
+    Serial.printf("Unsupported output rate %u Hz, keeping %u Hz\n", hz, power->getOutputRate());
+    return;
+  }
+  uint8_t slot = (uint8_t)PowerSource::outputRateIndex(hz);
+  cpuMeter.select(slot);
+  if (powerTask) powerTask->selectRate(slot);
+  if (webServer) {
+    webServer->setOutputRate(hz);
+  }
+  Serial.printf("Output rate: %u Hz\n", hz);
+}
+
+// Per-revolution samples (falls back to the timer if the source can't)
+static void applyRevTrigger(bool enabled) {
+  PowerSource::SampleTrigger trigger = enabled ? PowerSource::SampleTrigger::Revolution
+                                               : PowerSource::SampleTrigger::Timer;
+  if (!power->setSampleTrigger(trigger)) {
+    Serial.println("Per-revolution notify not supported by this power source");
+  }
+  bool active = power->getSampleTrigger() == PowerSource::SampleTrigger::Revolution;
+  if (webServer) {
+    webServer->setRevTrigger(active);
+  }
+  Serial.printf("Per-revolution notify: %s\n", active ? "ON" : "OFF");
+}
+
+static void applyCadenceFilter(CadenceFilterType type) {
+  if (!power->setCadenceFilter(type)) {
+    return;  // Source has no cadence filter
+  }
+  if (webServer) {
+    webServer->setCadenceFilter(type);
+  }
+  Serial.printf("Cadence filter: %s\n", ICadenceFilter::typeName(type));
+}
+
+// Workout commands from FTMS apps (Control Point)
+static void applyFtmsRequest() {
+  FtmsControlRequest req;
+  if (!ble.takeFtmsRequest(req)) return;
+
+  switch (req.cmd) {
+    case FtmsCommand::Start:
+      if (workout.isPaused()) {
+        workout.resume();
+        Serial.println("Workout resumed (FTMS)");
+      } else {
+        workout.start();
+        Serial.println("Workout started (FTMS)");
+      }
+      break;
+    case FtmsCommand::Pause:
+      workout.pause();
+      Serial.println("Workout paused (FTMS)");
+      break;
+    case FtmsCommand::Stop:
+    case FtmsCommand::Reset:
+      workout.stop();
+      Serial.println("Workout stopped (FTMS)");
+      break;
+    default:
+      break;
+  }
+  ble.respondFtms(req, BlePackets::FTMS_SUCCESS);
+  ble.reportFtmsStatus(req.cmd);
+}
+
+// CPS offset compensation: with the flywheel stopped the pendulum hangs at
+// zero load, so the 1 s ADC mean there becomes the zero point. Every
+// calibration point moves by the same amount, as linkage drift shifts the
+// whole curve. Needs a 0 kp calibration point. Reports the shift in mV and
+// the load the old zero read at rest, from the first segment's slope.
+static bool applyZeroOffset(int16_t& offsetMv, float& offsetKp) {
+  if (!calibration || !adcService || bleRpm > ZERO_OFFSET_MAX_RPM) return false;
+  // Read, shift and rebuild under the calibration's own lock: the web
+  // server and the calibration process update it from other tasks
+  int shift = 0;
+  if (!calibration->moveZero(adcService->read().avg1s, ZERO_OFFSET_MAX_MV, shift)) return false;
+  offsetMv = (int16_t)shift;
+
+  CalPoint points[MonarkCalibration::MAX_POINTS];
+  CalFit fit;
+  calibration->getPoints(points, fit);
+  offsetKp = shift * (points[1].kp - points[0].kp) / (float)(points[1].adc - points[0].adc);
+  return true;
+}
+
+// Calibration changes from any task (web, calibration process, zero
+// offset) land in NVS from here only. The revision is read before the
+// copy, so a change that slips in between is saved again next time.
+static void saveCalibrationChanges() {
+  if (!calibration) return;
+  uint32_t revision = calibration->getRevision();
+  if (revision == savedCalRevision) return;
+
+  CalPoint points[MonarkCalibration::MAX_POINTS];
+  CalFit fit;
+  uint8_t count = calibration->getPoints(points, fit);
+  settings.saveCalibration(points, count, fit);
+  savedCalRevision = revision;
+}
+
+// CPS Control Point requests from apps, answered once applied
+static void applyCpsRequest() {
+  CpsControlRequest req;
+  if (!ble.takeCpsRequest(req)) return;
+
+  uint8_t param[2];
+  switch (req.op) {
+    case BlePackets::CPS_OP_SET_CRANK_LENGTH:
+      settings.saveCrankLength(req.value);
+      Serial.printf("Crank length set to %.1f mm (CPS)\n", req.value / 2.0f);
+      ble.respondCps(req, BlePackets::CPS_SUCCESS);
+      break;
+    case BlePackets::CPS_OP_REQUEST_CRANK_LENGTH:
+      BlePackets::putU16(param, settings.loadCrankLength());
+      ble.respondCps(req, BlePackets::CPS_SUCCESS, param, 2);
+      break;
+    case BlePackets::CPS_OP_REQUEST_SAMPLING_RATE:
+      param[0] = power->getOutputRate();
+      ble.respondCps(req, BlePackets::CPS_SUCCESS, param, 1);
+      break;
+    case BlePackets::CPS_OP_START_OFFSET_COMPENSATION: {
+      int16_t offsetMv = 0;
+      float offsetKp = 0.0f;
+      if (applyZeroOffset(offsetMv, offsetKp)) {
+        // Apps get the offset in spec units (N at the pedal), not the mV shift
+        int16_t offsetN = BlePackets::cpsOffsetForce(offsetKp, cycleConstant, settings.loadCrankLength());
+        Serial.printf("Zero offset: calibration moved %d mV, %.3f kp, %d N (CPS)\n", offsetMv, offsetKp, offsetN);
+        BlePackets::putS16(param, offsetN);
+        ble.respondCps(req, BlePackets::CPS_SUCCESS, param, 2);
+      } else {
+        Serial.println("Zero offset failed: flywheel moving, load on pendulum or no 0 kp point");
+        ble.respondCps(req, BlePackets::CPS_OPERATION_FAILED);
+      }
+      break;
+    }
+    default:
+      ble.respondCps(req, BlePackets::CPS_NOT_SUPPORTED);
+      break;
+  }
+}
 
 void setup() {
   Serial.begin(115200);
@@ -76,36 +251,75 @@ void setup() {
   // Load calibration (needed for both sim and real)
   Serial.println("Loading calibration...");
   Serial.flush();
-  int a0=CAL_DEF_0KP, a2=CAL_DEF_2KP, a4=CAL_DEF_4KP, a6=CAL_DEF_6KP;
-  bool loaded = settings.loadCalibration(a0, a2, a4, a6);
+  CalPoint calPoints[MonarkCalibration::MAX_POINTS];
+  uint8_t calCount = 0;
+  CalFit calFit = CalFit::Linear;
+  bool loaded = settings.loadCalibration(calPoints, calCount, calFit);
 
   if (loaded) {
     Serial.println("Loaded calibration from NVS.");
   } else {
     Serial.println("Using default/developer calibration.");
+    memcpy(calPoints, CAL_DEFAULT_POINTS, sizeof(CAL_DEFAULT_POINTS));
+    calCount = CAL_DEFAULT_COUNT;
   }
-  Serial.printf("Cal: %d %d %d %d\n", a0, a2, a4, a6);
+  Serial.printf("Cal (%s):", MonarkCalibration::fitName(calFit));
+  for (uint8_t i = 0; i < calCount; i++) {
+    Serial.printf(" %gkp=%d", calPoints[i].kp, calPoints[i].adc);
+  }
+  Serial.println();
 
-  calibration = new MonarkCalibration(a0, a2, a4, a6);
+  calibration = new MonarkCalibration(calPoints, calCount, calFit);
+  savedCalRevision = calibration->getRevision();  // As loaded, or the defaults
 
   // Load cycle constant from settings
-  float cycleConstant = settings.loadCycleConstant(CYCLE_CONSTANT);
+  cycleConstant = settings.loadCycleConstant(CYCLE_CONSTANT);
   Serial.printf("Cycle constant: %.2f\n", cycleConstant);
 
+  // Force ADC service: sole owner of ADC_PIN, shared by power source,
+  // calibration and web
+  adcService = new AdcService(ADC_PIN, ADC_SAMPLE_RATE_HZ, ADC_OUTPUT_RATE_HZ);
+  adcService->begin();
+
   // Load simulator mode from settings (defaults to false)
   bool useSimulator = settings.loadSimulatorMode(false);
   Serial.printf("Simulator mode: %s\n", useSimulator ? "ON" : "OFF");
 
   // Power source (sim or real)
   if (useSimulator) {
-    power = new PowerSimulator(cycleConstant);
+    SimProfile simProfile;
+    uint32_t simSeed;
+    uint8_t simScale;
+    settings.loadSimulatorConfig(simProfile, simSeed, simScale);
+    if (simScale > 1) {
+      // Stress mode: all timing (sim, filters, output rate) runs faster
+      Clock::setScale(simScale);
+      Serial.printf("Simulator time scale: x%u\n", simScale);
+    }
+    power = new PowerSimulator(cycleConstant, calibration, simProfile, simSeed);
   } else {
-    power = new PowerReal(cycleConstant, CADENCE_PIN, ADC_PIN, calibration);
+    power = new PowerReal(cycleConstant, CADENCE_PIN, adcService, calibration);
+  }
+  uint8_t pulsesPerRev = settings.loadPulsesPerRev();
+  if (!power->setPulsesPerRev(pulsesPerRev)) {
+    Serial.printf("%u pulses/rev not supported by this power source\n", pulsesPerRev);
   }
   power->begin();
+  applyOutputRate(settings.loadOutputRate(1));
+  applyRevTrigger(settings.loadRevTrigger(false));
+  applyCadenceFilter(settings.loadCadenceFilter());
+
+  // Sampling and sample production run in their own task from here on
+  subBle = sampleBus.subscribe("ble");
+  subWorkout = sampleBus.subscribe("workout");
+  subDisplay = sampleBus.subscribe("display");
+  subWeb = sampleBus.subscribe("web");
+  powerTask = new PowerTask(power, &sampleBus);
+  powerTask->selectRate((uint8_t)PowerSource::outputRateIndex(power->getOutputRate()));
+  powerTask->begin();
 
   // Init calibration process (available in both modes)
-  calProcess = new CalibrationProcess(CAL_BUTTON_PIN, ADC_PIN, display, &settings, calibration);
+  calProcess = new CalibrationProcess(CAL_BUTTON_PIN, adcService, display, calibration);
   calProcess->begin();
 
   if (!loaded && !DEVELOPER_MODE && !useSimulator) {
@@ -118,18 +332,36 @@ void setup() {
   Serial.printf("Device name: %s\n", deviceName.c_str());
   Serial.flush();
 
-  // BLE CPS transport (uses device name)
+  // BLE transport: CPS, CSC and/or FTMS (uses device name)
   Serial.println("Starting BLE...");
   Serial.flush();
-  ble.begin(deviceName.c_str());
+  uint8_t bleServices = settings.loadBleServices();
+  ble.setWorkout(&workout);
+  ble.setCycleConstant(cycleConstant);
+  ble.begin(deviceName.c_str(), bleServices);
+  Serial.printf("BLE services: CPS %s (torque %s, energy %s), CSC %s (wheel %s), FTMS %s\n",
+                (bleServices & BleServices::SERVICE_CPS) ? "ON" : "OFF",
+                (bleServices & BleServices::SERVICE_CPS_TORQUE) ? "ON" : "OFF",
+                (bleServices & BleServices::SERVICE_CPS_ENERGY) ? "ON" : "OFF",
+                (bleServices & BleServices::SERVICE_CSC) ? "ON" : "OFF",
+                (bleServices & BleServices::SERVICE_CSC_WHEEL) ? "ON" : "OFF",
+                (bleServices & BleServices::SERVICE_FTMS) ? "ON" : "OFF");
   Serial.println("BLE OK");
   Serial.flush();
 
   // Web server for power data and calibration (uses device name for WiFi AP)
   Serial.println("Starting WiFi...");
   Serial.flush();
-  webServer = new PowerWebServer(&settings, calibration, ADC_PIN);
+  webServer = new PowerWebServer(&settings, calibration, adcService);
   webServer->begin();  // Uses device name from settings
+  webServer->setOutputRate(power->getOutputRate());
+  webServer->setRevTrigger(power->getSampleTrigger() == PowerSource::SampleTrigger::Revolution);
+  webServer->setCadenceFilter(power->getCadenceFilter());
+  webServer->setCpuMeter(&cpuMeter);
+  webServer->setPowerTask(powerTask);
+  webServer->setSampleBus(&sampleBus);
+  webServer->setPowerSource(power);
+  webServer->setBle(&ble);
   Serial.println("WiFi OK");
   Serial.flush();
 
@@ -137,14 +369,12 @@ void setup() {
 }
 
 void loop() {
-  uint32_t now = millis();
+  PowerSample s;
 
   // Handle calibration (it manages its own touch input)
   if (calProcess && calProcess->isCalibrating()) {
     calProcess->update();
-    power->update(now);
-    if (power->hasSample()) {
-      PowerSample s = power->getSample();
+    while (sampleBus.read(subBle, s)) {
       ble.notify(s);
     }
     delay(10);
@@ -166,11 +396,12 @@ void loop() {
       }
       else if (action == MenuAction::ViewCalibration) {
         if (calibration) {
+          // First and last point (16x2 LCD has no room for more)
           char line1[32], line2[32];
-          snprintf(line1, sizeof(line1), "0kp:%d 2kp:%d",
-                   calibration->getAdc0(), calibration->getAdc2());
-          snprintf(line2, sizeof(line2), "4kp:%d 6kp:%d",
-                   calibration->getAdc4(), calibration->getAdc6());
+          const CalPoint& lo = calibration->getPoint(0);
+          const CalPoint& hi = calibration->getPoint(calibration->getPointCount() - 1);
+          snprintf(line1, sizeof(line1), "%gkp:%d", lo.kp, lo.adc);
+          snprintf(line2, sizeof(line2), "%gkp:%d", hi.kp, hi.adc);
           display->showMessage(line1, line2);
         }
       }
@@ -219,19 +450,42 @@ void loop() {
     calProcess->update();
   }
 
-  power->update(now);
+  // Output rate changes requested over the web
+  if (webServer) {
+    uint8_t hz = webServer->takeOutputRateRequest();
+    if (hz) applyOutputRate(hz);
+    int8_t perRev = webServer->takeRevTriggerRequest();
+    if (perRev >= 0) applyRevTrigger(perRev);
+    CadenceFilterType filter;
+    if (webServer->takeCadenceFilterRequest(filter)) applyCadenceFilter(filter);
+  }
 
-  if (power->hasSample()) {
-    PowerSample s = power->getSample();
+  // Workout start/stop requested over FTMS, settings and zero offset over CPS
+  applyFtmsRequest();
+  applyCpsRequest();
+  saveCalibrationChanges();
 
-    // Add power sample to workout if running
+  // Each consumer reads the sample bus at its own pace
+  cpuMeter.start();
+
+  // BLE: every sample, so each notification carries its own revolution
+  while (sampleBus.read(subBle, s)) {
+    ble.notify(s);
+    bleRpm = s.rpm;
+  }
+
+  // Workout averages need every sample
+  while (sampleBus.read(subWorkout, s)) {
     if (workout.isRunning()) {
       workout.addPowerSample(s.power_w);
     }
 
     // Serial debug
     //Serial.printf("rpm=%.1f kp=%.2f P=%.1fW rev=%u evt=%u adc=%.2f\n",  s.rpm, s.kp, s.power_w, s.crank_revs, s.crank_evt_1024, s.adc_raw);
+  }
 
+  // Display: skip ahead to the newest sample (skip if menu is open)
+  if (display && !display->isMenuOpen() && sampleBus.readLatest(subDisplay, s)) {
     // Prepare workout display info
     WorkoutDisplay wd;
     wd.active = !workout.isStopped();
@@ -243,19 +497,14 @@ void loop() {
     wd.lapAvgPower = workout.getCurrentLapAvgPower();
     wd.lapNumber = workout.getLapCount();
 
-    // Update display (skip if menu is open)
-    if (display && !display->isMenuOpen()) {
-      display->showPower(s, &wd);
-    }
-
-    // BLE
-    ble.notify(s);
+    display->showPower(s, &wd);
+  }
 
-    // Web server
-    if (webServer) {
-      webServer->updatePowerData(s);
-    }
+  // Web server: newest sample only
+  if (webServer && sampleBus.readLatest(subWeb, s)) {
+    webServer->updatePowerData(s);
   }
+  cpuMeter.stop();
 
   // Yield to async web server and other tasks
   yield();